@@ -0,0 +1,251 @@
+/*
+ * bench.c: measures the throughput of each stage of
+ * sixfive on the given sources
+ *
+ * Usage: bench [-r runs] file.S ...
+ *
+ * Each stage is run on its own, the given number of
+ * times, and reported as the mean time per run, lines
+ * and megabytes of source per second, and how far it
+ * raised the peak resident set size of the process (in
+ * KiB on Linux, in bytes on macOS), which as memory is
+ * kept between runs is mostly on the first.
+ */
+
+/* For the stages themselves, which are not part of the interface */
+#include "../libsixfive.c"
+
+#include <time.h>
+#include <sys/resource.h>
+
+/*****************************/
+/* PREPROCESSOR              */
+/*****************************/
+
+#define DEFAULT_RUNS 20
+
+/*****************************/
+/* ENUMS AND TYPEDEFS        */
+/*****************************/
+
+enum {
+  bench_stage_read,
+  bench_stage_tokenize,
+  bench_stage_eval,
+  bench_stage_labels,
+  bench_stage_write,
+  bench_stage_assemble,
+  bench_stage_count
+};
+
+const char *bench_stage_names[bench_stage_count] = {
+  "read",
+  "tokenize",
+  "instruction_eval",
+  "relax_labels",
+  "write",
+  "sixfive_assemble"
+};
+
+/*
+ * The totals of one stage over every run:
+ * its time, and how far it raised the peak
+ * resident set size
+ */
+typedef struct bench_stage {
+  double seconds;
+  long rss;
+} bench_stage;
+
+/*****************************/
+/* UTILITY FUNCTIONS         */
+/*****************************/
+
+double bench_now(void){
+  struct timespec now;
+
+  clock_gettime(CLOCK_MONOTONIC, &now);
+  return now.tv_sec + now.tv_nsec/1e9;
+}
+
+/*
+ * Returns the peak resident set size of
+ * the process so far
+ */
+long bench_rss(void){
+  struct rusage usage;
+
+  getrusage(RUSAGE_SELF, &usage);
+  return usage.ru_maxrss;
+}
+
+/*****************************/
+/* STAGES                    */
+/*****************************/
+
+/*
+ * Runs every stage on a file, runs times
+ * over, and prints a table of the results
+ */
+int bench_file(char *path, int runs){
+  bench_stage stages[bench_stage_count];
+  sixfive_source source;
+  sixfive_ctx *ctx = sixfive_ctx_new();
+  sixfive_line *tokens = NULL;
+  unsigned char *out_buf = malloc(SIXFIVE_OUTPUT_MAX_LENGTH);
+  const char *line, *eol, *end;
+  unsigned long sum = 0;
+  long lines = 0, length = 0, out_len = 0, i;
+  double start, seconds;
+  long rss;
+  FILE *fp_out;
+  int run, stage, out = sixfive_output_success;
+
+  memset(stages, 0, sizeof(stages));
+  if(ctx == NULL || out_buf == NULL){
+    fprintf(stderr, "bench: out of memory.\n");
+    return sixfive_output_error;
+  }
+
+  for(run=0;run<runs && out != sixfive_output_error;run++){
+    /* Pages of a mapped file are only read once touched */
+    rss = bench_rss();
+    start = bench_now();
+    if(sixfive_source_open(&source, path) == sixfive_output_error){
+      fprintf(stderr, "bench: unable to open file \"%s\" for reading.\n", path);
+      out = sixfive_output_error;
+      break;
+    }
+    for(i=0;i<source.length;i+=4096){
+      sum += (unsigned char)source.data[i];
+    }
+    stages[bench_stage_read].seconds += bench_now() - start;
+    stages[bench_stage_read].rss += bench_rss() - rss;
+    length = source.length;
+
+    if(tokens == NULL){
+      end = source.data + source.length;
+      for(line=source.data;line<end;lines++){
+        eol = memchr(line, '\n', end - line);
+        line = (eol == NULL ? end : eol+1);
+      }
+      tokens = malloc(sizeof(sixfive_line)*(lines+1));
+      if(tokens == NULL){
+        fprintf(stderr, "bench: out of memory.\n");
+        out = sixfive_output_error;
+      }
+    }
+
+    sixfive_ctx_reset(ctx);
+    rss = bench_rss();
+    start = bench_now();
+    end = source.data + source.length;
+    for(i=0,line=source.data;out != sixfive_output_error && line<end;i++){
+      eol = memchr(line, '\n', end - line);
+      if(eol == NULL){
+        eol = end;
+      }
+      if(sixfive_tokens_split(line, eol - line, ctx->wide, &tokens[i]) == sixfive_output_error){
+        fprintf(stderr, "bench: \"%s\" does not assemble, on line %li.\n", path, i+1);
+        out = sixfive_output_error;
+      }
+      line = eol+1;
+    }
+    stages[bench_stage_tokenize].seconds += bench_now() - start;
+    stages[bench_stage_tokenize].rss += bench_rss() - rss;
+
+    /* Each line's labels are defined where it starts, as it is assembled */
+    rss = bench_rss();
+    start = bench_now();
+    for(i=0;out != sixfive_output_error && i<lines;i++){
+      sixfive_tokens_bind(ctx, &tokens[i]);
+      if(sixfive_parse_eval(ctx, &tokens[i], i+1) == sixfive_output_error){
+        fprintf(stderr, "bench: \"%s\" does not assemble, on line %li.\n", path, i+1);
+        out = sixfive_output_error;
+      }
+    }
+    stages[bench_stage_eval].seconds += bench_now() - start;
+    stages[bench_stage_eval].rss += bench_rss() - rss;
+
+    /* Shortens what it can, then patches every reference to a label */
+    rss = bench_rss();
+    start = bench_now();
+    if(out != sixfive_output_error &&
+       (sixfive_relax(ctx) == sixfive_output_error || sixfive_parse_labels(ctx) == sixfive_output_error)){
+      fprintf(stderr, "bench: \"%s\" does not assemble, %s\n", path, ctx->diagnostics[0].message);
+      out = sixfive_output_error;
+    }
+    stages[bench_stage_labels].seconds += bench_now() - start;
+    stages[bench_stage_labels].rss += bench_rss() - rss;
+
+    rss = bench_rss();
+    start = bench_now();
+    fp_out = tmpfile();
+    if(fp_out != NULL){
+      fwrite(ctx->image.data, 1, ctx->image.length, fp_out);
+      fclose(fp_out);
+    }
+    stages[bench_stage_write].seconds += bench_now() - start;
+    stages[bench_stage_write].rss += bench_rss() - rss;
+
+    rss = bench_rss();
+    start = bench_now();
+    out_len = SIXFIVE_OUTPUT_MAX_LENGTH;
+    if(out != sixfive_output_error && sixfive_assemble(ctx, source.data, source.length, out_buf, &out_len, NULL) == sixfive_output_error){
+      fprintf(stderr, "bench: \"%s\" does not assemble, %s\n", path, ctx->diagnostics[0].message);
+      out = sixfive_output_error;
+    }
+    stages[bench_stage_assemble].seconds += bench_now() - start;
+    stages[bench_stage_assemble].rss += bench_rss() - rss;
+
+    sixfive_source_close(&source);
+  }
+
+  if(out != sixfive_output_error){
+    printf("%s: %li lines, %.1f KiB of source, %li bytes of output, %i runs\n", path, lines, length/1024.0, out_len, runs);
+    printf("  %-18s %10s %14s %10s %10s\n", "stage", "ms/run", "lines/s", "MB/s", "+peak RSS");
+    for(stage=0;stage<bench_stage_count;stage++){
+      seconds = stages[stage].seconds / runs;
+      printf("  %-18s %10.3f %14.0f %10.1f %10li\n", bench_stage_names[stage], seconds*1e3,
+        (seconds > 0 ? lines/seconds : 0), (seconds > 0 ? length/1e6/seconds : 0), stages[stage].rss);
+    }
+  }
+
+  /* Keeps the reads above from being optimized away */
+  if(sum == 1){
+    printf("\n");
+  }
+
+  free(tokens);
+  free(out_buf);
+  sixfive_ctx_free(ctx);
+  return out;
+}
+
+/*****************************/
+/* MAIN                      */
+/*****************************/
+
+int main(int argc, char **argv){
+  int runs = DEFAULT_RUNS;
+  int out = 0;
+  int i;
+
+  for(i=1;i<argc;i++){
+    if(i+1 < argc && strcmp(argv[i], "-r") == 0){
+      runs = atoi(argv[++i]);
+      if(runs < 1){
+        runs = 1;
+      }
+    } else if(bench_file(argv[i], runs) == sixfive_output_error){
+      out = 1;
+    }
+  }
+
+  if(argc < 2){
+    fprintf(stderr, "Usage: bench [-r runs] file.S ...\n");
+    return 1;
+  }
+
+  return out;
+}
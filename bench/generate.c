@@ -0,0 +1,255 @@
+/*
+ * generate.c: writes a synthetic 6502 program to stdout,
+ * for benchmarking sixfive
+ *
+ * Usage: generate [-n lines] [-l label%] [-r reference%]
+ *                 [-f forward%] [-c comment%] [-m mix]
+ *                 [-s seed]
+ *
+ * Absolute operands and branches refer to a label
+ * reference% of the time, forward% of those to one
+ * not yet defined (which is, within the next few
+ * labels, or else at the end), so that both
+ * references left to fix up and their relaxation
+ * are exercised.
+ *
+ * mix gives the weight of each addressing mode, in the
+ * order of the columns of SIXFIVE_ISA:
+ *   implied,accumulator,immediate,zeropage,zeropage_x,
+ *   zeropage_y,absolute,absolute_x,absolute_y,indirect,
+ *   indirect_x,indirect_y,relative
+ *
+ * Programs stop short of the requested length if their
+ * output would not fit in the 6502's 64 KiB, counting
+ * each reference to a label at its longest.
+ */
+
+/* For the ISA table, its instruction and mode enums, and mnemonics */
+#include "../libsixfive.c"
+
+/*****************************/
+/* PREPROCESSOR              */
+/*****************************/
+
+#define DEFAULT_LINES 20000
+#define DEFAULT_LABELS 10
+#define DEFAULT_REFERENCES 30
+#define DEFAULT_FORWARD 50
+#define FORWARD_WINDOW 16
+#define DEFAULT_COMMENTS 10
+#define DEFAULT_SEED 1
+
+/* Roughly the mix of a hand-written program */
+#define DEFAULT_MIX "20,3,20,15,5,1,15,6,4,1,2,3,5"
+
+/*****************************/
+/* ENUMS AND TYPEDEFS        */
+/*****************************/
+
+/* Bytes taken by an instruction in each mode */
+const int generate_sizes[sixfive_mode_count] = {
+  1, 1, 2, 2, 2, 2, 3, 3, 3, 3, 2, 2, 2
+};
+
+/* A branch to a label, at its longest: the opposite branch over a JMP */
+#define GENERATE_BRANCH_SIZE 5
+
+/*****************************/
+/* UTILITY FUNCTIONS         */
+/*****************************/
+
+unsigned long generate_state = DEFAULT_SEED;
+
+/*
+ * Marsaglia's xorshift32, so that a seed
+ * gives the same program with any libc
+ */
+unsigned long generate_random(unsigned long n){
+  generate_state ^= (generate_state << 13) & 0xffffffffUL;
+  generate_state ^= generate_state >> 17;
+  generate_state ^= (generate_state << 5) & 0xffffffffUL;
+  return generate_state % n;
+}
+
+/*
+ * Returns a random instruction which has
+ * the given addressing mode
+ */
+int generate_instruction(int mode){
+  int candidates[sixfive_instruction_count];
+  int count = 0, i;
+
+  for(i=0;i<sixfive_instruction_count;i++){
+    if(sixfive_instruction_opcodes[i][mode] != -1){
+      candidates[count++] = i;
+    }
+  }
+
+  return candidates[generate_random(count)];
+}
+
+/*
+ * Returns the label a reference is to: one
+ * already defined, or (forward% of the time,
+ * or if there is none yet) one of the next
+ * few, noting in *wanted how many must be
+ * defined for it to be
+ */
+long generate_label(int defined, int forward, int *wanted){
+  long label;
+
+  if(defined == 0 || (long)generate_random(100) < forward){
+    label = defined + generate_random(FORWARD_WINDOW);
+    if(label >= *wanted){
+      *wanted = label+1;
+    }
+    return label;
+  }
+
+  return generate_random(defined);
+}
+
+/*****************************/
+/* MAIN                      */
+/*****************************/
+
+int main(int argc, char **argv){
+  long lines = DEFAULT_LINES;
+  int labels = DEFAULT_LABELS;
+  int references = DEFAULT_REFERENCES;
+  int forward = DEFAULT_FORWARD;
+  int comments = DEFAULT_COMMENTS;
+  char *mix = DEFAULT_MIX;
+  int weights[sixfive_mode_count];
+  int total = 0, defined = 0, wanted = 0;
+  long bytes = 0, n;
+  int mode, pick, size, label, i;
+  char *c;
+
+  for(i=1;i<argc;i++){
+    if(i+1 < argc && strcmp(argv[i], "-n") == 0){
+      lines = atol(argv[++i]);
+    } else if(i+1 < argc && strcmp(argv[i], "-l") == 0){
+      labels = atoi(argv[++i]);
+    } else if(i+1 < argc && strcmp(argv[i], "-r") == 0){
+      references = atoi(argv[++i]);
+    } else if(i+1 < argc && strcmp(argv[i], "-f") == 0){
+      forward = atoi(argv[++i]);
+    } else if(i+1 < argc && strcmp(argv[i], "-c") == 0){
+      comments = atoi(argv[++i]);
+    } else if(i+1 < argc && strcmp(argv[i], "-m") == 0){
+      mix = argv[++i];
+    } else if(i+1 < argc && strcmp(argv[i], "-s") == 0){
+      generate_state = strtoul(argv[++i], NULL, 10);
+    } else {
+      fprintf(stderr, "Usage: generate [-n lines] [-l label%%] [-r reference%%] [-f forward%%] [-c comment%%] [-m mix] [-s seed]\n");
+      return 1;
+    }
+  }
+  if(generate_state == 0){
+    generate_state = DEFAULT_SEED;
+  }
+
+  c = mix;
+  for(i=0;i<sixfive_mode_count;i++){
+    weights[i] = (int)strtol(c, &c, 10);
+    total += weights[i];
+    if(i < sixfive_mode_count-1 && *c++ != ','){
+      fprintf(stderr, "generate: expected %i comma-separated weights.\n", sixfive_mode_count);
+      return 1;
+    }
+  }
+  if(total <= 0){
+    fprintf(stderr, "generate: the weights must not all be zero.\n");
+    return 1;
+  }
+
+  for(n=0;n<lines;n++){
+    if((long)generate_random(100) < labels){
+      printf("l%i:", defined++);
+    }
+
+    if((long)generate_random(100) < comments){
+      printf(" ; comment %li\n", n);
+      continue;
+    }
+
+    pick = generate_random(total);
+    for(mode=0;pick >= weights[mode];mode++){
+      pick -= weights[mode];
+    }
+
+    /* Only absolute operands and branches refer to labels */
+    label = -1;
+    if(labels > 0 && (mode == sixfive_mode_relative || (mode >= sixfive_mode_absolute && mode <= sixfive_mode_absolute_y)) &&
+       (long)generate_random(100) < references){
+      label = generate_label(defined, forward, &wanted);
+    }
+    size = (label != -1 && mode == sixfive_mode_relative ? GENERATE_BRANCH_SIZE : generate_sizes[mode]);
+
+    /* Leaving those still wanted short of $ffff, which no label may be at */
+    if(bytes + size > SIXFIVE_OUTPUT_MAX_LENGTH - 2){
+      printf("\n");
+      fprintf(stderr, "generate: stopped after %li lines, at the 6502's 64 KiB limit.\n", n+1);
+      break;
+    }
+    bytes += size;
+
+    printf("  %.3s", sixfive_instruction_names[generate_instruction(mode)]);
+    switch(mode){
+      case sixfive_mode_accumulator:
+        printf(" A");
+        break;
+      case sixfive_mode_immediate:
+        printf(" #$%.2lx", generate_random(0x100));
+        break;
+      case sixfive_mode_zeropage:
+        printf(" $%.2lx", generate_random(0x100));
+        break;
+      case sixfive_mode_relative:
+        if(label != -1){
+          printf(" l%i", label);
+        } else {
+          printf(" $%.2lx", generate_random(0x100));
+        }
+        break;
+      case sixfive_mode_zeropage_x:
+        printf(" $%.2lx,X", generate_random(0x100));
+        break;
+      case sixfive_mode_zeropage_y:
+        printf(" $%.2lx,Y", generate_random(0x100));
+        break;
+      case sixfive_mode_absolute:
+      case sixfive_mode_absolute_x:
+      case sixfive_mode_absolute_y:
+        if(label != -1){
+          printf(" l%i", label);
+        } else {
+          printf(" $%.4lx", generate_random(0x10000));
+        }
+        if(mode == sixfive_mode_absolute_x){
+          printf(",X");
+        } else if(mode == sixfive_mode_absolute_y){
+          printf(",Y");
+        }
+        break;
+      case sixfive_mode_indirect:
+        printf(" ($%.4lx)", generate_random(0x10000));
+        break;
+      case sixfive_mode_indirect_x:
+        printf(" ($%.2lx,X)", generate_random(0x100));
+        break;
+      case sixfive_mode_indirect_y:
+        printf(" ($%.2lx),Y", generate_random(0x100));
+        break;
+    }
+    printf("\n");
+  }
+
+  /* Any label referred to but not yet defined is, at the end */
+  for(;defined < wanted;defined++){
+    printf("l%i:\n", defined);
+  }
+
+  return 0;
+}
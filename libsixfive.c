@@ -0,0 +1,6923 @@
+/*
+ * libsixfive.c: an assembler for the 6502 microprocessor
+ *
+ * See sixfive.h for the interface
+ */
+
+/*
+ * Source files are mmapped, large ones
+ * assembled on several threads, and phases
+ * timed by the wall clock, where POSIX is
+ * available
+ */
+#if defined(__unix__) || defined(__APPLE__)
+#define _POSIX_C_SOURCE 200112L
+#define SIXFIVE_MMAP
+#define SIXFIVE_THREADS
+#define SIXFIVE_CLOCK
+#endif
+
+#include <stdio.h>
+#include <string.h>
+#include <strings.h>
+#include <stdint.h>
+#include <stdarg.h>
+#include <stdlib.h>
+#include <ctype.h>
+#include <time.h>
+
+#ifdef SIXFIVE_MMAP
+#include <fcntl.h>
+#include <unistd.h>
+#include <sys/mman.h>
+#include <sys/stat.h>
+#endif
+
+#ifdef SIXFIVE_THREADS
+#include <pthread.h>
+#endif
+
+/*
+ * Lines are scanned for the characters which
+ * end a token 16 bytes at a time with SSE2,
+ * or 32 with AVX2 where the CPU has it, on
+ * x86 compilers which can select it at run
+ * time (or, built with SIXFIVE_NO_SIMD, a
+ * byte at a time)
+ */
+#if defined(__GNUC__) && defined(__SSE2__) && (defined(__x86_64__) || defined(__i386__)) && !defined(SIXFIVE_NO_SIMD)
+#define SIXFIVE_SSE2
+#include <emmintrin.h>
+#if __GNUC__ >= 5 || defined(__clang__)
+#define SIXFIVE_AVX2
+#include <immintrin.h>
+#endif
+#endif
+
+#include "sixfive.h"
+
+/*****************************/
+/* PREPROCESSOR              */
+/*****************************/
+
+#define OUTPUT_INITIAL_LENGTH 0x1000
+#define DIAGNOSTICS_INITIAL_COUNT 16
+#define MAX_OPERANDS 2
+#define MAX_MACRO_PARAMS 16
+#define MAX_NESTING 64
+#define MACRO_LINE_LENGTH 1024
+#define MAX_EXPR_OPS 64
+#define READ_BLOCK_LENGTH 0x10000
+#define DISASSEMBLY_LINE_LENGTH 24
+#define LABELS_INITIAL_COUNT 64
+#define ARENA_BLOCK_LENGTH 0x4000
+
+#define FIXUPS_INITIAL_COUNT 256
+#define LISTING_INITIAL_COUNT 256
+#define MACROS_INITIAL_COUNT 16
+#define BODIES_INITIAL_COUNT 256
+#define EXPRS_INITIAL_COUNT 256
+#define OBJECT_VERSION 1
+#define MEMORY_LENGTH 0x10000
+#define UNITS_PER_THREAD 4
+#define UNIT_MIN_LENGTH 0x10000
+#define WATCH_UNIT_LENGTH 0x1000
+#define WATCH_COMPARE_LENGTH 256
+#define MAX_THREADS 256
+#define ADDRESS_UNKNOWN 0xffff
+
+#define LENGTH(x) (sizeof(x)/sizeof(x[0]))
+
+/*****************************/
+/* UTILITY FUNCTIONS         */
+/*****************************/
+
+/*
+ * Dan Bernstein's hash algorithm,
+ * http://www.cse.yorku.ca/~oz/hash.html
+ */
+unsigned long djb2hash(const unsigned char *str, int len){
+  unsigned long hash = 5381;
+
+  while(len-- > 0){
+    hash = ((hash << 5) + hash) + *str++; /* hash * 33 + c */
+  }
+
+  return hash;
+}
+
+/*
+ * Returns the value of a hex digit,
+ * or -1 if c is not one
+ */
+int hex_digit(char c){
+  if(c >= '0' && c <= '9'){
+    return c - '0';
+  }
+  if(c >= 'a' && c <= 'f'){
+    return c - 'a' + 10;
+  }
+  if(c >= 'A' && c <= 'F'){
+    return c - 'A' + 10;
+  }
+  return -1;
+}
+
+/*****************************/
+/* ENUMS AND TYPEDEFS        */
+/*****************************/
+
+/*
+ * The 6502 instruction set: one row per mnemonic
+ * (with its letters spelled out for the lookup
+ * switch below) and one column per addressing
+ * mode, -1 where a mode does not exist
+ *
+ * The instruction enum, the opcode table, and the
+ * mnemonic lookup are all generated from this list.
+ *
+ * Instruction set used:
+ * https://www.masswerk.at/6502/6502_instruction_set.html
+ */
+#define SIXFIVE_ISA(I) \
+/*                     impl  A     #     zp    zp,X  zp,Y  abs   abs,X abs,Y (ind) (,X)  (),Y  rel */ \
+  I(ADC, 'A','D','C',   -1,   -1, 0x69, 0x65, 0x75,   -1, 0x6d, 0x7d, 0x79,   -1, 0x61, 0x71,   -1) \
+  I(AND, 'A','N','D',   -1,   -1, 0x29, 0x25, 0x35,   -1, 0x2d, 0x3d, 0x39,   -1, 0x21, 0x31,   -1) \
+  I(ASL, 'A','S','L',   -1, 0x0a,   -1, 0x06, 0x16,   -1, 0x0e, 0x1e,   -1,   -1,   -1,   -1,   -1) \
+  I(BCC, 'B','C','C',   -1,   -1,   -1,   -1,   -1,   -1,   -1,   -1,   -1,   -1,   -1,   -1, 0x90) \
+  I(BCS, 'B','C','S',   -1,   -1,   -1,   -1,   -1,   -1,   -1,   -1,   -1,   -1,   -1,   -1, 0xb0) \
+  I(BEQ, 'B','E','Q',   -1,   -1,   -1,   -1,   -1,   -1,   -1,   -1,   -1,   -1,   -1,   -1, 0xf0) \
+  I(BIT, 'B','I','T',   -1,   -1,   -1, 0x24,   -1,   -1, 0x2c,   -1,   -1,   -1,   -1,   -1,   -1) \
+  I(BMI, 'B','M','I',   -1,   -1,   -1,   -1,   -1,   -1,   -1,   -1,   -1,   -1,   -1,   -1, 0x30) \
+  I(BNE, 'B','N','E',   -1,   -1,   -1,   -1,   -1,   -1,   -1,   -1,   -1,   -1,   -1,   -1, 0xd0) \
+  I(BPL, 'B','P','L',   -1,   -1,   -1,   -1,   -1,   -1,   -1,   -1,   -1,   -1,   -1,   -1, 0x10) \
+  I(BRK, 'B','R','K', 0x00,   -1,   -1,   -1,   -1,   -1,   -1,   -1,   -1,   -1,   -1,   -1,   -1) \
+  I(BVC, 'B','V','C',   -1,   -1,   -1,   -1,   -1,   -1,   -1,   -1,   -1,   -1,   -1,   -1, 0x50) \
+  I(BVS, 'B','V','S',   -1,   -1,   -1,   -1,   -1,   -1,   -1,   -1,   -1,   -1,   -1,   -1, 0x70) \
+  I(CLC, 'C','L','C', 0x18,   -1,   -1,   -1,   -1,   -1,   -1,   -1,   -1,   -1,   -1,   -1,   -1) \
+  I(CLD, 'C','L','D', 0xd8,   -1,   -1,   -1,   -1,   -1,   -1,   -1,   -1,   -1,   -1,   -1,   -1) \
+  I(CLI, 'C','L','I', 0x58,   -1,   -1,   -1,   -1,   -1,   -1,   -1,   -1,   -1,   -1,   -1,   -1) \
+  I(CLV, 'C','L','V', 0xb8,   -1,   -1,   -1,   -1,   -1,   -1,   -1,   -1,   -1,   -1,   -1,   -1) \
+  I(CMP, 'C','M','P',   -1,   -1, 0xc9, 0xc5, 0xd5,   -1, 0xcd, 0xdd, 0xd9,   -1, 0xc1, 0xd1,   -1) \
+  I(CPX, 'C','P','X',   -1,   -1, 0xe0, 0xe4,   -1,   -1, 0xec,   -1,   -1,   -1,   -1,   -1,   -1) \
+  I(CPY, 'C','P','Y',   -1,   -1, 0xc0, 0xc4,   -1,   -1, 0xcc,   -1,   -1,   -1,   -1,   -1,   -1) \
+  I(DEC, 'D','E','C',   -1,   -1,   -1, 0xc6, 0xd6,   -1, 0xce, 0xde,   -1,   -1,   -1,   -1,   -1) \
+  I(DEX, 'D','E','X', 0xca,   -1,   -1,   -1,   -1,   -1,   -1,   -1,   -1,   -1,   -1,   -1,   -1) \
+  I(DEY, 'D','E','Y', 0x88,   -1,   -1,   -1,   -1,   -1,   -1,   -1,   -1,   -1,   -1,   -1,   -1) \
+  I(EOR, 'E','O','R',   -1,   -1, 0x49, 0x45, 0x55,   -1, 0x4d, 0x5d, 0x59,   -1, 0x41, 0x51,   -1) \
+  I(INC, 'I','N','C',   -1,   -1,   -1, 0xe6, 0xf6,   -1, 0xee, 0xfe,   -1,   -1,   -1,   -1,   -1) \
+  I(INX, 'I','N','X', 0xe8,   -1,   -1,   -1,   -1,   -1,   -1,   -1,   -1,   -1,   -1,   -1,   -1) \
+  I(INY, 'I','N','Y', 0xc8,   -1,   -1,   -1,   -1,   -1,   -1,   -1,   -1,   -1,   -1,   -1,   -1) \
+  I(JMP, 'J','M','P',   -1,   -1,   -1,   -1,   -1,   -1, 0x4c,   -1,   -1, 0x6c,   -1,   -1,   -1) \
+  I(JSR, 'J','S','R',   -1,   -1,   -1,   -1,   -1,   -1, 0x20,   -1,   -1,   -1,   -1,   -1,   -1) \
+  I(LDA, 'L','D','A',   -1,   -1, 0xa9, 0xa5, 0xb5,   -1, 0xad, 0xbd, 0xb9,   -1, 0xa1, 0xb1,   -1) \
+  I(LDX, 'L','D','X',   -1,   -1, 0xa2, 0xa6,   -1, 0xb6, 0xae,   -1, 0xbe,   -1,   -1,   -1,   -1) \
+  I(LDY, 'L','D','Y',   -1,   -1, 0xa0, 0xa4, 0xb4,   -1, 0xac, 0xbc,   -1,   -1,   -1,   -1,   -1) \
+  I(LSR, 'L','S','R',   -1, 0x4a,   -1, 0x46, 0x56,   -1, 0x4e, 0x5e,   -1,   -1,   -1,   -1,   -1) \
+  I(NOP, 'N','O','P', 0xea,   -1,   -1,   -1,   -1,   -1,   -1,   -1,   -1,   -1,   -1,   -1,   -1) \
+  I(ORA, 'O','R','A',   -1,   -1, 0x09, 0x05, 0x15,   -1, 0x0d, 0x1d, 0x19,   -1, 0x01, 0x11,   -1) \
+  I(PHA, 'P','H','A', 0x48,   -1,   -1,   -1,   -1,   -1,   -1,   -1,   -1,   -1,   -1,   -1,   -1) \
+  I(PHP, 'P','H','P', 0x08,   -1,   -1,   -1,   -1,   -1,   -1,   -1,   -1,   -1,   -1,   -1,   -1) \
+  I(PLA, 'P','L','A', 0x68,   -1,   -1,   -1,   -1,   -1,   -1,   -1,   -1,   -1,   -1,   -1,   -1) \
+  I(PLP, 'P','L','P', 0x28,   -1,   -1,   -1,   -1,   -1,   -1,   -1,   -1,   -1,   -1,   -1,   -1) \
+  I(ROL, 'R','O','L',   -1, 0x2a,   -1, 0x26, 0x36,   -1, 0x2e, 0x3e,   -1,   -1,   -1,   -1,   -1) \
+  I(ROR, 'R','O','R',   -1, 0x6a,   -1, 0x66, 0x76,   -1, 0x6e, 0x7e,   -1,   -1,   -1,   -1,   -1) \
+  I(RTI, 'R','T','I', 0x40,   -1,   -1,   -1,   -1,   -1,   -1,   -1,   -1,   -1,   -1,   -1,   -1) \
+  I(RTS, 'R','T','S', 0x60,   -1,   -1,   -1,   -1,   -1,   -1,   -1,   -1,   -1,   -1,   -1,   -1) \
+  I(SBC, 'S','B','C',   -1,   -1, 0xe9, 0xe5, 0xf5,   -1, 0xed, 0xfd, 0xf9,   -1, 0xe1, 0xf1,   -1) \
+  I(SEC, 'S','E','C', 0x38,   -1,   -1,   -1,   -1,   -1,   -1,   -1,   -1,   -1,   -1,   -1,   -1) \
+  I(SED, 'S','E','D', 0xf8,   -1,   -1,   -1,   -1,   -1,   -1,   -1,   -1,   -1,   -1,   -1,   -1) \
+  I(SEI, 'S','E','I', 0x78,   -1,   -1,   -1,   -1,   -1,   -1,   -1,   -1,   -1,   -1,   -1,   -1) \
+  I(STA, 'S','T','A',   -1,   -1,   -1, 0x85, 0x95,   -1, 0x8d, 0x9d, 0x99,   -1, 0x81, 0x91,   -1) \
+  I(STX, 'S','T','X',   -1,   -1,   -1, 0x86,   -1, 0x96, 0x8e,   -1,   -1,   -1,   -1,   -1,   -1) \
+  I(STY, 'S','T','Y',   -1,   -1,   -1, 0x84, 0x94,   -1, 0x8c,   -1,   -1,   -1,   -1,   -1,   -1) \
+  I(TAX, 'T','A','X', 0xaa,   -1,   -1,   -1,   -1,   -1,   -1,   -1,   -1,   -1,   -1,   -1,   -1) \
+  I(TAY, 'T','A','Y', 0xa8,   -1,   -1,   -1,   -1,   -1,   -1,   -1,   -1,   -1,   -1,   -1,   -1) \
+  I(TSX, 'T','S','X', 0xba,   -1,   -1,   -1,   -1,   -1,   -1,   -1,   -1,   -1,   -1,   -1,   -1) \
+  I(TXA, 'T','X','A', 0x8a,   -1,   -1,   -1,   -1,   -1,   -1,   -1,   -1,   -1,   -1,   -1,   -1) \
+  I(TXS, 'T','X','S', 0x9a,   -1,   -1,   -1,   -1,   -1,   -1,   -1,   -1,   -1,   -1,   -1,   -1) \
+  I(TYA, 'T','Y','A', 0x98,   -1,   -1,   -1,   -1,   -1,   -1,   -1,   -1,   -1,   -1,   -1,   -1)
+
+/* Index of each mnemonic's row in the table above */
+#define SIXFIVE_ISA_ENUM(m, c0, c1, c2, imp, acc, imm, zp, zpx, zpy, ab, abx, aby, ind, inx, iny, rel) \
+  sixfive_instruction_##m,
+enum {
+  SIXFIVE_ISA(SIXFIVE_ISA_ENUM)
+  sixfive_instruction_count
+};
+
+/* Column of each addressing mode in the table above */
+enum {
+  sixfive_mode_implied,
+  sixfive_mode_accumulator,
+  sixfive_mode_immediate,
+  sixfive_mode_zeropage,
+  sixfive_mode_zeropage_x,
+  sixfive_mode_zeropage_y,
+  sixfive_mode_absolute,
+  sixfive_mode_absolute_x,
+  sixfive_mode_absolute_y,
+  sixfive_mode_indirect,
+  sixfive_mode_indirect_x,
+  sixfive_mode_indirect_y,
+  sixfive_mode_relative,
+  sixfive_mode_count
+};
+
+/* Used to describe the parser's state */
+enum {
+  sixfive_state_unknown,
+  sixfive_state_comment,
+  sixfive_state_instruction,
+  sixfive_state_operand,
+  sixfive_state_label,
+  sixfive_state_directive
+};
+
+/* How a fixup may change the size of the output */
+enum {
+  sixfive_relax_none,
+  sixfive_relax_zeropage,
+  sixfive_relax_branch,
+  sixfive_relax_jump,
+  sixfive_relax_org
+};
+
+/*
+ * How an object's symbol is seen by other
+ * objects, as a label's flags and as the
+ * kind of each symbol in the object
+ */
+enum {
+  sixfive_symbol_local=0,
+  sixfive_symbol_export=1,
+  sixfive_symbol_import=2
+};
+
+/* How an object's section may be placed */
+enum {
+  sixfive_section_relocatable=0,
+  sixfive_section_absolute=1
+};
+
+/* Which of two instructions in a row the optimizer removes */
+enum {
+  sixfive_peephole_keep,
+  sixfive_peephole_first,
+  sixfive_peephole_second,
+  sixfive_peephole_tail
+};
+
+/* What the disassembler knows of each byte */
+enum {
+  sixfive_disassembly_line=1,  /* Starts a line */
+  sixfive_disassembly_target=2 /* Is an address some operand uses */
+};
+
+/* Directives, which begin with a '.' */
+enum {
+  sixfive_directive_org,
+  sixfive_directive_byte,
+  sixfive_directive_word,
+  sixfive_directive_fill,
+  sixfive_directive_incbin,
+  sixfive_directive_include,
+  sixfive_directive_macro,
+  sixfive_directive_endm,
+  sixfive_directive_rept,
+  sixfive_directive_endr,
+  sixfive_directive_export,
+  sixfive_directive_import,
+  sixfive_directive_count
+};
+
+/*
+ * A span of the source text, which is
+ * never copied or modified (and need
+ * not be NUL-terminated)
+ */
+typedef struct sixfive_token {
+  const char *str;
+  int len;
+} sixfive_token;
+
+/*
+ * The tokens of a single line: its
+ * instruction (or -1 if it has none),
+ * and its operands (where argc is -1 if
+ * there are too many)
+ *
+ * A line holding a directive instead has
+ * its type (or -1), its name, and the rest
+ * of the line as its arguments, as does
+ * any other (its mnemonic, so that it may
+ * name a macro, and the rest).
+ *
+ * text is the whole line, without its
+ * newline, and labels the part of it which
+ * defines labels.  tokens counts them all.
+ *
+ * num is the line's number in its file,
+ * and match, for the lines which start
+ * and end a .macro or .rept, how many lines
+ * away the other is (or 0), so that blocks
+ * keep their pairs wherever they are copied
+ * to, see sixfive_tokens_match.
+ * params is set if the line holds a '\',
+ * so may use a macro's parameters.
+ */
+typedef struct sixfive_line {
+  sixfive_token text;
+  int instruction;
+  int argc;
+  sixfive_token args[MAX_OPERANDS+1];
+  int directive;
+  sixfive_token name;
+  sixfive_token rest;
+  sixfive_token labels;
+  int tokens;
+  int num;
+  int match;
+  int params;
+} sixfive_line;
+
+/* Growable list of lines split into tokens */
+typedef struct sixfive_lines {
+  sixfive_line *list;
+  int count;
+  int capacity;
+} sixfive_lines;
+
+/* 
+ * Used to store identifying information
+ * about a label, used on the parser's
+ * second pass
+ *
+ * mark is the number of fixups recorded
+ * before the label was defined, used to
+ * move it when the output is relaxed, and
+ * flags whether it is exported or imported
+ * by an object
+ */
+typedef struct sixfive_label {
+  char *string;
+  unsigned long hash;
+  uint16_t address;
+  int mark;
+  int flags;
+} sixfive_label;
+
+/*
+ * A reference to a label whose address
+ * is not known until the whole file has
+ * been parsed, to be patched into the
+ * output afterwards
+ *
+ * One whose expr is not -1 is patched with
+ * the value of that expression (in the
+ * context's exprs) instead, where * is the
+ * address here bytes from its offset.
+ *
+ * One which relaxes instead marks the start
+ * of an instruction written at its longest,
+ * with its current width and the opcode of
+ * its short form, or the padding of a .org
+ * (with no label, and the address it pads
+ * up to as its width).
+ */
+typedef struct sixfive_fixup {
+  long offset;
+  int label;
+  int expr;
+  int here;
+  int width;
+  int line;
+  int relax;
+  int opcode;
+} sixfive_fixup;
+
+/*
+ * A block of an arena, followed by size
+ * bytes, of which used are handed out
+ */
+typedef struct sixfive_arena_block {
+  struct sixfive_arena_block *next;
+  size_t used;
+  size_t size;
+} sixfive_arena_block;
+
+/*
+ * Bump allocator for what lives until the
+ * next assembly, whose blocks are chained
+ * (so that nothing handed out ever moves)
+ * and kept when it is emptied, current
+ * being the one being handed out from
+ */
+typedef struct sixfive_arena {
+  sixfive_arena_block *first;
+  sixfive_arena_block *current;
+  long allocations;
+} sixfive_arena;
+
+/*
+ * Open-addressed hash table of labels,
+ * grown (and rehashed) as it fills
+ *
+ * Labels are kept in order of first
+ * appearance, and each slot holds the
+ * index of a label plus one, or zero if
+ * it is empty, and names are interned
+ * into an arena shared with the context
+ */
+typedef struct sixfive_symtab {
+  sixfive_label *labels;
+  int count;
+  int capacity;
+  int *slots;
+  int slot_mask;
+  sixfive_arena *names;
+  long lookups;
+  long probes;
+  long probe_max;
+  long allocations;
+} sixfive_symtab;
+
+/*
+ * The assembled output, kept in memory
+ * until the whole file has assembled
+ * successfully, where length doubles as
+ * the write cursor
+ */
+typedef struct sixfive_image {
+  unsigned char *data;
+  long length;
+  long capacity;
+} sixfive_image;
+
+/* Operations of a compiled expression */
+enum {
+  sixfive_expr_end,
+  sixfive_expr_value,
+  sixfive_expr_label,
+  sixfive_expr_here,
+  sixfive_expr_negate,
+  sixfive_expr_not,
+  sixfive_expr_low,
+  sixfive_expr_high,
+  sixfive_expr_add,
+  sixfive_expr_sub,
+  sixfive_expr_mul,
+  sixfive_expr_div,
+  sixfive_expr_and,
+  sixfive_expr_or,
+  sixfive_expr_xor,
+  sixfive_expr_shl,
+  sixfive_expr_shr
+};
+
+/*
+ * One operation of an expression, which are
+ * kept in postfix order, ending with
+ * sixfive_expr_end: a value (or the index of
+ * a label, whose address is) to push, or an
+ * operator applied to the values on top
+ */
+typedef struct sixfive_expr_op {
+  int op;
+  long value;
+} sixfive_expr_op;
+
+/* Growable list of the operations of every expression left to resolve */
+typedef struct sixfive_exprs {
+  sixfive_expr_op *list;
+  int count;
+  int capacity;
+} sixfive_exprs;
+
+/*
+ * An expression, once compiled: its value,
+ * if it is constant, or else the label it
+ * names (if it is nothing more, or -1) and
+ * where its operations start in the
+ * context's exprs (or -1)
+ *
+ * wide is set if it holds a hex number of
+ * more than two digits, written as a word.
+ */
+typedef struct sixfive_value {
+  long value;
+  int label;
+  int expr;
+  int wide;
+} sixfive_value;
+
+/*
+ * An expression being compiled, from c up
+ * to end, into ops, where constant parts
+ * are worked out as they are added (and
+ * zero is set on dividing by zero)
+ */
+typedef struct sixfive_expr_parser {
+  sixfive_ctx *ctx;
+  const char *c;
+  const char *end;
+  sixfive_expr_op ops[MAX_EXPR_OPS];
+  int count;
+  int wide;
+  int zero;
+} sixfive_expr_parser;
+
+/*
+ * An instruction's operand: its addressing
+ * mode (for an address, the zero page one,
+ * until it is known not to fit), its value,
+ * and its text, and whether it is only a
+ * number rather than an expression
+ */
+typedef struct sixfive_operand {
+  int mode;
+  sixfive_value value;
+  sixfive_token text;
+  int literal;
+} sixfive_operand;
+
+/*
+ * How the disassembler writes an opcode: its
+ * text up to its operand (as "  LDA ($"), and
+ * after it (as "),Y"), each copied whole and
+ * then cut to its length, its length and
+ * addressing mode (or -1 for a .byte), and
+ * the byte written in hex between them, if
+ * digits is 2, at value_at (as for "$ff")
+ */
+typedef struct sixfive_disassembly_op {
+  char before[12];
+  char after[4];
+  unsigned char before_len;
+  unsigned char after_len;
+  unsigned char length;
+  signed char mode;
+  unsigned char value_at;
+  unsigned char digits;
+} sixfive_disassembly_op;
+
+/* Growable list of fixups, in output order */
+typedef struct sixfive_fixups {
+  sixfive_fixup *list;
+  int count;
+  int capacity;
+} sixfive_fixups;
+
+/*
+ * A line which assembled into the output
+ * (or would have, had it any bytes), at
+ * offset, with mark fixups before it, as
+ * for labels
+ *
+ * code is set for instructions, rather
+ * than directives.
+ */
+typedef struct sixfive_listed {
+  long offset;
+  int line;
+  int mark;
+  int code;
+} sixfive_listed;
+
+/* Growable list of listed lines, in output order */
+typedef struct sixfive_listeds {
+  sixfive_listed *list;
+  int count;
+  int capacity;
+} sixfive_listeds;
+
+/*
+ * A file read by .include, split into
+ * lines of tokens (leaving out those with
+ * none), which are kept for as long as it
+ * is unmodified since mtime
+ *
+ * refs counts the contexts using it, and
+ * its cache, while it is the latest.
+ */
+typedef struct sixfive_included {
+  char *path;
+  time_t mtime;
+  long size;
+  sixfive_source source;
+  sixfive_line *lines;
+  int count;
+  int refs;
+  sixfive_cache *cache;
+  struct sixfive_included *next;
+} sixfive_included;
+
+/*
+ * Every file included so far, see
+ * sixfive_cache_get, split into lines with
+ * the scanner wide picks (see sixfive_scan)
+ */
+struct sixfive_cache {
+  sixfive_included *files;
+  int wide;
+#ifdef SIXFIVE_THREADS
+  pthread_mutex_t lock;
+#endif
+};
+
+/*
+ * A macro: count lines of tokens from first,
+ * in lines (or in the context's bodies, if
+ * NULL), with the given parameters
+ *
+ * source is the text it was defined in, for
+ * the optimizer to look at.
+ */
+typedef struct sixfive_macro {
+  const char *name;
+  const sixfive_line *lines;
+  int first;
+  int count;
+  const char *source;
+  long source_length;
+  sixfive_token params[MAX_MACRO_PARAMS];
+  int param_count;
+} sixfive_macro;
+
+/*
+ * What the lines being assembled came from:
+ * a macro, with its arguments and a number
+ * unique to each expansion (for \@), or the
+ * included file at path
+ */
+typedef struct sixfive_expansion {
+  sixfive_macro macro;
+  sixfive_token args[MAX_MACRO_PARAMS];
+  int is_macro;
+  unsigned long unique;
+  const char *path;
+} sixfive_expansion;
+
+/*
+ * The registers of the processor being
+ * run, and its memory
+ */
+typedef struct sixfive_cpu {
+  unsigned char *memory;
+  unsigned int a;
+  unsigned int x;
+  unsigned int y;
+  unsigned int s;
+  unsigned int p;
+  unsigned int pc;
+} sixfive_cpu;
+
+/*
+ * A run of whole lines of a large file,
+ * assembled on its own (by a context of its
+ * own) as though it started at address 0,
+ * then moved to its base address and linked
+ * against the labels of every other unit
+ *
+ * globals maps each of the unit's labels to
+ * the same label in the file's symbol table,
+ * and base is the unit's offset in the file's
+ * image.  address and placed are where the
+ * unit was parsed to start, and whether any
+ * bytes were assumed to come before it.
+ *
+ * A dirty unit has yet to be parsed, and an
+ * unlinked one has yet to be copied into the
+ * image at its current base.
+ */
+typedef struct sixfive_unit {
+  sixfive_ctx *ctx;
+  const char *src;
+  long length;
+  long base;
+  long address;
+  int placed;
+  int lines;
+  int status;
+  int dirty;
+  int linked;
+  int *globals;
+  int globals_capacity;
+} sixfive_unit;
+
+/*
+ * An object being read, up to end, where
+ * error is set once anything is read past
+ * its end
+ */
+typedef struct sixfive_reader {
+  const unsigned char *c;
+  const unsigned char *end;
+  int error;
+} sixfive_reader;
+
+/*
+ * Everything needed to assemble one file,
+ * kept (along with its memory) between
+ * files so that contexts can be reused
+ *
+ * arena holds the names of the labels in
+ * symtab and the macros in macro_names,
+ * and is emptied (not freed) for each file.
+ *
+ * previous holds the address of every label
+ * as of the last layout of the units, and
+ * text a copy of the source they were split
+ * from, while watching.
+ *
+ * A stream, see sixfive_stream_write, keeps
+ * in text only what it has not yet parsed
+ * (from stream_parsed) and the line before,
+ * with lines_before the lines it has, or
+ * all of it if stream_whole is set.
+ * stream_status is how parsing it went.
+ *
+ * stats counts the work of the current
+ * assembly, and timing enables its times.
+ * wide picks the scanner lines are split
+ * with, see sixfive_scan, once per context.
+ *
+ * origin is the address of the first byte of
+ * the image, and placed is set once any byte
+ * of the file has been (so that a leading
+ * .org moves the origin instead of padding).
+ * fixed and external are set once a .org or
+ * .incbin is parsed.  here is the offset the
+ * line being parsed starts at, which * in an
+ * expression stands for the address of, and
+ * exprs holds expressions left to resolve.
+ *
+ * relaxable counts the fixups which may yet
+ * be shortened, and shifts is room to move
+ * them in, see sixfive_relax.
+ *
+ * optimize enables the optimizer, which
+ * looks at the lines around each one in
+ * source, the whole file being assembled.
+ *
+ * listing enables recording each line's
+ * output in listed, which once assembled
+ * is described in lines.
+ *
+ * memory, counts, and cycles are the memory
+ * of the last run of the output, and how
+ * often and for how long each address ran,
+ * and profile describes each listed line's.
+ *
+ * cache holds the files read by .include
+ * (shared, or own_cache if none was set),
+ * and held those this assembly uses.
+ * macros are found by name in macro_names,
+ * whose marks are their indices (or -1),
+ * and bodies holds the lines of those (and
+ * of .rept blocks) in the file itself.
+ * expansions counts every macro expanded.
+ *
+ * object enables writing the output as an
+ * object, into object_data, see
+ * sixfive_object_write.  links and bases
+ * are the symbols of the object being
+ * linked and the base address of every
+ * section, see sixfive_link.
+ */
+struct sixfive_ctx {
+  sixfive_symtab symtab;
+  sixfive_arena arena;
+  sixfive_fixups fixups;
+  sixfive_image image;
+  sixfive_diagnostic *diagnostics;
+  int diagnostic_count;
+  int diagnostic_capacity;
+  int threads;
+  int wide;
+  sixfive_unit *units;
+  int unit_count;
+  int unit_capacity;
+  int next_unit;
+  int linking;
+  uint16_t *previous;
+  int previous_count;
+  int previous_capacity;
+  char *text;
+  long text_length;
+  long text_capacity;
+  int watching;
+  int lines_before;
+  long stream_parsed;
+  int stream_status;
+  int stream_whole;
+  sixfive_stats stats;
+  int timing;
+  long origin;
+  int placed;
+  int fixed;
+  int external;
+  long here;
+  sixfive_exprs exprs;
+  char directory[FILENAME_MAX];
+  int relaxable;
+  long *shifts;
+  int shifts_capacity;
+  int optimize;
+  const char *source;
+  long source_length;
+  int listing;
+  sixfive_listeds listed;
+  sixfive_listing_line *lines;
+  int line_count;
+  int line_capacity;
+  unsigned char *memory;
+  unsigned long *counts;
+  unsigned long *cycles;
+  sixfive_profile_line *profile;
+  int profile_count;
+  int profile_capacity;
+  sixfive_cache *cache;
+  sixfive_cache *own_cache;
+  sixfive_included **held;
+  int held_count;
+  int held_capacity;
+  sixfive_symtab macro_names;
+  sixfive_macro *macros;
+  int macro_count;
+  int macro_capacity;
+  sixfive_lines bodies;
+  unsigned long expansions;
+  int object;
+  sixfive_image object_data;
+  sixfive_label *links;
+  int link_capacity;
+  long *bases;
+  int base_count;
+  int base_capacity;
+  sixfive_image disassembly;
+  unsigned char *marks;
+#ifdef SIXFIVE_THREADS
+  pthread_mutex_t lock;
+#endif
+};
+
+/*****************************/
+/* LOGGING UTILITIES         */
+/*****************************/
+
+void sixfive_print_info(int depth, char *str, ...){
+  va_list args;
+
+  switch(depth){
+    case 0:
+      printf(CYAN "> ");
+      break;
+    case 1:
+      printf(GREEN "=> ");
+      break;
+    case 2:
+      printf(YELLOW "==> ");
+      break;
+    case 3:
+      printf(BLUE "===> ");
+      break;
+    case 4:
+      printf(MAGENTA "====> ");
+      break;
+  }
+
+  va_start(args, str);
+  vfprintf(stdout, str, args);
+  printf("\n" RESET);
+  va_end(args);
+}
+
+void sixfive_print_error(char *str, ...){
+  va_list args;
+
+  va_start(args, str);
+  fprintf(stderr, RED);
+  vfprintf(stderr, str, args);
+  fprintf(stderr, "\n" RESET);
+  va_end(args);
+}
+
+/*
+ * Records an error on the given line,
+ * rather than printing it, as a library
+ * should not write to stderr
+ */
+void sixfive_diagnostic_add(sixfive_ctx *ctx, int line, char *str, ...){
+  sixfive_diagnostic *list;
+  int capacity;
+  va_list args;
+
+  if(ctx->diagnostic_count == ctx->diagnostic_capacity){
+    capacity = (ctx->diagnostic_capacity == 0 ? DIAGNOSTICS_INITIAL_COUNT : ctx->diagnostic_capacity*2);
+    list = realloc(ctx->diagnostics, sizeof(sixfive_diagnostic)*capacity);
+    if(list == NULL){
+      return;
+    }
+    ctx->stats.allocations++;
+    ctx->diagnostics = list;
+    ctx->diagnostic_capacity = capacity;
+  }
+
+  ctx->diagnostics[ctx->diagnostic_count].line = line;
+  va_start(args, str);
+  vsnprintf(ctx->diagnostics[ctx->diagnostic_count++].message, SIXFIVE_MESSAGE_LENGTH, str, args);
+  va_end(args);
+}
+
+/*****************************/
+/* OPERANDS                  */
+/*****************************/
+
+/*
+ * Reads the number at *c, moving *c past it:
+ * in hex after '$' (wide if it has more than
+ * two digits), in binary after '%', or in
+ * decimal, of any number of digits (such as
+ * $2, $00ff, or 10)
+ *
+ * Returns sixfive_output_none if there is no
+ * number at *c, or sixfive_output_error if it
+ * has no digits or more than 32 bits.
+ */
+int sixfive_operand_number(const char **c, const char *end, unsigned long *value, int *wide){
+  const char *start = *c;
+  int base = 10, digits, digit;
+
+  *value = 0;
+  *wide = 0;
+  if(*c == end){
+    return sixfive_output_none;
+  }
+  if(**c == '$' || **c == '%'){
+    base = (**c == '$' ? 16 : 2);
+    (*c)++;
+  } else if(!isdigit((unsigned char)**c)){
+    return sixfive_output_none;
+  }
+
+  for(;*c < end && (digit = hex_digit(**c)) != -1 && digit < base;(*c)++){
+    if((*value = *value*base + digit) > 0xffffffffUL){
+      return sixfive_output_error;
+    }
+  }
+
+  digits = *c - start - (base != 10);
+  if(digits == 0){
+    return sixfive_output_error;
+  }
+  *wide = (base == 16 && digits > 2);
+
+  return sixfive_output_success;
+}
+
+/*
+ * Whether a token names the given index
+ * register, in either case, followed by
+ * close (a ')', or '\0' for nothing)
+ */
+int sixfive_operand_index(const sixfive_token *arg, char reg, char close){
+  return arg->len == 1 + (close != '\0') && toupper((unsigned char)arg->str[0]) == reg &&
+         (close == '\0' || arg->str[1] == close);
+}
+
+/*
+ * Returns the addressing mode of a line's
+ * operand, opened by open ('#', '(', or '\0'
+ * for neither) and closed by a ')' if closed,
+ * and followed by its index register, or
+ * sixfive_mode_count if there is none
+ */
+int sixfive_operand_mode(const sixfive_line *tokens, char open, int closed){
+  const sixfive_token *index = &tokens->args[1];
+
+  switch(open){
+    case '#':
+      return (tokens->argc == 1 && !closed ? sixfive_mode_immediate : sixfive_mode_count);
+    case '(':
+      if(!closed){
+        return (tokens->argc == 2 && sixfive_operand_index(index, 'X', ')') ? sixfive_mode_indirect_x : sixfive_mode_count);
+      }
+      if(tokens->argc == 1){
+        return sixfive_mode_indirect;
+      }
+      return (sixfive_operand_index(index, 'Y', '\0') ? sixfive_mode_indirect_y : sixfive_mode_count);
+  }
+
+  if(closed){
+    return sixfive_mode_count;
+  }
+  if(tokens->argc == 1){
+    return sixfive_mode_zeropage;
+  }
+  if(sixfive_operand_index(index, 'X', '\0')){
+    return sixfive_mode_zeropage_x;
+  }
+  return (sixfive_operand_index(index, 'Y', '\0') ? sixfive_mode_zeropage_y : sixfive_mode_count);
+}
+
+/*****************************/
+/* OUTPUT                    */
+/*****************************/
+
+/*
+ * Makes room for the image to hold len
+ * bytes in all, up to the end of the
+ * 6502's 64 KiB address space
+ */
+int sixfive_image_reserve(sixfive_ctx *ctx, long len){
+  sixfive_image *image = &ctx->image;
+  unsigned char *data;
+  long capacity = image->capacity;
+
+  if(ctx->origin + len > SIXFIVE_OUTPUT_MAX_LENGTH){
+    sixfive_diagnostic_add(ctx, 0, "output exceeds %i bytes.", SIXFIVE_OUTPUT_MAX_LENGTH);
+    return sixfive_output_error;
+  }
+  if(len > capacity){
+    if(capacity == 0){
+      capacity = OUTPUT_INITIAL_LENGTH;
+    }
+    while(capacity < len){
+      capacity *= 2;
+    }
+    data = realloc(image->data, capacity);
+    if(data == NULL){
+      return sixfive_output_error;
+    }
+    ctx->stats.allocations++;
+    image->data = data;
+    image->capacity = capacity;
+  }
+
+  return sixfive_output_success;
+}
+
+/*
+ * Appends bytes at the write cursor,
+ * growing the image as needed
+ */
+int sixfive_image_emit(sixfive_ctx *ctx, const unsigned char *bytes, int len){
+  sixfive_image *image = &ctx->image;
+
+  /* Nothing is copied, as data may still be NULL */
+  if(len == 0){
+    return sixfive_output_success;
+  }
+  if((image->length + len > image->capacity || ctx->origin + image->length + len > SIXFIVE_OUTPUT_MAX_LENGTH) &&
+     sixfive_image_reserve(ctx, image->length + len) == sixfive_output_error){
+    return sixfive_output_error;
+  }
+
+  memcpy(image->data + image->length, bytes, len);
+  image->length += len;
+  ctx->stats.bytes += len;
+  ctx->placed = 1;
+
+  return sixfive_output_success;
+}
+
+/*
+ * Appends len copies of a byte at the
+ * write cursor
+ */
+int sixfive_image_fill(sixfive_ctx *ctx, int byte, long len){
+  sixfive_image *image = &ctx->image;
+
+  if(len == 0){
+    return sixfive_output_success;
+  }
+  if(sixfive_image_reserve(ctx, image->length + len) == sixfive_output_error){
+    return sixfive_output_error;
+  }
+
+  memset(image->data + image->length, byte, len);
+  image->length += len;
+  ctx->stats.bytes += len;
+  ctx->placed = 1;
+
+  return sixfive_output_success;
+}
+
+/*****************************/
+/* ARENA                     */
+/*****************************/
+
+/*
+ * Hands out len bytes (aligned for a
+ * pointer) from the current block, moving
+ * on to the next block if it does not fit,
+ * or to a new one if that is too small
+ */
+void *sixfive_arena_alloc(sixfive_arena *arena, size_t len){
+  size_t size = ARENA_BLOCK_LENGTH;
+  sixfive_arena_block *block = arena->current;
+  void *out;
+
+  len = (len + sizeof(void*)-1) & ~(sizeof(void*)-1);
+  if(block == NULL || block->used + len > block->size){
+    if(block != NULL && block->next != NULL && block->next->size >= len){
+      block = block->next;
+    } else {
+      if(len > size){
+        size = len;
+      }
+      block = malloc(sizeof(sixfive_arena_block) + size);
+      if(block == NULL){
+        return NULL;
+      }
+      arena->allocations++;
+      block->size = size;
+      if(arena->current == NULL){
+        block->next = NULL;
+        arena->first = block;
+      } else {
+        block->next = arena->current->next;
+        arena->current->next = block;
+      }
+    }
+    block->used = 0;
+    arena->current = block;
+  }
+
+  out = (char*)(block+1) + block->used;
+  block->used += len;
+  return out;
+}
+
+/*
+ * Empties the arena, keeping its blocks
+ * to be handed out again in order
+ */
+void sixfive_arena_reset(sixfive_arena *arena){
+  arena->current = arena->first;
+  if(arena->first != NULL){
+    arena->first->used = 0;
+  }
+}
+
+/*
+ * Frees every block of the arena
+ */
+void sixfive_arena_free(sixfive_arena *arena){
+  sixfive_arena_block *block = arena->first, *next;
+
+  while(block != NULL){
+    next = block->next;
+    free(block);
+    block = next;
+  }
+  memset(arena, 0, sizeof(sixfive_arena));
+}
+
+/*****************************/
+/* LABELS                    */
+/*****************************/
+
+/*
+ * Copies a label's name into the
+ * table's arena
+ */
+char *sixfive_symtab_intern(sixfive_symtab *tab, const char *str, int len){
+  char *out = sixfive_arena_alloc(tab->names, len + 1);
+
+  if(out == NULL){
+    return NULL;
+  }
+  memcpy(out, str, len);
+  out[len] = '\0';
+  return out;
+}
+
+/*
+ * Doubles the number of slots and labels
+ * the table can hold, reinserting every
+ * existing label
+ */
+int sixfive_symtab_grow(sixfive_symtab *tab){
+  int i, j;
+  int capacity = (tab->capacity == 0 ? LABELS_INITIAL_COUNT : tab->capacity*2);
+  sixfive_label *labels = realloc(tab->labels, sizeof(sixfive_label)*capacity);
+  int *slots;
+
+  if(labels == NULL){
+    return sixfive_output_error;
+  }
+  tab->labels = labels;
+
+  /* Twice as many slots as labels keeps probes short */
+  slots = calloc(sizeof(int), capacity*2);
+  if(slots == NULL){
+    return sixfive_output_error;
+  }
+  tab->allocations += 2;
+  free(tab->slots);
+  tab->slots = slots;
+  tab->slot_mask = capacity*2 - 1;
+  tab->capacity = capacity;
+
+  for(i=0;i<tab->count;i++){
+    j = tab->labels[i].hash & tab->slot_mask;
+    while(tab->slots[j] != 0){
+      j = (j+1) & tab->slot_mask;
+    }
+    tab->slots[j] = i+1;
+  }
+
+  return sixfive_output_success;
+}
+
+/*
+ * Empties the table, keeping its memory
+ * for the next file (its names are left
+ * to whoever empties its arena)
+ */
+void sixfive_symtab_clear(sixfive_symtab *tab){
+  if(tab->slots != NULL){
+    memset(tab->slots, 0, sizeof(int)*(tab->slot_mask+1));
+  }
+  tab->count = 0;
+}
+
+/*
+ * Frees all memory held by the table,
+ * other than its arena
+ */
+void sixfive_symtab_free(sixfive_symtab *tab){
+  free(tab->slots);
+  free(tab->labels);
+  memset(tab, 0, sizeof(sixfive_symtab));
+}
+
+/*
+ * Counts the slots a lookup probed
+ */
+void sixfive_symtab_count(sixfive_symtab *symtab, int probes){
+  symtab->probes += probes;
+  if(probes > symtab->probe_max){
+    symtab->probe_max = probes;
+  }
+}
+
+/*
+ * Finds a label in the table by name and
+ * hash, adding one if it does not already
+ * exist, and setting its address if known
+ */
+int sixfive_symtab_find(sixfive_symtab *symtab, const char *str, int len, unsigned long hash, uint16_t adr){
+  sixfive_label *label;
+  int i, probes = 0;
+
+  symtab->lookups++;
+  if(symtab->count > 0){
+    i = hash & symtab->slot_mask;
+    while(symtab->slots[i] != 0){
+      probes++;
+      label = &symtab->labels[symtab->slots[i]-1];
+      if(label->hash == hash && strncmp(label->string, str, len) == 0 && label->string[len] == '\0'){
+        if(adr != ADDRESS_UNKNOWN){
+          label->address = adr;
+        }
+        sixfive_symtab_count(symtab, probes);
+        return symtab->slots[i]-1;
+      }
+      i = (i+1) & symtab->slot_mask;
+    }
+  }
+  sixfive_symtab_count(symtab, probes);
+
+  if(symtab->count == symtab->capacity && sixfive_symtab_grow(symtab) == sixfive_output_error){
+    return sixfive_output_error;
+  }
+
+  /* The table may have been rehashed above */
+  i = hash & symtab->slot_mask;
+  while(symtab->slots[i] != 0){
+    i = (i+1) & symtab->slot_mask;
+  }
+
+  label = &symtab->labels[symtab->count];
+  label->string = sixfive_symtab_intern(symtab, str, len);
+  if(label->string == NULL){
+    return sixfive_output_error;
+  }
+  label->hash = hash;
+  label->address = adr;
+  label->mark = 0;
+  label->flags = 0;
+  symtab->slots[i] = ++symtab->count;
+
+  return symtab->count-1;
+}
+
+/*
+ * Finds a label in the table of known labels,
+ * adding one if it does not already exist
+ */
+int sixfive_label_find(sixfive_ctx *ctx, const char *str, int len, uint16_t adr){
+  /* Which would read as a register */
+  if(len == 1 && (*str == 'A' || *str == 'X' || *str == 'Y')){
+    return sixfive_output_error;
+  }
+
+  return sixfive_symtab_find(&ctx->symtab, str, len, djb2hash((const unsigned char*)str, len), adr);
+}
+
+/*****************************/
+/* EXPRESSIONS               */
+/*****************************/
+
+/*
+ * Makes room for count operations in all
+ */
+int sixfive_expr_reserve(sixfive_ctx *ctx, int count){
+  sixfive_exprs *exprs = &ctx->exprs;
+  sixfive_expr_op *list;
+  int capacity = exprs->capacity;
+
+  if(count > capacity){
+    if(capacity == 0){
+      capacity = EXPRS_INITIAL_COUNT;
+    }
+    while(capacity < count){
+      capacity *= 2;
+    }
+    list = realloc(exprs->list, sizeof(sixfive_expr_op)*capacity);
+    if(list == NULL){
+      return sixfive_output_error;
+    }
+    ctx->stats.allocations++;
+    exprs->list = list;
+    exprs->capacity = capacity;
+  }
+
+  return sixfive_output_success;
+}
+
+/*
+ * Applies an operator to a (and b, for
+ * those taking two values), which fails
+ * only when dividing by zero
+ *
+ * Arithmetic wraps rather than overflows,
+ * and shifts of 32 or more give zero.
+ */
+int sixfive_expr_apply(int op, long a, long b, long *out){
+  unsigned long x = a, y = b;
+
+  switch(op){
+    case sixfive_expr_negate: *out = (long)(0 - x);        break;
+    case sixfive_expr_not:    *out = ~a;                   break;
+    case sixfive_expr_low:    *out = a & 0xff;             break;
+    case sixfive_expr_high:   *out = (a >> 8) & 0xff;      break;
+    case sixfive_expr_add:    *out = (long)(x + y);        break;
+    case sixfive_expr_sub:    *out = (long)(x - y);        break;
+    case sixfive_expr_mul:    *out = (long)(x * y);        break;
+    case sixfive_expr_and:    *out = a & b;                break;
+    case sixfive_expr_or:     *out = a | b;                break;
+    case sixfive_expr_xor:    *out = a ^ b;                break;
+    case sixfive_expr_shl:    *out = (y < 32 ? (long)(x << y) : 0); break;
+    case sixfive_expr_shr:    *out = (y < 32 ? (long)(x >> y) : 0); break;
+    case sixfive_expr_div:
+      if(b == 0){
+        return sixfive_output_error;
+      }
+      *out = a / b;
+      break;
+  }
+
+  return sixfive_output_success;
+}
+
+/*
+ * Adds an operation to an expression being
+ * compiled, working it out at once if the
+ * values it applies to are all constant
+ */
+int sixfive_expr_emit(sixfive_expr_parser *p, int op, long value){
+  sixfive_expr_op *last = (p->count > 0 ? &p->ops[p->count-1] : NULL);
+
+  if(op >= sixfive_expr_negate && op < sixfive_expr_add && p->count > 0 && last->op == sixfive_expr_value){
+    return sixfive_expr_apply(op, last->value, 0, &last->value);
+  }
+  if(op >= sixfive_expr_add && p->count > 1 && last->op == sixfive_expr_value && last[-1].op == sixfive_expr_value){
+    p->count--;
+    if(sixfive_expr_apply(op, last[-1].value, last->value, &last[-1].value) == sixfive_output_error){
+      p->zero = 1;
+      return sixfive_output_error;
+    }
+    return sixfive_output_success;
+  }
+
+  /* Leaving room for sixfive_expr_end */
+  if(p->count == MAX_EXPR_OPS-1){
+    return sixfive_output_error;
+  }
+  p->ops[p->count].op = op;
+  p->ops[p->count].value = value;
+  p->count++;
+
+  return sixfive_output_success;
+}
+
+/* Skips the spaces between the parts of an expression */
+void sixfive_expr_space(sixfive_expr_parser *p){
+  while(p->c < p->end && (*p->c == ' ' || *p->c == '\t')){
+    p->c++;
+  }
+}
+
+/*
+ * Compiles a value: a number, written in hex
+ * after '$', binary after '%', in decimal, or
+ * as a character in single quotes, a label,
+ * or * for the address of the current line
+ */
+int sixfive_expr_operand(sixfive_expr_parser *p){
+  const char *start = p->c;
+  unsigned long value = 0;
+  int wide, status, label;
+
+  switch(*p->c){
+    case '*':
+      p->c++;
+      return sixfive_expr_emit(p, sixfive_expr_here, 0);
+    case '\'':
+      if(p->end - p->c < 3 || p->c[2] != '\''){
+        return sixfive_output_error;
+      }
+      value = (unsigned char)p->c[1];
+      p->c += 3;
+      return sixfive_expr_emit(p, sixfive_expr_value, value);
+  }
+
+  if((status = sixfive_operand_number(&p->c, p->end, &value, &wide)) != sixfive_output_none){
+    if(status == sixfive_output_error){
+      return sixfive_output_error;
+    }
+    p->wide |= wide;
+    return sixfive_expr_emit(p, sixfive_expr_value, value);
+  }
+  if(isalpha((unsigned char)*p->c) || *p->c == '_'){
+    for(;p->c < p->end && (isalnum((unsigned char)*p->c) || *p->c == '_');p->c++);
+    if((label = sixfive_label_find(p->ctx, start, p->c - start, ADDRESS_UNKNOWN)) == sixfive_output_error){
+      return sixfive_output_error;
+    }
+    return sixfive_expr_emit(p, sixfive_expr_label, label);
+  }
+
+  return sixfive_output_error;
+}
+
+/*
+ * Takes the operator next in an expression,
+ * returning it and how tightly it binds, or
+ * -1 if there is none
+ *
+ * Operators bind in the same order as C's:
+ * |, ^, &, << and >>, + and -, * and /,
+ * then the unary -, ~, < (low byte) and >
+ * (high byte), written before a value.
+ */
+int sixfive_expr_operator(sixfive_expr_parser *p, int unary, int *precedence){
+  char c = *p->c, next = (p->end - p->c > 1 ? p->c[1] : '\0');
+  int op = -1, len = 1;
+
+  if(unary){
+    *precedence = 6;
+    switch(c){
+      case '-': op = sixfive_expr_negate; break;
+      case '~': op = sixfive_expr_not;    break;
+      case '<': op = sixfive_expr_low;    break;
+      case '>': op = sixfive_expr_high;   break;
+    }
+  } else {
+    switch(c){
+      case '|': op = sixfive_expr_or;  *precedence = 0; break;
+      case '^': op = sixfive_expr_xor; *precedence = 1; break;
+      case '&': op = sixfive_expr_and; *precedence = 2; break;
+      case '+': op = sixfive_expr_add; *precedence = 4; break;
+      case '-': op = sixfive_expr_sub; *precedence = 4; break;
+      case '*': op = sixfive_expr_mul; *precedence = 5; break;
+      case '/': op = sixfive_expr_div; *precedence = 5; break;
+      case '<':
+      case '>':
+        if(next == c){
+          op = (c == '<' ? sixfive_expr_shl : sixfive_expr_shr);
+          *precedence = 3;
+          len = 2;
+        }
+        break;
+    }
+  }
+  if(op != -1){
+    p->c += len;
+  }
+
+  return op;
+}
+
+/*
+ * Compiles len bytes of str as an expression,
+ * once, into its value if it is constant, or
+ * else into the operations left to work out
+ * once its labels are known (with whatever
+ * parts of it are constant worked out)
+ *
+ * Operators wait on a stack until those on
+ * either side of them are compiled, taking
+ * them into postfix order.  An expression of
+ * a lone label keeps only the label, as most
+ * do.
+ */
+int sixfive_expr_compile(sixfive_ctx *ctx, const char *str, int len, sixfive_value *value, int num){
+  sixfive_expr_parser p;
+  int stack[MAX_EXPR_OPS], precedences[MAX_EXPR_OPS];
+  int top = 0, expect = 1, op, precedence, status = sixfive_output_success;
+
+  p.ctx = ctx;
+  p.c = str;
+  p.end = str + len;
+  p.count = 0;
+  p.wide = 0;
+  p.zero = 0;
+
+  for(;;){
+    sixfive_expr_space(&p);
+    if(p.c == p.end || top == MAX_EXPR_OPS){
+      break;
+    }
+    if(expect && *p.c == '('){
+      stack[top] = -1;
+      precedences[top++] = -1;
+      p.c++;
+    } else if(expect && (op = sixfive_expr_operator(&p, 1, &precedence)) != -1){
+      stack[top] = op;
+      precedences[top++] = precedence;
+    } else if(expect){
+      if((status = sixfive_expr_operand(&p)) == sixfive_output_error){
+        break;
+      }
+      expect = 0;
+    } else if(*p.c == ')'){
+      for(;top > 0 && stack[top-1] != -1 && status != sixfive_output_error;top--){
+        status = sixfive_expr_emit(&p, stack[top-1], 0);
+      }
+      if(top == 0 || status == sixfive_output_error){
+        status = sixfive_output_error;
+        break;
+      }
+      top--;
+      p.c++;
+    } else if((op = sixfive_expr_operator(&p, 0, &precedence)) != -1){
+      /* Operators of the same level apply left to right */
+      for(;top > 0 && precedences[top-1] >= precedence && status != sixfive_output_error;top--){
+        status = sixfive_expr_emit(&p, stack[top-1], 0);
+      }
+      stack[top] = op;
+      precedences[top++] = precedence;
+      expect = 1;
+    } else {
+      break;
+    }
+  }
+  for(;top > 0 && stack[top-1] != -1 && status != sixfive_output_error;top--){
+    status = sixfive_expr_emit(&p, stack[top-1], 0);
+  }
+
+  if(status == sixfive_output_error || expect || top > 0 || p.c != p.end){
+    sixfive_diagnostic_add(ctx, num, (p.zero ? "division by zero in \"%.*s\"." : "invalid expression \"%.*s\"."), (len < 64 ? len : 64), str);
+    return sixfive_output_error;
+  }
+
+  value->value = 0;
+  value->label = -1;
+  value->expr = -1;
+  value->wide = p.wide;
+  if(p.count == 1 && p.ops[0].op == sixfive_expr_value){
+    value->value = p.ops[0].value;
+    return sixfive_output_success;
+  }
+  if(p.count == 1 && p.ops[0].op == sixfive_expr_label){
+    value->label = p.ops[0].value;
+    return sixfive_output_success;
+  }
+
+  if(sixfive_expr_reserve(ctx, ctx->exprs.count + p.count + 1) == sixfive_output_error){
+    return sixfive_output_error;
+  }
+  p.ops[p.count].op = sixfive_expr_end;
+  p.ops[p.count].value = 0;
+  memcpy(ctx->exprs.list + ctx->exprs.count, p.ops, sizeof(sixfive_expr_op)*(p.count+1));
+  value->expr = ctx->exprs.count;
+  ctx->exprs.count += p.count+1;
+
+  return sixfive_output_success;
+}
+
+/*
+ * Makes a constant value an expression of
+ * just that constant, to be resolved along
+ * with those which use labels
+ */
+int sixfive_expr_constant(sixfive_ctx *ctx, sixfive_value *value){
+  if(sixfive_expr_reserve(ctx, ctx->exprs.count + 2) == sixfive_output_error){
+    return sixfive_output_error;
+  }
+  ctx->exprs.list[ctx->exprs.count].op = sixfive_expr_value;
+  ctx->exprs.list[ctx->exprs.count].value = value->value;
+  ctx->exprs.list[ctx->exprs.count+1].op = sixfive_expr_end;
+  ctx->exprs.list[ctx->exprs.count+1].value = 0;
+  value->expr = ctx->exprs.count;
+  ctx->exprs.count += 2;
+
+  return sixfive_output_success;
+}
+
+/*
+ * Works out a compiled expression, with *
+ * at here, and the address of each label,
+ * found in labels by its index (or by the
+ * index globals maps it to, if given),
+ * moved by shifts, if given
+ *
+ * Returns sixfive_output_none if a label is
+ * not yet known, setting *value to its index.
+ */
+int sixfive_expr_eval(const sixfive_expr_op *op, const sixfive_label *labels, const int *globals, const long *shifts, long here, long *value){
+  long stack[MAX_EXPR_OPS];
+  const sixfive_label *label;
+  int top = 0;
+
+  for(;op->op != sixfive_expr_end;op++){
+    switch(op->op){
+      case sixfive_expr_value:
+        stack[top++] = op->value;
+        break;
+      case sixfive_expr_here:
+        stack[top++] = here;
+        break;
+      case sixfive_expr_label:
+        label = &labels[globals != NULL ? globals[op->value] : op->value];
+        if(label->address == ADDRESS_UNKNOWN){
+          *value = label - labels;
+          return sixfive_output_none;
+        }
+        stack[top++] = label->address + (shifts != NULL ? shifts[label->mark] : 0);
+        break;
+      case sixfive_expr_negate:
+      case sixfive_expr_not:
+      case sixfive_expr_low:
+      case sixfive_expr_high:
+        sixfive_expr_apply(op->op, stack[top-1], 0, &stack[top-1]);
+        break;
+      default:
+        top--;
+        if(sixfive_expr_apply(op->op, stack[top-1], stack[top], &stack[top-1]) == sixfive_output_error){
+          return sixfive_output_error;
+        }
+        break;
+    }
+  }
+  *value = stack[0];
+
+  return sixfive_output_success;
+}
+
+/*****************************/
+/* FIXUPS                    */
+/*****************************/
+
+/*
+ * Makes room for count fixups in all
+ */
+int sixfive_fixup_reserve(sixfive_ctx *ctx, int count){
+  sixfive_fixups *fixups = &ctx->fixups;
+  sixfive_fixup *list;
+  int capacity = fixups->capacity;
+
+  if(count > capacity){
+    if(capacity == 0){
+      capacity = FIXUPS_INITIAL_COUNT;
+    }
+    while(capacity < count){
+      capacity *= 2;
+    }
+    list = realloc(fixups->list, sizeof(sixfive_fixup)*capacity);
+    if(list == NULL){
+      return sixfive_output_error;
+    }
+    ctx->stats.allocations++;
+    fixups->list = list;
+    fixups->capacity = capacity;
+  }
+
+  return sixfive_output_success;
+}
+
+/*
+ * Records that the given value, of a label
+ * or an expression (or NULL, for none), is
+ * referenced at the given offset of the
+ * output, by the line starting at here
+ */
+int sixfive_fixup_add(sixfive_ctx *ctx, long offset, const sixfive_value *value, int width, int line){
+  sixfive_fixups *fixups = &ctx->fixups;
+  sixfive_fixup *fixup;
+
+  if(fixups->count == fixups->capacity && sixfive_fixup_reserve(ctx, fixups->count+1) == sixfive_output_error){
+    return sixfive_output_error;
+  }
+
+  fixup = &fixups->list[fixups->count++];
+  fixup->offset = offset;
+  fixup->label = (value != NULL ? value->label : -1);
+  fixup->expr = (value != NULL ? value->expr : -1);
+  fixup->here = ctx->here - offset;
+  fixup->width = width;
+  fixup->line = line;
+  fixup->relax = sixfive_relax_none;
+  fixup->opcode = -1;
+  ctx->stats.fixups++;
+
+  return sixfive_output_success;
+}
+
+/*
+ * Records a fixup which may change the
+ * size of the output, see sixfive_relax
+ */
+int sixfive_fixup_relax(sixfive_ctx *ctx, long offset, const sixfive_value *value, int width, int relax, int opcode, int line){
+  sixfive_fixup *fixup;
+
+  if(sixfive_fixup_add(ctx, offset, value, width, line) == sixfive_output_error){
+    return sixfive_output_error;
+  }
+
+  fixup = &ctx->fixups.list[ctx->fixups.count-1];
+  fixup->relax = relax;
+  fixup->opcode = opcode;
+  if(relax != sixfive_relax_org){
+    ctx->relaxable++;
+  }
+
+  return sixfive_output_success;
+}
+
+/*
+ * Works out what a fixup is patched with:
+ * its label's address, or its expression's
+ * value with * at here, where labels are
+ * found as for sixfive_expr_eval (and the
+ * expression in exprs)
+ *
+ * Returns sixfive_output_none if a label is
+ * not yet known, setting *value to its index,
+ * and fails on dividing by zero.
+ */
+int sixfive_fixup_value(const sixfive_fixup *fixup, const sixfive_expr_op *exprs, const sixfive_label *labels, const int *globals, const long *shifts, long here, long *value){
+  const sixfive_label *label;
+
+  if(fixup->expr != -1){
+    return sixfive_expr_eval(exprs + fixup->expr, labels, globals, shifts, here, value);
+  }
+
+  label = &labels[globals != NULL ? globals[fixup->label] : fixup->label];
+  if(label->address == ADDRESS_UNKNOWN){
+    *value = label - labels;
+    return sixfive_output_none;
+  }
+  *value = label->address + (shifts != NULL ? shifts[label->mark] : 0);
+
+  return sixfive_output_success;
+}
+
+/*
+ * Adds the diagnostic for a fixup which
+ * could not be worked out, given what
+ * sixfive_fixup_value returned
+ */
+void sixfive_fixup_error(sixfive_ctx *ctx, const sixfive_fixup *fixup, const sixfive_label *labels, int status, long value){
+  if(status == sixfive_output_none){
+    sixfive_diagnostic_add(ctx, fixup->line, "unrecognized operand/label \"%.64s\".", labels[value].string);
+  } else {
+    sixfive_diagnostic_add(ctx, fixup->line, "division by zero.");
+  }
+}
+
+/*
+ * Whether a value fits a fixup's width (as
+ * either a signed or unsigned number): 0 if
+ * so, or else 1 if it is larger than *limit
+ * and -1 if smaller
+ */
+int sixfive_fixup_range(const sixfive_fixup *fixup, long value, long *limit){
+  long max = (fixup->width == 2 ? 0xffff : 0xff);
+
+  if(value > max){
+    *limit = max;
+    return 1;
+  }
+  if(value < -(max+1)/2){
+    *limit = -(max+1)/2;
+    return -1;
+  }
+
+  return 0;
+}
+
+/*
+ * Patches a fixup's value into data, if it
+ * fits its width, adding a diagnostic to
+ * ctx if not
+ */
+int sixfive_fixup_patch(sixfive_ctx *ctx, unsigned char *data, const sixfive_fixup *fixup, long value){
+  long limit;
+
+  /* Branches are complete once relaxed, and have no width left */
+  if(fixup->width == 0){
+    return sixfive_output_success;
+  }
+  switch(sixfive_fixup_range(fixup, value, &limit)){
+    case 1:
+      sixfive_diagnostic_add(ctx, fixup->line, "$%lx is larger than $%lx.", value, limit);
+      return sixfive_output_error;
+    case -1:
+      sixfive_diagnostic_add(ctx, fixup->line, "%li is smaller than %li.", value, limit);
+      return sixfive_output_error;
+  }
+
+  data[fixup->offset] = value & 0xff;
+  if(fixup->width == 2){
+    data[fixup->offset+1] = (value >> 8) & 0xff;
+  }
+
+  return sixfive_output_success;
+}
+
+/*****************************/
+/* RELAXATION                */
+/*****************************/
+
+/* Width of each kind of relaxing fixup at its longest */
+#define RELAX_LENGTH(relax) ((relax) == sixfive_relax_branch ? 5 : 3)
+
+/* Width of each kind once lengthened from the given width */
+#define RELAX_GROW(relax, width) ((relax) == sixfive_relax_branch && (width) == 0 ? 2 : RELAX_LENGTH(relax))
+
+/*
+ * Returns how much a .org padded by, which
+ * is nothing if the code before it was too
+ * long to fit until relaxed
+ */
+long sixfive_relax_padding(sixfive_ctx *ctx, sixfive_fixup *fixup){
+  long padding = fixup->width - (ctx->origin + fixup->offset);
+
+  return (padding > 0 ? padding : 0);
+}
+
+/*
+ * Finds how far each fixup moves with their
+ * current widths: shifts[i] is how far the
+ * i-th fixup (and any label defined just
+ * before it) moves, and shifts[count] how
+ * far the end of the output does
+ *
+ * Code only ever shrinks from its longest, so
+ * each .org pads as much more as it needs to
+ * keep what follows it in place (or where it
+ * should have been).
+ */
+void sixfive_relax_shifts(sixfive_ctx *ctx){
+  sixfive_fixup *fixup = ctx->fixups.list;
+  long shift = 0;
+  int i;
+
+  for(i=0;i<ctx->fixups.count;i++,fixup++){
+    ctx->shifts[i] = shift;
+    switch(fixup->relax){
+      case sixfive_relax_zeropage:
+      case sixfive_relax_branch:
+      case sixfive_relax_jump:
+        shift += fixup->width - RELAX_LENGTH(fixup->relax);
+        break;
+      case sixfive_relax_org:
+        shift = fixup->width - (ctx->origin + fixup->offset + sixfive_relax_padding(ctx, fixup));
+        break;
+    }
+  }
+  ctx->shifts[i] = shift;
+}
+
+/*
+ * Returns where a label is once relaxed
+ */
+long sixfive_relax_address(sixfive_ctx *ctx, sixfive_label *label){
+  return label->address + ctx->shifts[label->mark];
+}
+
+/*
+ * Whether a fixup still fits in its current
+ * short form, given how far everything has
+ * moved (one with no width at all fits only
+ * if its label is right after it)
+ */
+int sixfive_relax_fits(sixfive_ctx *ctx, int i){
+  sixfive_fixup *fixup = &ctx->fixups.list[i];
+  long address, from = ctx->origin + fixup->offset + ctx->shifts[i];
+
+  if(sixfive_fixup_value(fixup, ctx->exprs.list, ctx->symtab.labels, NULL, ctx->shifts, from + fixup->here, &address) != sixfive_output_success){
+    return 0;
+  }
+
+  if(fixup->width == 0){
+    return address == from;
+  }
+  if(fixup->relax == sixfive_relax_zeropage){
+    /* Nothing is known to be in the zero page until an object is placed */
+    return address >= 0 && address < 0x100 && !(ctx->object && !ctx->fixed);
+  }
+  from += 2;
+  return address - from >= -128 && address - from <= 127;
+}
+
+/*
+ * Shortens every instruction which refers to
+ * a label, written at its longest while the
+ * label was unknown, as far as it can:
+ *   - To its zero page form, if the label is
+ *     in the zero page
+ *   - To a single branch, if the label is in
+ *     its range, rather than the opposite
+ *     branch over a JMP
+ *   - To nothing at all, for a branch or JMP
+ *     (when optimizing) to the instruction
+ *     right after it
+ *
+ * Each starts short, and those which do not
+ * fit are lengthened, until none change.  As
+ * they only ever lengthen, this ends, and as
+ * labels only move towards them, no zero page
+ * operand leaves the zero page and no branch
+ * goes out of range.
+ *
+ * The output is then moved up over the bytes
+ * saved, and labels, fixups, and listed lines
+ * along with it, ready to be linked.
+ */
+int sixfive_relax(sixfive_ctx *ctx){
+  sixfive_fixup *fixup, *end = ctx->fixups.list + ctx->fixups.count;
+  sixfive_label *label;
+  unsigned char *data = ctx->image.data;
+  long *shifts, src = 0, dst = 0, address;
+  int i, changed, removed, status;
+
+  if(ctx->relaxable == 0){
+    return sixfive_output_success;
+  }
+
+  if(ctx->fixups.count+1 > ctx->shifts_capacity){
+    shifts = realloc(ctx->shifts, sizeof(long)*(ctx->fixups.count+1));
+    if(shifts == NULL){
+      return sixfive_output_error;
+    }
+    ctx->stats.allocations++;
+    ctx->shifts = shifts;
+    ctx->shifts_capacity = ctx->fixups.count+1;
+  }
+
+  /* Checked first, as they would be without relaxing (or by sixfive_object_check) */
+  for(fixup=ctx->fixups.list;fixup<end && !ctx->object;fixup++){
+    if(fixup->relax != sixfive_relax_org &&
+       (status = sixfive_fixup_value(fixup, ctx->exprs.list, ctx->symtab.labels, NULL, NULL, 0, &address)) == sixfive_output_none){
+      sixfive_fixup_error(ctx, fixup, ctx->symtab.labels, status, address);
+      return sixfive_output_error;
+    }
+  }
+
+  /* Each fixup was recorded at its shortest */
+  do {
+    changed = 0;
+    ctx->stats.relax_passes++;
+    sixfive_relax_shifts(ctx);
+    for(i=0,fixup=ctx->fixups.list;fixup<end;i++,fixup++){
+      if(fixup->relax != sixfive_relax_none && fixup->relax != sixfive_relax_org &&
+         fixup->width < RELAX_LENGTH(fixup->relax) && !sixfive_relax_fits(ctx, i)){
+        fixup->width = RELAX_GROW(fixup->relax, fixup->width);
+        changed = 1;
+      }
+    }
+  } while(changed);
+
+  for(i=0,fixup=ctx->fixups.list;fixup<end;i++,fixup++){
+    address = ctx->origin + fixup->offset + ctx->shifts[i];
+    if(fixup->relax == sixfive_relax_org && fixup->width < address){
+      sixfive_diagnostic_add(ctx, fixup->line, ".org $%.4x is behind the current address, $%.4lx.", fixup->width, address);
+      return sixfive_output_error;
+    }
+  }
+
+#ifdef DEBUG_BUILD
+  sixfive_print_info(1, "Relaxed in %li passes, saving %li bytes.", ctx->stats.relax_passes, -ctx->shifts[ctx->fixups.count]);
+#endif
+
+  /* Everything moves towards the start, so is never overwritten before it moves */
+  for(i=0,fixup=ctx->fixups.list;fixup<end;i++,fixup++){
+    memmove(data + dst, data + src, fixup->offset - src);
+    dst += fixup->offset - src;
+    src = fixup->offset;
+    if(fixup->relax == sixfive_relax_org){
+      src += sixfive_relax_padding(ctx, fixup);
+    }
+    fixup->offset = dst;
+
+    /* Only the optimizer removes one, saving what a short branch or JMP takes (and as many cycles) */
+    if(fixup->relax != sixfive_relax_org && fixup->width == 0){
+      removed = (fixup->relax == sixfive_relax_branch ? 2 : 3);
+      ctx->stats.optimize_bytes += removed;
+      ctx->stats.optimize_cycles += removed;
+      ctx->stats.relax_saved -= removed;
+      src += RELAX_LENGTH(fixup->relax);
+      fixup->relax = sixfive_relax_none;
+      continue;
+    }
+
+    switch(fixup->relax){
+      case sixfive_relax_zeropage:
+        if(fixup->width == 2){
+          data[dst] = fixup->opcode;
+          src += 3;
+          dst += 2;
+          fixup->width = 1;
+        } else {
+          fixup->width = 2;
+        }
+        fixup->offset++;
+        fixup->here--;
+        break;
+      case sixfive_relax_branch:
+        if(fixup->width == 2){
+          sixfive_fixup_value(fixup, ctx->exprs.list, ctx->symtab.labels, NULL, ctx->shifts, ctx->origin + dst + fixup->here, &address);
+          address -= ctx->origin + dst + 2;
+          data[dst] = fixup->opcode;
+          data[dst+1] = address & 0xff;
+          src += 5;
+          dst += 2;
+          fixup->width = 0;
+        } else {
+          fixup->offset += 3;
+          fixup->here -= 3;
+          fixup->width = 2;
+        }
+        break;
+      case sixfive_relax_jump:
+        fixup->offset++;
+        fixup->here--;
+        fixup->width = 2;
+        break;
+      case sixfive_relax_org:
+        address = fixup->width - (ctx->origin + dst);
+        memset(data + dst, 0, address);
+        dst += address;
+        continue;
+    }
+    fixup->relax = sixfive_relax_none;
+  }
+  memmove(data + dst, data + src, ctx->image.length - src);
+  ctx->image.length += ctx->shifts[ctx->fixups.count];
+  ctx->stats.bytes += ctx->shifts[ctx->fixups.count];
+  ctx->stats.relax_saved -= ctx->shifts[ctx->fixups.count];
+
+  for(i=0;i<ctx->symtab.count;i++){
+    label = &ctx->symtab.labels[i];
+    if(label->address != ADDRESS_UNKNOWN){
+      label->address = sixfive_relax_address(ctx, label);
+    }
+  }
+  for(i=0;i<ctx->listed.count;i++){
+    ctx->listed.list[i].offset += ctx->shifts[ctx->listed.list[i].mark];
+  }
+  ctx->relaxable = 0;
+
+  return sixfive_output_success;
+}
+
+/*****************************/
+/* INSTRUCTIONS              */
+/*****************************/
+
+/*
+ * Opcode of every (instruction, addressing mode)
+ * pair, or -1 if the pair does not exist
+ *
+ * Generated from SIXFIVE_ISA above, so that finding
+ * an opcode is a single table access rather than a
+ * search.
+ */
+#define SIXFIVE_ISA_ROW(m, c0, c1, c2, imp, acc, imm, zp, zpx, zpy, ab, abx, aby, ind, inx, iny, rel) \
+  { imp, acc, imm, zp, zpx, zpy, ab, abx, aby, ind, inx, iny, rel },
+const short sixfive_instruction_opcodes[sixfive_instruction_count][sixfive_mode_count] = {
+  SIXFIVE_ISA(SIXFIVE_ISA_ROW)
+};
+
+/*
+ * Cycles taken by each opcode, or 0 if it
+ * is not in the table above, not counting
+ * the extra cycle of a branch taken or of
+ * an index crossing a page
+ *
+ * Indexed modes of instructions which only
+ * read memory take the latter, and so are
+ * the ones listed here as a cycle shorter
+ * than stores (4 for absolute,X and ,Y,
+ * and 5 for (indirect),Y).
+ */
+const unsigned char sixfive_opcode_cycles[256] = {
+/*       0  1  2  3  4  5  6  7  8  9  a  b  c  d  e  f */
+/* 0 */  7, 6, 0, 0, 0, 3, 5, 0, 3, 2, 2, 0, 0, 4, 6, 0,
+/* 1 */  2, 5, 0, 0, 0, 4, 6, 0, 2, 4, 0, 0, 0, 4, 7, 0,
+/* 2 */  6, 6, 0, 0, 3, 3, 5, 0, 4, 2, 2, 0, 4, 4, 6, 0,
+/* 3 */  2, 5, 0, 0, 0, 4, 6, 0, 2, 4, 0, 0, 0, 4, 7, 0,
+/* 4 */  6, 6, 0, 0, 0, 3, 5, 0, 3, 2, 2, 0, 3, 4, 6, 0,
+/* 5 */  2, 5, 0, 0, 0, 4, 6, 0, 2, 4, 0, 0, 0, 4, 7, 0,
+/* 6 */  6, 6, 0, 0, 0, 3, 5, 0, 4, 2, 2, 0, 5, 4, 6, 0,
+/* 7 */  2, 5, 0, 0, 0, 4, 6, 0, 2, 4, 0, 0, 0, 4, 7, 0,
+/* 8 */  0, 6, 0, 0, 3, 3, 3, 0, 2, 0, 2, 0, 4, 4, 4, 0,
+/* 9 */  2, 6, 0, 0, 4, 4, 4, 0, 2, 5, 2, 0, 0, 5, 0, 0,
+/* a */  2, 6, 2, 0, 3, 3, 3, 0, 2, 2, 2, 0, 4, 4, 4, 0,
+/* b */  2, 5, 0, 0, 4, 4, 4, 0, 2, 4, 2, 0, 4, 4, 4, 0,
+/* c */  2, 6, 0, 0, 3, 3, 5, 0, 2, 2, 2, 0, 4, 4, 6, 0,
+/* d */  2, 5, 0, 0, 0, 4, 6, 0, 2, 4, 0, 0, 0, 4, 7, 0,
+/* e */  2, 6, 0, 0, 3, 3, 5, 0, 2, 2, 2, 0, 4, 4, 6, 0,
+/* f */  2, 5, 0, 0, 0, 4, 6, 0, 2, 4, 0, 0, 0, 4, 7, 0
+};
+
+/* Length of an instruction in each addressing mode */
+const unsigned char sixfive_mode_lengths[sixfive_mode_count] = {
+  1, 1, 2, 2, 2, 2, 3, 3, 3, 3, 2, 2, 2
+};
+
+/*
+ * Fills in the instruction and addressing
+ * mode of each opcode, the table above
+ * inverted, or -1 for those not in it
+ */
+void sixfive_opcode_decode(signed char *instructions, signed char *modes){
+  int i, j, opcode;
+
+  memset(instructions, -1, 256);
+  memset(modes, -1, 256);
+  for(i=0;i<sixfive_instruction_count;i++){
+    for(j=0;j<sixfive_mode_count;j++){
+      if((opcode = sixfive_instruction_opcodes[i][j]) != -1){
+        instructions[opcode] = i;
+        modes[opcode] = j;
+      }
+    }
+  }
+}
+
+/*
+ * Parses an instruction's operands into its
+ * addressing mode, as written, and value
+ *
+ * Most operands are a number, lexed in one
+ * pass along with the '#' or parentheses of
+ * their mode.  The rest are compiled as
+ * expressions, found between those, or before
+ * the index register.  An operand wholly in
+ * parentheses is indirect, so a parenthesized
+ * expression must not be.
+ */
+int sixfive_operand_parse(sixfive_ctx *ctx, sixfive_line *tokens, sixfive_operand *operand, int num){
+  sixfive_token expr = tokens->args[0];
+  const char *c = expr.str, *end = expr.str + expr.len;
+  unsigned long value;
+  char open = '\0';
+  int closed = 0, wide, depth, i;
+
+  operand->text = expr;
+  operand->literal = 0;
+  operand->value.value = 0;
+  operand->value.label = -1;
+  operand->value.expr = -1;
+  operand->value.wide = 0;
+
+  if(tokens->argc == 0){
+    operand->mode = sixfive_mode_implied;
+    return sixfive_output_success;
+  }
+  if(tokens->argc == 1 && expr.len == 1 && toupper((unsigned char)expr.str[0]) == 'A'){
+    operand->mode = sixfive_mode_accumulator;
+    return sixfive_output_success;
+  }
+
+  if(c < end && (*c == '#' || *c == '(')){
+    open = *c++;
+  }
+  if(sixfive_operand_number(&c, end, &value, &wide) == sixfive_output_success){
+    closed = (open == '(' && c < end && *c == ')');
+    c += closed;
+    if(c == end && (operand->mode = sixfive_operand_mode(tokens, open, closed)) != sixfive_mode_count){
+      operand->value.value = value;
+      operand->value.wide = wide;
+      operand->literal = 1;
+      return sixfive_output_success;
+    }
+  }
+
+  open = '\0';
+  closed = 0;
+  if(expr.str[0] == '#'){
+    open = '#';
+    expr.str++;
+    expr.len--;
+  } else if(expr.str[0] == '(' && tokens->argc == 2 && sixfive_operand_index(&tokens->args[1], 'X', ')')){
+    open = '(';
+    expr.str++;
+    expr.len--;
+  } else if(expr.str[0] == '(' && expr.str[expr.len-1] == ')'){
+    /* Only if its first parenthesis closes last */
+    for(i=0,depth=0;i<expr.len-1;i++){
+      depth += (expr.str[i] == '(') - (expr.str[i] == ')');
+      if(depth == 0){
+        break;
+      }
+    }
+    if(i == expr.len-1){
+      open = '(';
+      closed = 1;
+      expr.str++;
+      expr.len -= 2;
+    }
+  }
+  if((operand->mode = sixfive_operand_mode(tokens, open, closed)) == sixfive_mode_count){
+    return sixfive_output_error;
+  }
+
+  return sixfive_expr_compile(ctx, expr.str, expr.len, &operand->value, num);
+}
+
+/*
+ * Writes an instruction with the given operand,
+ * choosing its final addressing mode: the zero
+ * page one only if its value is known to fit,
+ * and the instruction has it, and otherwise
+ * the absolute one
+ *
+ * The operand's value is written as it is, to
+ * be patched later if it is not yet known.
+ * So a branch whose operand is only a number
+ * takes it as a raw offset (as BNE $05),
+ * while any other goes to the address it
+ * works out to, see sixfive_branch_eval.
+ */
+int sixfive_instruction_eval(sixfive_ctx *ctx, int instruc, sixfive_operand *operand, int num){
+  const short *opcodes = sixfive_instruction_opcodes[instruc];
+  sixfive_value *value = &operand->value;
+  unsigned char output[3];
+  int mode = operand->mode, constant = (value->label == -1 && value->expr == -1);
+  int fits = (constant && !value->wide && value->value >= 0 && value->value <= 0xff);
+  long min = 0, max = 0xffff;
+
+  if(instruc >= sixfive_instruction_count){
+    return sixfive_output_error;
+  }
+
+  if(mode >= sixfive_mode_zeropage && mode <= sixfive_mode_zeropage_y){
+    if(mode == sixfive_mode_zeropage && opcodes[mode] == -1 && opcodes[sixfive_mode_relative] != -1){
+      /* A branch given only a number takes it as its offset, written like a zero page operand */
+      mode = (fits ? sixfive_mode_relative : sixfive_mode_count);
+    } else if(!fits || opcodes[mode] == -1){
+      /* Or, unknown, in the zero page form if that is all there is */
+      if(constant || opcodes[mode + (sixfive_mode_absolute - sixfive_mode_zeropage)] != -1){
+        mode += sixfive_mode_absolute - sixfive_mode_zeropage;
+      }
+    }
+  }
+  if(mode == sixfive_mode_count || opcodes[mode] == -1){
+    return sixfive_output_error;
+  }
+
+  if(sixfive_mode_lengths[mode] == 2){
+    min = (mode == sixfive_mode_immediate ? -0x80 : 0);
+    max = (value->wide ? -1 : 0xff);
+  }
+  if(constant && sixfive_mode_lengths[mode] > 1 && (value->value < min || value->value > max)){
+    sixfive_diagnostic_add(ctx, num, "operand \"%.*s\" is out of range.", (operand->text.len < 64 ? operand->text.len : 64), operand->text.str);
+    return sixfive_output_error;
+  }
+
+  operand->mode = mode;
+  output[0] = opcodes[mode];
+  output[1] = value->value & 0xff;
+  output[2] = (value->value >> 8) & 0xff;
+
+  return sixfive_image_emit(ctx, output, sixfive_mode_lengths[mode]);
+}
+
+/*
+ * Writes a branch to a label (or the address
+ * of any expression) at its longest,
+ * as the opposite branch over a JMP to the
+ * label, to be shortened once it is known
+ * to be in range (or, when optimizing,
+ * removed if it only skips to the next
+ * instruction)
+ */
+int sixfive_branch_eval(sixfive_ctx *ctx, int opcode, const sixfive_value *value, int num){
+  unsigned char output[5];
+  long offset = ctx->image.length;
+
+  /* Each branch's opposite differs only in bit 5 */
+  output[0] = opcode ^ 0x20;
+  output[1] = 3;
+  output[2] = sixfive_instruction_opcodes[sixfive_instruction_JMP][sixfive_mode_absolute];
+  output[3] = output[4] = 0;
+
+  if(sixfive_image_emit(ctx, output, 5) == sixfive_output_error){
+    return sixfive_output_error;
+  }
+  return sixfive_fixup_relax(ctx, offset, value, (ctx->optimize ? 0 : 2), sixfive_relax_branch, opcode, num);
+}
+
+/*
+ * Packs a three-letter mnemonic into 15 bits,
+ * five per letter, which also makes it
+ * case-insensitive
+ */
+#define SIXFIVE_MNEMONIC_KEY(c0, c1, c2) \
+  ((((c0)&31)<<10) | (((c1)&31)<<5) | ((c2)&31))
+
+#define SIXFIVE_ISA_CASE(m, c0, c1, c2, imp, acc, imm, zp, zpx, zpy, ab, abx, aby, ind, inx, iny, rel) \
+  case SIXFIVE_MNEMONIC_KEY(c0, c1, c2): return sixfive_instruction_##m;
+
+/*
+ * Returns the index of the given instruction
+ * mnemonic, used to access the above table
+ * and determine an instruction's opcode, or
+ * sixfive_instruction_count if it is unknown
+ */
+int sixfive_instruction_type(const char *buf, int len){
+  if(len != 3 ||
+     !isalpha((unsigned char)buf[0]) ||
+     !isalpha((unsigned char)buf[1]) ||
+     !isalpha((unsigned char)buf[2])){
+    return sixfive_instruction_count;
+  }
+
+  switch(SIXFIVE_MNEMONIC_KEY(buf[0], buf[1], buf[2])){
+    SIXFIVE_ISA(SIXFIVE_ISA_CASE)
+  }
+
+  return sixfive_instruction_count;
+}
+
+#define SIXFIVE_ISA_NAME(m, c0, c1, c2, imp, acc, imm, zp, zpx, zpy, ab, abx, aby, ind, inx, iny, rel) \
+  {c0, c1, c2},
+
+/* Each instruction's mnemonic, not NUL-terminated */
+const char sixfive_instruction_names[sixfive_instruction_count][3] = {
+  SIXFIVE_ISA(SIXFIVE_ISA_NAME)
+};
+
+/*****************************/
+/* DIRECTIVES                */
+/*****************************/
+
+/* Name of each directive, without its '.' */
+const char *sixfive_directive_names[sixfive_directive_count] = {
+  "org", "byte", "word", "fill", "incbin", "include", "macro", "endm", "rept", "endr", "export", "import"
+};
+
+/*
+ * Returns the index of the given directive
+ * name, in any case, or sixfive_directive_count
+ * if it is unknown
+ */
+int sixfive_directive_type(const char *buf, int len){
+  const char *name;
+  int i, j;
+
+  for(i=0;i<sixfive_directive_count;i++){
+    name = sixfive_directive_names[i];
+    for(j=0;j<len && name[j] != '\0' && tolower((unsigned char)buf[j]) == name[j];j++);
+    if(j == len && name[j] == '\0'){
+      return i;
+    }
+  }
+
+  return sixfive_directive_count;
+}
+
+/*
+ * Takes the next of a directive's arguments
+ * from the rest of its line, where they are
+ * separated by commas (outside of quotes)
+ * and end at a comment
+ *
+ * Returns sixfive_output_none once there
+ * are none left
+ */
+int sixfive_directive_arg(sixfive_token *rest, sixfive_token *arg){
+  const char *c = rest->str;
+  const char *end = rest->str + rest->len;
+  int quoted = 0;
+
+  while(c < end && isspace((unsigned char)*c)){
+    c++;
+  }
+  if(c == end || *c == ';'){
+    return sixfive_output_none;
+  }
+
+  for(arg->str=c;c<end && (quoted || (*c != ',' && *c != ';'));c++){
+    if(*c == '"'){
+      quoted = !quoted;
+    } else if(!quoted && *c == '\'' && c+2 < end && c[2] == '\''){
+      c += 2;
+    }
+  }
+  for(arg->len=c-arg->str;arg->len > 0 && isspace((unsigned char)arg->str[arg->len-1]);arg->len--);
+
+  if(c < end && *c == ','){
+    c++;
+  }
+  rest->len = end - c;
+  rest->str = c;
+
+  return sixfive_output_success;
+}
+
+/*
+ * Takes the next argument as a number no
+ * larger than max, adding a diagnostic if
+ * it is missing or not one
+ *
+ * The number may be any expression whose
+ * value is known where it is written.
+ */
+int sixfive_directive_number(sixfive_ctx *ctx, sixfive_token *rest, unsigned long max, unsigned long *value, int num){
+  sixfive_token arg;
+  sixfive_value result;
+
+  if(sixfive_directive_arg(rest, &arg) != sixfive_output_success){
+    sixfive_diagnostic_add(ctx, num, "expected a number.");
+    return sixfive_output_error;
+  }
+  if(sixfive_expr_compile(ctx, arg.str, arg.len, &result, num) == sixfive_output_error){
+    return sixfive_output_error;
+  }
+  if(result.label != -1 || result.expr != -1){
+    sixfive_diagnostic_add(ctx, num, "expected a number, not \"%.*s\".", (arg.len < 64 ? arg.len : 64), arg.str);
+    return sixfive_output_error;
+  }
+  if(result.value < 0){
+    sixfive_diagnostic_add(ctx, num, "%li is smaller than 0.", result.value);
+    return sixfive_output_error;
+  }
+  *value = result.value;
+  if(*value > max){
+    sixfive_diagnostic_add(ctx, num, "$%lx is larger than $%lx.", *value, max);
+    return sixfive_output_error;
+  }
+
+  return sixfive_output_success;
+}
+
+/*
+ * Whether a token could name a label: a
+ * letter or underscore, then any number
+ * of letters, digits and underscores
+ */
+int sixfive_directive_label(sixfive_token *arg){
+  int i;
+
+  if(arg->len == 0 || (!isalpha((unsigned char)arg->str[0]) && arg->str[0] != '_')){
+    return 0;
+  }
+  for(i=1;i<arg->len;i++){
+    if(!isalnum((unsigned char)arg->str[i]) && arg->str[i] != '_'){
+      return 0;
+    }
+  }
+
+  return 1;
+}
+
+/*
+ * .org $addr: moves the write cursor to the
+ * given address, padding with zeros, or (before
+ * any byte is written) moves the whole image
+ */
+int sixfive_org_eval(sixfive_ctx *ctx, sixfive_token *rest, int num){
+  unsigned long value;
+  long address = ctx->origin + ctx->image.length;
+
+  if(sixfive_directive_number(ctx, rest, SIXFIVE_OUTPUT_MAX_LENGTH-1, &value, num) == sixfive_output_error){
+    return sixfive_output_error;
+  }
+
+  if(ctx->object && ctx->placed && !ctx->fixed){
+    sixfive_diagnostic_add(ctx, num, "an object placed by the linker may only .org before its first byte.");
+    return sixfive_output_error;
+  }
+
+  ctx->fixed = 1;
+  if(!ctx->placed){
+    ctx->origin = value;
+    return sixfive_output_success;
+  }
+
+  /*
+   * Recorded so that relaxing the code before it keeps it in
+   * place, and as code is written at its longest until then,
+   * it may only fit once relaxed
+   */
+  if((long)value < address){
+    ctx->relaxable++;
+  } else if(sixfive_image_fill(ctx, 0, value - address) == sixfive_output_error){
+    return sixfive_output_error;
+  }
+  return sixfive_fixup_relax(ctx, address - ctx->origin, NULL, value, sixfive_relax_org, -1, num);
+}
+
+/*
+ * .byte and .word: writes each value, of the
+ * given width, in little-endian order, where
+ * those not yet known are patched in later
+ * (truncated to the width)
+ */
+int sixfive_data_eval(sixfive_ctx *ctx, sixfive_token *rest, int width, int num){
+  sixfive_token arg;
+  sixfive_value value;
+  unsigned char output[2];
+  long min = (width == 1 ? -0x80 : -0x8000), max = (width == 1 ? 0xff : 0xffff);
+  int count = 0;
+
+  for(;sixfive_directive_arg(rest, &arg) == sixfive_output_success;count++){
+    if(sixfive_expr_compile(ctx, arg.str, arg.len, &value, num) == sixfive_output_error){
+      return sixfive_output_error;
+    }
+    if(value.label != -1 || value.expr != -1){
+      if(sixfive_fixup_add(ctx, ctx->image.length, &value, width, num) == sixfive_output_error){
+        return sixfive_output_error;
+      }
+      value.value = 0;
+    } else if(value.value > max){
+      sixfive_diagnostic_add(ctx, num, "$%lx is larger than $%lx.", value.value, max);
+      return sixfive_output_error;
+    } else if(value.value < min){
+      sixfive_diagnostic_add(ctx, num, "%li is smaller than %li.", value.value, min);
+      return sixfive_output_error;
+    }
+
+    output[0] = value.value & 0xff;
+    output[1] = (value.value >> 8) & 0xff;
+    if(sixfive_image_emit(ctx, output, width) == sixfive_output_error){
+      return sixfive_output_error;
+    }
+  }
+
+  if(count == 0){
+    sixfive_diagnostic_add(ctx, num, "expected a number or label.");
+    return sixfive_output_error;
+  }
+
+  return sixfive_output_success;
+}
+
+/*
+ * .fill count[, byte]: writes count copies of
+ * a byte, or of zero
+ */
+int sixfive_fill_eval(sixfive_ctx *ctx, sixfive_token *rest, int num){
+  sixfive_token next;
+  unsigned long count, value = 0;
+
+  if(sixfive_directive_number(ctx, rest, SIXFIVE_OUTPUT_MAX_LENGTH, &count, num) == sixfive_output_error){
+    return sixfive_output_error;
+  }
+  next = *rest;
+  if(sixfive_directive_arg(&next, &next) == sixfive_output_success &&
+     sixfive_directive_number(ctx, rest, 0xff, &value, num) == sixfive_output_error){
+    return sixfive_output_error;
+  }
+
+  return sixfive_image_fill(ctx, value, count);
+}
+
+/*
+ * Takes the next argument as a quoted path,
+ * setting name to what is between its quotes
+ * and path to where it is found: relative to
+ * the context's directory, unless absolute
+ */
+int sixfive_directive_path(sixfive_ctx *ctx, sixfive_token *rest, sixfive_token *name, char *path, int num){
+  int len = 0;
+
+  if(sixfive_directive_arg(rest, name) != sixfive_output_success ||
+     name->len < 2 || name->str[0] != '"' || name->str[name->len-1] != '"'){
+    sixfive_diagnostic_add(ctx, num, "expected a quoted path.");
+    return sixfive_output_error;
+  }
+
+  name->str++;
+  name->len -= 2;
+  if(name->str[0] != '/' && ctx->directory[0] != '\0'){
+    len = strlen(ctx->directory);
+  }
+  if(len + 1 + name->len >= FILENAME_MAX){
+    sixfive_diagnostic_add(ctx, num, "path \"%.64s\" is too long.", name->str);
+    return sixfive_output_error;
+  }
+  memcpy(path, ctx->directory, len);
+  if(len > 0){
+    path[len++] = '/';
+  }
+  memcpy(path + len, name->str, name->len);
+  path[len + name->len] = '\0';
+
+  return sixfive_output_success;
+}
+
+/*
+ * .incbin "path"[, offset[, length]]: writes
+ * the bytes of a file (or of part of it,
+ * which must be all there) as they are,
+ * where relative paths are found from the
+ * context's directory
+ *
+ * The file is mapped where possible, so its
+ * bytes are copied once, into the image.
+ */
+int sixfive_incbin_eval(sixfive_ctx *ctx, sixfive_token *rest, int num){
+  sixfive_token name, next;
+  sixfive_source src;
+  char path[FILENAME_MAX];
+  unsigned long offset = 0, length = 0;
+  int has_length = 0, status;
+
+  if(sixfive_directive_path(ctx, rest, &name, path, num) == sixfive_output_error){
+    return sixfive_output_error;
+  }
+  next = *rest;
+  if(sixfive_directive_arg(&next, &next) == sixfive_output_success){
+    if(sixfive_directive_number(ctx, rest, 0xffffffffUL, &offset, num) == sixfive_output_error){
+      return sixfive_output_error;
+    }
+    next = *rest;
+    if(sixfive_directive_arg(&next, &next) == sixfive_output_success){
+      if(sixfive_directive_number(ctx, rest, SIXFIVE_OUTPUT_MAX_LENGTH, &length, num) == sixfive_output_error){
+        return sixfive_output_error;
+      }
+      has_length = 1;
+    }
+  }
+
+  ctx->external = 1;
+  if(sixfive_source_open(&src, path) == sixfive_output_error){
+    sixfive_diagnostic_add(ctx, num, "cannot open \"%.*s\".", (name.len < 64 ? name.len : 64), name.str);
+    return sixfive_output_error;
+  }
+
+  if(offset > (unsigned long)src.length){
+    sixfive_diagnostic_add(ctx, num, "$%lx is past the end of \"%.*s\".", offset, (name.len < 64 ? name.len : 64), name.str);
+    status = sixfive_output_error;
+  } else if(has_length && length > src.length - offset){
+    sixfive_diagnostic_add(ctx, num, "$%lx bytes from $%lx run past the end of \"%.*s\".", length, offset, (name.len < 64 ? name.len : 64), name.str);
+    status = sixfive_output_error;
+  } else {
+    if(!has_length){
+      length = src.length - offset;
+    }
+    status = sixfive_image_emit(ctx, (const unsigned char*)src.data + offset, length);
+  }
+  sixfive_source_close(&src);
+
+  return status;
+}
+
+/*
+ * .export and .import label[, label]: marks
+ * each label as seen by, or defined in, the
+ * other objects it is linked with
+ */
+int sixfive_symbol_eval(sixfive_ctx *ctx, sixfive_token *rest, int flag, int num){
+  sixfive_token arg;
+  int label, count = 0;
+
+  for(;sixfive_directive_arg(rest, &arg) == sixfive_output_success;count++){
+    if(!sixfive_directive_label(&arg) ||
+       (label = sixfive_label_find(ctx, arg.str, arg.len, ADDRESS_UNKNOWN)) == sixfive_output_error){
+      sixfive_diagnostic_add(ctx, num, "expected a label, not \"%.*s\".", (arg.len < 64 ? arg.len : 64), arg.str);
+      return sixfive_output_error;
+    }
+    ctx->symtab.labels[label].flags |= flag;
+  }
+
+  if(count == 0){
+    sixfive_diagnostic_add(ctx, num, "expected a label.");
+    return sixfive_output_error;
+  }
+
+  return sixfive_output_success;
+}
+
+/*
+ * Evaluates a directive given the rest of
+ * its line
+ */
+int sixfive_directive_eval(sixfive_ctx *ctx, sixfive_line *tokens, int num){
+  sixfive_token *rest = &tokens->rest;
+  sixfive_token arg;
+  int status = sixfive_output_error;
+
+  switch(tokens->directive){
+    case sixfive_directive_org:
+      status = sixfive_org_eval(ctx, rest, num);
+      break;
+    case sixfive_directive_byte:
+      status = sixfive_data_eval(ctx, rest, 1, num);
+      break;
+    case sixfive_directive_word:
+      status = sixfive_data_eval(ctx, rest, 2, num);
+      break;
+    case sixfive_directive_fill:
+      status = sixfive_fill_eval(ctx, rest, num);
+      break;
+    case sixfive_directive_incbin:
+      status = sixfive_incbin_eval(ctx, rest, num);
+      break;
+    case sixfive_directive_export:
+      status = sixfive_symbol_eval(ctx, rest, sixfive_symbol_export, num);
+      break;
+    case sixfive_directive_import:
+      status = sixfive_symbol_eval(ctx, rest, sixfive_symbol_import, num);
+      break;
+    default:
+      sixfive_diagnostic_add(ctx, num, "unknown directive \".%.*s\".", tokens->name.len, tokens->name.str);
+      return sixfive_output_error;
+  }
+
+  if(status != sixfive_output_error && sixfive_directive_arg(rest, &arg) == sixfive_output_success){
+    sixfive_diagnostic_add(ctx, num, "unexpected \"%.*s\".", (arg.len < 64 ? arg.len : 64), arg.str);
+    return sixfive_output_error;
+  }
+
+  return status;
+}
+
+/*****************************/
+/* OPTIMIZER                 */
+/*****************************/
+
+/*
+ * Returns the instruction on the line of
+ * source starting at line, or -1 if it has
+ * none, or defines a label (unless labels
+ * are to be skipped over)
+ */
+int sixfive_peephole_peek(const char *line, const char *end, int skip_labels){
+  const char *eol = memchr(line, '\n', end - line);
+  const char *c;
+  int type;
+
+  if(eol == NULL){
+    eol = end;
+  }
+  for(c=line;c<eol && *c != ';' && *c != '.' && *c != '"' && *c != '\'';c++){
+    if(*c == ':'){
+      if(!skip_labels){
+        return -1;
+      }
+      line = c+1;
+    }
+  }
+
+  while(line < eol && (*line == ' ' || *line == '\t' || *line == '\r' || *line == ',')){
+    line++;
+  }
+  for(c=line;c<eol && *c != ' ' && *c != '\t' && *c != '\r' && *c != ',' && *c != ';';c++);
+  if(c == line || *line == '.'){
+    return -1;
+  }
+
+  type = sixfive_instruction_type(line, c - line);
+  return (type == sixfive_instruction_count ? -1 : type);
+}
+
+/*
+ * Returns the register an instruction sets,
+ * along with N and Z, without reading it
+ * (or 0 if it is not one of these)
+ */
+int sixfive_peephole_sets(int instruc){
+  switch(instruc){
+    case sixfive_instruction_LDA:
+    case sixfive_instruction_PLA:
+    case sixfive_instruction_TXA:
+    case sixfive_instruction_TYA:
+      return 'A';
+    case sixfive_instruction_LDX:
+    case sixfive_instruction_TAX:
+    case sixfive_instruction_TSX:
+      return 'X';
+    case sixfive_instruction_LDY:
+    case sixfive_instruction_TAY:
+      return 'Y';
+  }
+
+  return 0;
+}
+
+/*
+ * Whether all an instruction changes is the
+ * register it sets, along with N and Z, so
+ * that it may be removed once that is set
+ * again: loads only with an immediate
+ * operand (reads of memory may have side
+ * effects), and never PLA, which also moves
+ * the stack pointer
+ */
+int sixfive_peephole_removable(int instruc, int immediate){
+  switch(instruc){
+    case sixfive_instruction_LDA:
+    case sixfive_instruction_LDX:
+    case sixfive_instruction_LDY:
+      return immediate;
+    case sixfive_instruction_PLA:
+      return 0;
+  }
+
+  return (sixfive_peephole_sets(instruc) != 0);
+}
+
+/*
+ * Returns which of two instructions, the
+ * second always run straight after the
+ * first, can be removed:
+ *   - The second, if it changes nothing
+ *     the first did not already (such as
+ *     TXA after TAX, or a second SEI)
+ *   - The first, if all it changes is set
+ *     again by the second, without reading
+ *     it (such as LDA # before PLA, or CLC
+ *     before SEC)
+ *   - For a JSR followed by RTS, the RTS,
+ *     with the JSR made a JMP instead
+ *
+ * Only instructions which touch nothing but
+ * A, X, Y, and the flags are removed, as
+ * reads and writes of memory may have side
+ * effects (such as on IO registers), and
+ * the stack must stay as it was, so a PLA
+ * may only ever be the second.  immediate
+ * is whether the first has an immediate
+ * operand.
+ */
+int sixfive_peephole_pair(int first, int immediate, int second){
+  switch(first){
+    case sixfive_instruction_TAX:
+      if(second == sixfive_instruction_TXA){
+        return sixfive_peephole_second;
+      }
+      break;
+    case sixfive_instruction_TXA:
+      if(second == sixfive_instruction_TAX){
+        return sixfive_peephole_second;
+      }
+      break;
+    case sixfive_instruction_TAY:
+      if(second == sixfive_instruction_TYA){
+        return sixfive_peephole_second;
+      }
+      break;
+    case sixfive_instruction_TYA:
+      if(second == sixfive_instruction_TAY){
+        return sixfive_peephole_second;
+      }
+      break;
+    case sixfive_instruction_TSX:
+      if(second == sixfive_instruction_TXS){
+        return sixfive_peephole_second;
+      }
+      break;
+    case sixfive_instruction_CLI:
+    case sixfive_instruction_SEI:
+      if(second == first){
+        return sixfive_peephole_second;
+      }
+      break;
+    case sixfive_instruction_JSR:
+      if(second == sixfive_instruction_RTS){
+        return sixfive_peephole_tail;
+      }
+      break;
+    case sixfive_instruction_CLC:
+    case sixfive_instruction_SEC:
+      if(second == sixfive_instruction_CLC || second == sixfive_instruction_SEC){
+        return sixfive_peephole_first;
+      }
+      break;
+    case sixfive_instruction_CLD:
+    case sixfive_instruction_SED:
+      if(second == sixfive_instruction_CLD || second == sixfive_instruction_SED){
+        return sixfive_peephole_first;
+      }
+      break;
+    case sixfive_instruction_CLV:
+      if(second == sixfive_instruction_CLV){
+        return sixfive_peephole_first;
+      }
+      break;
+  }
+
+  if(sixfive_peephole_removable(first, immediate) && sixfive_peephole_sets(first) == sixfive_peephole_sets(second)){
+    return sixfive_peephole_first;
+  }
+
+  return sixfive_peephole_keep;
+}
+
+/*
+ * Decides what to do with a line, given the
+ * lines on either side of it in the source,
+ * returning whether it is removed, made a
+ * JMP (sixfive_peephole_tail), or kept
+ *
+ * Only the lines right before and after it
+ * are looked at, so a blank line, comment,
+ * label, or directive between two lines
+ * keeps both.  That also keeps the decision
+ * the same however the file is split into
+ * units.
+ */
+int sixfive_peephole(sixfive_ctx *ctx, sixfive_line *tokens){
+  const char *start = ctx->source;
+  const char *end = ctx->source + ctx->source_length;
+  const char *line = tokens->text.str;
+  const char *eol = tokens->text.str + tokens->text.len;
+  const char *prev;
+  int immediate = (tokens->argc == 1 && tokens->args[0].str[0] == '#');
+  int pair;
+
+  if(start == NULL || line < start || eol > end){
+    return sixfive_peephole_keep;
+  }
+
+  /* The line after this one must not be reached from elsewhere */
+  if(eol < end){
+    pair = sixfive_peephole_peek(eol+1, end, 0);
+    if(pair != -1){
+      switch(sixfive_peephole_pair(tokens->instruction, immediate, pair)){
+        case sixfive_peephole_first:
+          return sixfive_peephole_first;
+        case sixfive_peephole_tail:
+          return sixfive_peephole_tail;
+      }
+    }
+  }
+
+  /* Nor this one, to look at the line before it */
+  if(line > start && sixfive_peephole_peek(line, end, 0) != -1){
+    for(prev=line-1;prev > start && prev[-1] != '\n';prev--);
+    pair = sixfive_peephole_peek(prev, line-1, 1);
+    if(pair != -1){
+      switch(sixfive_peephole_pair(pair, 0, tokens->instruction)){
+        case sixfive_peephole_second:
+        case sixfive_peephole_tail:
+          return sixfive_peephole_second;
+      }
+    }
+  }
+
+  return sixfive_peephole_keep;
+}
+
+/*****************************/
+/* LISTING                   */
+/*****************************/
+
+/*
+ * Makes room for count listed lines in all
+ */
+int sixfive_listing_reserve(sixfive_ctx *ctx, int count){
+  sixfive_listeds *listed = &ctx->listed;
+  sixfive_listed *list;
+  int capacity = listed->capacity;
+
+  if(count > capacity){
+    if(capacity == 0){
+      capacity = LISTING_INITIAL_COUNT;
+    }
+    while(capacity < count){
+      capacity *= 2;
+    }
+    list = realloc(listed->list, sizeof(sixfive_listed)*capacity);
+    if(list == NULL){
+      return sixfive_output_error;
+    }
+    ctx->stats.allocations++;
+    listed->list = list;
+    listed->capacity = capacity;
+  }
+
+  return sixfive_output_success;
+}
+
+/*
+ * Records that the given line starts at
+ * the current end of the output
+ */
+int sixfive_listing_add(sixfive_ctx *ctx, int num, int code){
+  sixfive_listeds *listed = &ctx->listed;
+  sixfive_listed *list;
+
+  if(listed->count == listed->capacity && sixfive_listing_reserve(ctx, listed->count+1) == sixfive_output_error){
+    return sixfive_output_error;
+  }
+
+  list = &listed->list[listed->count++];
+  list->offset = ctx->image.length;
+  list->line = num;
+  list->mark = ctx->fixups.count;
+  list->code = code;
+
+  return sixfive_output_success;
+}
+
+/*
+ * Describes each listed line of a finished
+ * assembly: where it ended up, how long it
+ * is, and (for instructions) how many cycles
+ * it takes
+ *
+ * Opcodes are found from the table of them,
+ * inverted, and each instruction takes:
+ *   - At least its cycles in the table
+ *   - One more if it is a branch, if taken,
+ *     and another if that crosses a page
+ *   - One more if it reads from an index
+ *     which may cross a page (which an
+ *     absolute,X or ,Y operand whose low
+ *     byte is 0 never does)
+ */
+int sixfive_listing_finish(sixfive_ctx *ctx){
+  signed char instructions[256], modes[256];
+  sixfive_listed *listed = ctx->listed.list;
+  sixfive_listing_line *line;
+  unsigned char *data = ctx->image.data;
+  long at, end, next, target;
+  int i, opcode, cycles;
+
+  if(ctx->listed.count > ctx->line_capacity){
+    line = realloc(ctx->lines, sizeof(sixfive_listing_line)*ctx->listed.count);
+    if(line == NULL){
+      return sixfive_output_error;
+    }
+    ctx->stats.allocations++;
+    ctx->lines = line;
+    ctx->line_capacity = ctx->listed.count;
+  }
+
+  sixfive_opcode_decode(instructions, modes);
+  for(i=0;i<ctx->listed.count;i++){
+    line = &ctx->lines[i];
+    end = (i+1 < ctx->listed.count ? listed[i+1].offset : ctx->image.length);
+    line->line = listed[i].line;
+    line->offset = listed[i].offset;
+    line->address = ctx->origin + listed[i].offset;
+    line->length = end - listed[i].offset;
+    line->cycles = line->cycles_max = 0;
+    line->crosses = 0;
+    if(!listed[i].code){
+      continue;
+    }
+
+    /* A branch too far to reach is a branch over a JMP, so holds two */
+    for(at=listed[i].offset;at<end && modes[data[at]] != -1;at=next){
+      opcode = data[at];
+      next = at + sixfive_mode_lengths[(int)modes[opcode]];
+      cycles = sixfive_opcode_cycles[opcode];
+      line->cycles += cycles;
+      line->cycles_max += cycles;
+      switch(modes[opcode]){
+        case sixfive_mode_relative:
+          target = ctx->origin + next + (signed char)data[at+1];
+          line->cycles_max++;
+          if(((ctx->origin + next) ^ target) & 0xff00){
+            line->cycles_max++;
+            line->crosses = 1;
+          }
+          break;
+        case sixfive_mode_absolute_x:
+        case sixfive_mode_absolute_y:
+          if(cycles == 4 && data[at+1] != 0){
+            line->cycles_max++;
+            line->crosses = 1;
+          }
+          break;
+        case sixfive_mode_indirect_y:
+          if(cycles == 5){
+            line->cycles_max++;
+            line->crosses = 1;
+          }
+          break;
+      }
+    }
+  }
+  ctx->line_count = ctx->listed.count;
+
+  return sixfive_output_success;
+}
+
+/*****************************/
+/* INTERPRETER               */
+/*****************************/
+
+/* Bits of the status register */
+#define FLAG_C 0x01
+#define FLAG_Z 0x02
+#define FLAG_I 0x04
+#define FLAG_D 0x08
+#define FLAG_B 0x10
+#define FLAG_U 0x20
+#define FLAG_V 0x40
+#define FLAG_N 0x80
+
+/* Sets N and Z from a result */
+#define CPU_NZ(cpu, v) \
+  ((cpu)->p = ((cpu)->p & ~(FLAG_N|FLAG_Z)) | ((v) & FLAG_N) | (((v) & 0xff) == 0 ? FLAG_Z : 0))
+
+/* Sets or clears a flag */
+#define CPU_FLAG(cpu, flag, on) \
+  ((cpu)->p = ((on) ? (cpu)->p | (flag) : (cpu)->p & ~(flag)))
+
+/*
+ * Adds a value and the carry to A, in
+ * decimal if the D flag is set (where,
+ * as on the NMOS 6502, N, V, and Z are
+ * those of the binary sum)
+ */
+void sixfive_cpu_adc(sixfive_cpu *cpu, unsigned int value){
+  unsigned int carry = cpu->p & FLAG_C;
+  unsigned int sum = cpu->a + value + carry;
+  unsigned int low;
+
+  CPU_NZ(cpu, sum);
+  CPU_FLAG(cpu, FLAG_V, ~(cpu->a ^ value) & (cpu->a ^ sum) & 0x80);
+  if(!(cpu->p & FLAG_D)){
+    CPU_FLAG(cpu, FLAG_C, sum > 0xff);
+    cpu->a = sum & 0xff;
+    return;
+  }
+
+  low = (cpu->a & 0x0f) + (value & 0x0f) + carry;
+  if(low > 0x09){
+    low += 0x06;
+  }
+  sum = (cpu->a & 0xf0) + (value & 0xf0) + (low > 0x0f ? 0x10 : 0) + (low & 0x0f);
+  if(sum > 0x9f){
+    sum += 0x60;
+  }
+  CPU_FLAG(cpu, FLAG_C, sum > 0xff);
+  cpu->a = sum & 0xff;
+}
+
+/*
+ * Subtracts a value and the borrow from A,
+ * in decimal if the D flag is set (where
+ * every flag is that of the binary result)
+ */
+void sixfive_cpu_sbc(sixfive_cpu *cpu, unsigned int value){
+  unsigned int borrow = !(cpu->p & FLAG_C);
+  unsigned int diff = (cpu->a - value - borrow) & 0x1ff;
+  int low, high;
+
+  CPU_NZ(cpu, diff);
+  CPU_FLAG(cpu, FLAG_V, (cpu->a ^ value) & (cpu->a ^ diff) & 0x80);
+  CPU_FLAG(cpu, FLAG_C, diff < 0x100);
+  if(!(cpu->p & FLAG_D)){
+    cpu->a = diff & 0xff;
+    return;
+  }
+
+  low = (int)(cpu->a & 0x0f) - (int)(value & 0x0f) - (int)borrow;
+  high = (int)(cpu->a >> 4) - (int)(value >> 4);
+  if(low < 0){
+    low -= 0x06;
+    high--;
+  }
+  if(high < 0){
+    high -= 0x06;
+  }
+  cpu->a = ((high << 4) | (low & 0x0f)) & 0xff;
+}
+
+/* Pushes a byte onto the stack */
+void sixfive_cpu_push(sixfive_cpu *cpu, unsigned int value){
+  cpu->memory[0x100 | cpu->s] = value;
+  cpu->s = (cpu->s - 1) & 0xff;
+}
+
+/* Pulls a byte off of the stack */
+unsigned int sixfive_cpu_pull(sixfive_cpu *cpu){
+  cpu->s = (cpu->s + 1) & 0xff;
+  return cpu->memory[0x100 | cpu->s];
+}
+
+/*
+ * Shifts or rotates a value as the given
+ * instruction does, setting the flags
+ */
+unsigned int sixfive_cpu_shift(sixfive_cpu *cpu, int instruc, unsigned int value){
+  unsigned int carry = cpu->p & FLAG_C;
+
+  switch(instruc){
+    case sixfive_instruction_ASL:
+      CPU_FLAG(cpu, FLAG_C, value & 0x80);
+      value = (value << 1) & 0xff;
+      break;
+    case sixfive_instruction_LSR:
+      CPU_FLAG(cpu, FLAG_C, value & 0x01);
+      value >>= 1;
+      break;
+    case sixfive_instruction_ROL:
+      CPU_FLAG(cpu, FLAG_C, value & 0x80);
+      value = ((value << 1) | carry) & 0xff;
+      break;
+    case sixfive_instruction_ROR:
+      CPU_FLAG(cpu, FLAG_C, value & 0x01);
+      value = (value >> 1) | (carry << 7);
+      break;
+  }
+  CPU_NZ(cpu, value);
+
+  return value;
+}
+
+/*
+ * Runs the output of the last assembly, loaded
+ * at its origin in otherwise empty memory and
+ * started from there, until it reaches a BRK
+ * (which is not run), returns with an RTS from
+ * where it started, reaches an opcode the 6502
+ * does not have, or runs for limit cycles
+ *
+ * Each opcode is decoded by the table of them,
+ * inverted, and run by a switch on its
+ * instruction, having found its operand's
+ * address by its addressing mode.  Each takes
+ * its cycles from the table of them, plus any
+ * it takes to cross a page or branch.
+ *
+ * Counts how many times each address ran, and
+ * the cycles it took in all.
+ */
+int sixfive_ctx_run(sixfive_ctx *ctx, unsigned long limit, sixfive_run *run){
+  signed char instructions[256], modes[256];
+  sixfive_cpu cpu;
+  unsigned char *mem;
+  unsigned int address = 0, base, next, value;
+  int opcode, cost;
+
+  if(ctx->diagnostic_count > 0){
+    return sixfive_output_error;
+  }
+  if(ctx->memory == NULL){
+    ctx->memory = malloc(MEMORY_LENGTH);
+    ctx->counts = malloc(sizeof(unsigned long)*MEMORY_LENGTH);
+    ctx->cycles = malloc(sizeof(unsigned long)*MEMORY_LENGTH);
+  }
+  if(ctx->memory == NULL || ctx->counts == NULL || ctx->cycles == NULL){
+    free(ctx->memory);
+    free(ctx->counts);
+    free(ctx->cycles);
+    ctx->memory = NULL;
+    ctx->counts = ctx->cycles = NULL;
+    return sixfive_output_error;
+  }
+
+  mem = ctx->memory;
+  memset(mem, 0, MEMORY_LENGTH);
+  memcpy(mem + ctx->origin, ctx->image.data, ctx->image.length);
+  memset(ctx->counts, 0, sizeof(unsigned long)*MEMORY_LENGTH);
+  memset(ctx->cycles, 0, sizeof(unsigned long)*MEMORY_LENGTH);
+  sixfive_opcode_decode(instructions, modes);
+
+  cpu.memory = mem;
+  cpu.a = cpu.x = cpu.y = 0;
+  cpu.s = 0xff;
+  cpu.p = FLAG_U | FLAG_I;
+  cpu.pc = ctx->origin;
+  run->status = -1;
+  run->instructions = 0;
+  run->cycles = 0;
+
+  while(run->status == -1){
+    opcode = mem[cpu.pc];
+    if(run->cycles >= limit){
+      run->status = sixfive_run_limit;
+      break;
+    }
+    if(instructions[opcode] == -1 || opcode == 0x00){
+      run->status = (opcode == 0x00 ? sixfive_run_brk : sixfive_run_illegal);
+      break;
+    }
+
+    cost = sixfive_opcode_cycles[opcode];
+    next = (cpu.pc + sixfive_mode_lengths[(int)modes[opcode]]) & 0xffff;
+    value = mem[(cpu.pc + 1) & 0xffff] | (mem[(cpu.pc + 2) & 0xffff] << 8);
+    switch(modes[opcode]){
+      case sixfive_mode_immediate:
+        address = (cpu.pc + 1) & 0xffff;
+        break;
+      case sixfive_mode_zeropage:
+        address = value & 0xff;
+        break;
+      case sixfive_mode_zeropage_x:
+        address = (value + cpu.x) & 0xff;
+        break;
+      case sixfive_mode_zeropage_y:
+        address = (value + cpu.y) & 0xff;
+        break;
+      case sixfive_mode_absolute:
+        address = value;
+        break;
+      case sixfive_mode_absolute_x:
+      case sixfive_mode_absolute_y:
+        address = (value + (modes[opcode] == sixfive_mode_absolute_x ? cpu.x : cpu.y)) & 0xffff;
+        /* Only reads take longer to cross a page, see sixfive_opcode_cycles */
+        if(cost == 4 && ((address ^ value) & 0xff00)){
+          cost++;
+        }
+        break;
+      case sixfive_mode_indirect:
+        /* Never carries into the pointer's high byte */
+        address = mem[value] | (mem[(value & 0xff00) | ((value + 1) & 0xff)] << 8);
+        break;
+      case sixfive_mode_indirect_x:
+        base = (value + cpu.x) & 0xff;
+        address = mem[base] | (mem[(base + 1) & 0xff] << 8);
+        break;
+      case sixfive_mode_indirect_y:
+        base = mem[value & 0xff] | (mem[(value + 1) & 0xff] << 8);
+        address = (base + cpu.y) & 0xffff;
+        if(cost == 5 && ((address ^ base) & 0xff00)){
+          cost++;
+        }
+        break;
+      case sixfive_mode_relative:
+        address = (next + (signed char)(value & 0xff)) & 0xffff;
+        break;
+    }
+
+    switch(instructions[opcode]){
+      case sixfive_instruction_ADC:
+        sixfive_cpu_adc(&cpu, mem[address]);
+        break;
+      case sixfive_instruction_SBC:
+        sixfive_cpu_sbc(&cpu, mem[address]);
+        break;
+      case sixfive_instruction_AND:
+        cpu.a &= mem[address];
+        CPU_NZ(&cpu, cpu.a);
+        break;
+      case sixfive_instruction_ORA:
+        cpu.a |= mem[address];
+        CPU_NZ(&cpu, cpu.a);
+        break;
+      case sixfive_instruction_EOR:
+        cpu.a ^= mem[address];
+        CPU_NZ(&cpu, cpu.a);
+        break;
+      case sixfive_instruction_ASL:
+      case sixfive_instruction_LSR:
+      case sixfive_instruction_ROL:
+      case sixfive_instruction_ROR:
+        if(modes[opcode] == sixfive_mode_accumulator){
+          cpu.a = sixfive_cpu_shift(&cpu, instructions[opcode], cpu.a);
+        } else {
+          mem[address] = sixfive_cpu_shift(&cpu, instructions[opcode], mem[address]);
+        }
+        break;
+      case sixfive_instruction_BIT:
+        value = mem[address];
+        CPU_FLAG(&cpu, FLAG_Z, (cpu.a & value) == 0);
+        cpu.p = (cpu.p & ~(FLAG_N|FLAG_V)) | (value & (FLAG_N|FLAG_V));
+        break;
+
+      /* Branches: the flag each tests, and whether it must be set */
+      case sixfive_instruction_BCC: value = !(cpu.p & FLAG_C); goto branch;
+      case sixfive_instruction_BCS: value = (cpu.p & FLAG_C); goto branch;
+      case sixfive_instruction_BNE: value = !(cpu.p & FLAG_Z); goto branch;
+      case sixfive_instruction_BEQ: value = (cpu.p & FLAG_Z); goto branch;
+      case sixfive_instruction_BPL: value = !(cpu.p & FLAG_N); goto branch;
+      case sixfive_instruction_BMI: value = (cpu.p & FLAG_N); goto branch;
+      case sixfive_instruction_BVC: value = !(cpu.p & FLAG_V); goto branch;
+      case sixfive_instruction_BVS: value = (cpu.p & FLAG_V);
+      branch:
+        if(value){
+          cost += ((next ^ address) & 0xff00 ? 2 : 1);
+          next = address;
+        }
+        break;
+
+      case sixfive_instruction_CLC: cpu.p &= ~FLAG_C; break;
+      case sixfive_instruction_CLD: cpu.p &= ~FLAG_D; break;
+      case sixfive_instruction_CLI: cpu.p &= ~FLAG_I; break;
+      case sixfive_instruction_CLV: cpu.p &= ~FLAG_V; break;
+      case sixfive_instruction_SEC: cpu.p |= FLAG_C; break;
+      case sixfive_instruction_SED: cpu.p |= FLAG_D; break;
+      case sixfive_instruction_SEI: cpu.p |= FLAG_I; break;
+
+      case sixfive_instruction_CMP:
+      case sixfive_instruction_CPX:
+      case sixfive_instruction_CPY:
+        base = (instructions[opcode] == sixfive_instruction_CMP ? cpu.a : instructions[opcode] == sixfive_instruction_CPX ? cpu.x : cpu.y);
+        value = mem[address];
+        CPU_FLAG(&cpu, FLAG_C, base >= value);
+        CPU_NZ(&cpu, (base - value) & 0xff);
+        break;
+
+      case sixfive_instruction_DEC:
+        mem[address] = (mem[address] - 1) & 0xff;
+        CPU_NZ(&cpu, mem[address]);
+        break;
+      case sixfive_instruction_INC:
+        mem[address] = (mem[address] + 1) & 0xff;
+        CPU_NZ(&cpu, mem[address]);
+        break;
+      case sixfive_instruction_DEX: cpu.x = (cpu.x - 1) & 0xff; CPU_NZ(&cpu, cpu.x); break;
+      case sixfive_instruction_DEY: cpu.y = (cpu.y - 1) & 0xff; CPU_NZ(&cpu, cpu.y); break;
+      case sixfive_instruction_INX: cpu.x = (cpu.x + 1) & 0xff; CPU_NZ(&cpu, cpu.x); break;
+      case sixfive_instruction_INY: cpu.y = (cpu.y + 1) & 0xff; CPU_NZ(&cpu, cpu.y); break;
+
+      case sixfive_instruction_JMP:
+        next = address;
+        break;
+      case sixfive_instruction_JSR:
+        sixfive_cpu_push(&cpu, ((next - 1) >> 8) & 0xff);
+        sixfive_cpu_push(&cpu, (next - 1) & 0xff);
+        next = address;
+        break;
+      case sixfive_instruction_RTS:
+        if(cpu.s == 0xff){
+          run->status = sixfive_run_return;
+          next = cpu.pc;
+          break;
+        }
+        next = sixfive_cpu_pull(&cpu);
+        next = ((next | (sixfive_cpu_pull(&cpu) << 8)) + 1) & 0xffff;
+        break;
+      case sixfive_instruction_RTI:
+        cpu.p = (sixfive_cpu_pull(&cpu) & ~FLAG_B) | FLAG_U;
+        next = sixfive_cpu_pull(&cpu);
+        next |= sixfive_cpu_pull(&cpu) << 8;
+        break;
+
+      case sixfive_instruction_LDA: cpu.a = mem[address]; CPU_NZ(&cpu, cpu.a); break;
+      case sixfive_instruction_LDX: cpu.x = mem[address]; CPU_NZ(&cpu, cpu.x); break;
+      case sixfive_instruction_LDY: cpu.y = mem[address]; CPU_NZ(&cpu, cpu.y); break;
+      case sixfive_instruction_STA: mem[address] = cpu.a; break;
+      case sixfive_instruction_STX: mem[address] = cpu.x; break;
+      case sixfive_instruction_STY: mem[address] = cpu.y; break;
+
+      case sixfive_instruction_PHA: sixfive_cpu_push(&cpu, cpu.a); break;
+      case sixfive_instruction_PHP: sixfive_cpu_push(&cpu, cpu.p | FLAG_B | FLAG_U); break;
+      case sixfive_instruction_PLA: cpu.a = sixfive_cpu_pull(&cpu); CPU_NZ(&cpu, cpu.a); break;
+      case sixfive_instruction_PLP: cpu.p = (sixfive_cpu_pull(&cpu) & ~FLAG_B) | FLAG_U; break;
+
+      case sixfive_instruction_TAX: cpu.x = cpu.a; CPU_NZ(&cpu, cpu.x); break;
+      case sixfive_instruction_TAY: cpu.y = cpu.a; CPU_NZ(&cpu, cpu.y); break;
+      case sixfive_instruction_TSX: cpu.x = cpu.s; CPU_NZ(&cpu, cpu.x); break;
+      case sixfive_instruction_TXA: cpu.a = cpu.x; CPU_NZ(&cpu, cpu.a); break;
+      case sixfive_instruction_TXS: cpu.s = cpu.x; break;
+      case sixfive_instruction_TYA: cpu.a = cpu.y; CPU_NZ(&cpu, cpu.a); break;
+    }
+
+    ctx->counts[cpu.pc]++;
+    ctx->cycles[cpu.pc] += cost;
+    run->cycles += cost;
+    run->instructions++;
+    cpu.pc = next;
+  }
+
+  run->pc = cpu.pc;
+  run->counts = ctx->counts;
+  run->address_cycles = ctx->cycles;
+
+  return sixfive_output_success;
+}
+
+/*
+ * Orders labels by address, for finding
+ * the one each line comes after
+ */
+int sixfive_label_compare(const void *a, const void *b){
+  const sixfive_label *x = *(const sixfive_label* const*)a;
+  const sixfive_label *y = *(const sixfive_label* const*)b;
+
+  return (x->address > y->address) - (x->address < y->address);
+}
+
+/*
+ * Describes how often each listed line of
+ * the last assembly ran in the last run,
+ * and which label it comes after
+ */
+int sixfive_ctx_profile(sixfive_ctx *ctx, sixfive_profile *profile){
+  sixfive_label **sorted;
+  sixfive_profile_line *line;
+  const sixfive_listing_line *listed;
+  long at;
+  int i, count = 0, label = 0;
+
+  profile->list = NULL;
+  profile->count = 0;
+  if(!ctx->listing || ctx->counts == NULL){
+    return sixfive_output_error;
+  }
+
+  if(ctx->line_count > ctx->profile_capacity){
+    line = realloc(ctx->profile, sizeof(sixfive_profile_line)*ctx->line_count);
+    if(line == NULL){
+      return sixfive_output_error;
+    }
+    ctx->profile = line;
+    ctx->profile_capacity = ctx->line_count;
+  }
+  sorted = malloc(sizeof(sixfive_label*)*(ctx->symtab.count+1));
+  if(sorted == NULL){
+    return sixfive_output_error;
+  }
+  for(i=0;i<ctx->symtab.count;i++){
+    if(ctx->symtab.labels[i].address != ADDRESS_UNKNOWN){
+      sorted[count++] = &ctx->symtab.labels[i];
+    }
+  }
+  qsort(sorted, count, sizeof(sixfive_label*), sixfive_label_compare);
+
+  for(i=0;i<ctx->line_count;i++){
+    listed = &ctx->lines[i];
+    line = &ctx->profile[i];
+    while(label < count && sorted[label]->address <= listed->address){
+      label++;
+    }
+    line->line = listed->line;
+    line->address = listed->address;
+    line->length = listed->length;
+    line->label = (label > 0 ? sorted[label-1]->string : NULL);
+    line->label_offset = (label > 0 ? listed->address - sorted[label-1]->address : 0);
+    line->count = (listed->length > 0 ? ctx->counts[listed->address] : 0);
+    line->cycles = 0;
+    for(at=0;at<listed->length;at++){
+      line->cycles += ctx->cycles[listed->address + at];
+    }
+  }
+  ctx->profile_count = ctx->line_count;
+  free(sorted);
+
+  profile->list = ctx->profile;
+  profile->count = ctx->profile_count;
+  return sixfive_output_success;
+}
+
+/*****************************/
+/* SCANNING                  */
+/*****************************/
+
+/*
+ * Whether a character may end a token (see
+ * sixfive_tokens_split), which includes every
+ * control character and space, so that the
+ * vectorized scanners below need only a few
+ * comparisons: any character this matches
+ * which does not end one is simply skipped
+ * by the tokenizer's switch
+ */
+#define SCAN_STOP(c) ((unsigned char)(c) <= ' ' || ((c) & 0xfe) == ':' || ((c) & 0xfd) == ',' || (c) == '\'')
+
+#ifdef SIXFIVE_SSE2
+/*
+ * Marks each of 16 bytes matching SCAN_STOP
+ * with a set bit of the mask returned
+ */
+int sixfive_scan_sse2_mask(__m128i x){
+  __m128i stop = _mm_cmpeq_epi8(_mm_min_epu8(x, _mm_set1_epi8(' ')), x);
+
+  stop = _mm_or_si128(stop, _mm_cmpeq_epi8(_mm_and_si128(x, _mm_set1_epi8((char)0xfe)), _mm_set1_epi8(':')));
+  stop = _mm_or_si128(stop, _mm_cmpeq_epi8(_mm_and_si128(x, _mm_set1_epi8((char)0xfd)), _mm_set1_epi8(',')));
+  stop = _mm_or_si128(stop, _mm_cmpeq_epi8(x, _mm_set1_epi8('\'')));
+
+  return _mm_movemask_epi8(stop);
+}
+
+#endif
+
+#ifdef SIXFIVE_AVX2
+/*
+ * Skips from c as far as it can towards end,
+ * 32 bytes at a time, to the first block
+ * with a character matching SCAN_STOP
+ */
+__attribute__((target("avx2")))
+const char *sixfive_scan_avx2(const char *c, const char *end){
+  __m256i x, stop;
+  unsigned int mask;
+
+  for(;end - c >= 32;c+=32){
+    x = _mm256_loadu_si256((const __m256i*)c);
+    stop = _mm256_cmpeq_epi8(_mm256_min_epu8(x, _mm256_set1_epi8(' ')), x);
+    stop = _mm256_or_si256(stop, _mm256_cmpeq_epi8(_mm256_and_si256(x, _mm256_set1_epi8((char)0xfe)), _mm256_set1_epi8(':')));
+    stop = _mm256_or_si256(stop, _mm256_cmpeq_epi8(_mm256_and_si256(x, _mm256_set1_epi8((char)0xfd)), _mm256_set1_epi8(',')));
+    stop = _mm256_or_si256(stop, _mm256_cmpeq_epi8(x, _mm256_set1_epi8('\'')));
+    mask = _mm256_movemask_epi8(stop);
+    if(mask != 0){
+      c += __builtin_ctz(mask);
+      break;
+    }
+  }
+  /* Or the SSE2 code which follows would stall on the upper halves */
+  _mm256_zeroupper();
+
+  return c;
+}
+#endif
+
+/*
+ * Returns whether the CPU can run the widest
+ * scanner built, to be passed to sixfive_scan
+ */
+int sixfive_scan_wide(void){
+#ifdef SIXFIVE_AVX2
+  return __builtin_cpu_supports("avx2") != 0;
+#else
+  return 0;
+#endif
+}
+
+/*
+ * Returns the first character from c (up to
+ * end) which may end a token, or end if none
+ * does, looking at as many at once as the
+ * CPU allows (32, if wide, or else 16)
+ *
+ * Never reads at or past end, so a line
+ * need not be followed by anything.
+ */
+const char *sixfive_scan(const char *c, const char *end, int wide){
+#ifdef SIXFIVE_SSE2
+  int mask;
+
+#ifdef SIXFIVE_AVX2
+  if(wide){
+    c = sixfive_scan_avx2(c, end);
+  }
+#endif
+  for(;end - c >= 16;c+=16){
+    mask = sixfive_scan_sse2_mask(_mm_loadu_si128((const __m128i*)c));
+    if(mask != 0){
+      return c + __builtin_ctz(mask);
+    }
+  }
+#endif
+  (void)wide;
+  for(;c < end && !SCAN_STOP(*c);c++);
+
+  return c;
+}
+
+/*****************************/
+/* TOKENS                    */
+/*****************************/
+
+/*
+ * Whether the spaces from c join the operand
+ * ending at last to what follows them, as
+ * one side or the other is an operator
+ */
+int sixfive_tokens_joined(const char *last, const char *c, const char *end){
+  static const char operators[] = "+-*/&|^<>~";
+
+  while(c < end && (*c == ' ' || *c == '\t')){
+    c++;
+  }
+  if(c == end || *c == ',' || *c == ';' || *c == '\r'){
+    return 0;
+  }
+
+  return (memchr(operators, *last, sizeof(operators)-1) != NULL || *last == '(' ||
+          memchr(operators, *c, sizeof(operators)-1) != NULL || *c == ')');
+}
+
+/*
+ * Splits a single line of input into its
+ * tokens, using spaces, commas, and the end
+ * of the line to separate them (but not
+ * the spaces around an operator, which
+ * join the parts of an expression)
+ *
+ * Tokens are spans of the line itself, so
+ * nothing is copied, nor are any labels
+ * looked up (see sixfive_tokens_bind), so a
+ * line may be split once and assembled any
+ * number of times.  wide is passed on to
+ * sixfive_scan.
+ *
+ * TODO: Variables
+ */
+int sixfive_tokens_split(const char *line, int len, int wide, sixfive_line *out){
+  int current_state = sixfive_state_unknown;
+  const char *c = line;
+  const char *end = line + len;
+  sixfive_token tok;
+
+  out->text.str = line;
+  out->text.len = len;
+  out->instruction = -1;
+  out->argc = 0;
+  out->args[0].len = out->args[1].len = 0;
+  out->directive = -1;
+  out->labels.str = line;
+  out->labels.len = 0;
+  out->tokens = 0;
+  out->num = 0;
+  out->match = 0;
+  out->params = (len > 0 && memchr(line, '\\', len) != NULL);
+  tok.str = line;
+
+#ifdef DEBUG_BUILD
+  sixfive_print_info(1, "Start parsing line.");
+#endif
+  /* Only characters which may end a token are looked at, up to the end */
+  for(;;c++){
+    c = sixfive_scan(c, end, wide);
+    tok.len = c - tok.str;
+    switch(c == end ? '\0' : *c){
+      case ':':
+#ifdef DEBUG_BUILD
+        sixfive_print_info(2, "Label: %.*s", tok.len, tok.str);
+#endif
+        current_state = sixfive_state_label;
+        out->tokens++;
+        out->labels.len = c+1 - line;
+        tok.str = c+1;
+        break;
+      case '.':
+        /* A directive takes the rest of the line as its arguments */
+        if(tok.len == 0 && (current_state == sixfive_state_unknown || current_state == sixfive_state_label)){
+          for(tok.str=++c;c<end && isalpha((unsigned char)*c);c++);
+#ifdef DEBUG_BUILD
+          sixfive_print_info(2, "Directive: %.*s", (int)(c - tok.str), tok.str);
+#endif
+          out->tokens++;
+          out->directive = sixfive_directive_type(tok.str, c - tok.str);
+          out->name.str = tok.str;
+          out->name.len = c - tok.str;
+          out->rest.str = c;
+          out->rest.len = end - c;
+          c = end;
+          break;
+        }
+#ifdef DEBUG_BUILD
+        sixfive_print_info(2, "Directive");
+#endif
+        current_state = sixfive_state_directive;
+        tok.str = c+1;
+        break;
+      case '\'':
+        /* Skips a character in quotes, which may be any of these */
+        if(c+2 < end && c[2] == '\''){
+          c += 2;
+        }
+        break;
+      case ' ':
+      case '\t':
+        /* Spaces around an operator are part of the expression */
+        if(current_state == sixfive_state_operand && tok.len > 0 && sixfive_tokens_joined(c-1, c, end)){
+          break;
+        }
+        /* Fall through */
+      case ';':
+      case '\r':
+      case ',':
+      case '\0':
+        if(c != end){
+          tok.str = c+1;
+        }
+        if(tok.len > 0){
+          out->tokens++;
+          switch(current_state){
+            case sixfive_state_unknown:
+            case sixfive_state_label:
+            case sixfive_state_instruction:
+#ifdef DEBUG_BUILD
+              sixfive_print_info(3, "Instruction: %.*s", tok.len, c-tok.len);
+#endif
+              current_state = sixfive_state_operand;
+              out->instruction = sixfive_instruction_type(c-tok.len, tok.len);
+              /* Kept in case it names a macro */
+              out->name.str = c-tok.len;
+              out->name.len = tok.len;
+              out->rest.str = c;
+              out->rest.len = end - c;
+              break;
+            case sixfive_state_operand:
+#ifdef DEBUG_BUILD
+              sixfive_print_info(4, "Operand: %.*s", tok.len, c-tok.len);
+#endif
+              if(out->argc == MAX_OPERANDS){
+                out->argc = -1;
+                return sixfive_output_error;
+              }
+              out->args[out->argc].str = c-tok.len;
+              out->args[out->argc].len = tok.len;
+              out->argc++;
+              break;
+            case sixfive_state_directive:
+              break;
+          }
+        }
+        if(c != end && *c == ';'){
+#ifdef DEBUG_BUILD
+          sixfive_print_info(2, "Comment");
+#endif
+          c = end;
+        }
+        break;
+    }
+    if(c == end){
+      break;
+    }
+  }
+
+#ifdef DEBUG_BUILD
+  sixfive_print_info(1, "End parsing line.");
+#endif
+
+  return sixfive_output_success;
+}
+
+/*
+ * Defines the labels a line holds, at the
+ * current address
+ *
+ * Labels its operands use are looked up as
+ * they are compiled (see sixfive_expr_compile).
+ */
+void sixfive_tokens_bind(sixfive_ctx *ctx, sixfive_line *tokens){
+  const char *c = tokens->labels.str;
+  const char *end = tokens->labels.str + tokens->labels.len;
+  const char *start = c;
+  int label_ind;
+
+  /* Each label runs from the last separator to its ':' */
+  for(;c<end;c++){
+    switch(*c){
+      case ':':
+        if((label_ind = sixfive_label_find(ctx, start, c - start, ctx->origin + ctx->image.length)) != sixfive_output_error){
+          ctx->symtab.labels[label_ind].mark = ctx->fixups.count;
+        }
+        start = c+1;
+        break;
+      case '.':
+      case ' ':
+      case '\t':
+      case '\r':
+      case ',':
+      case '\0':
+        start = c+1;
+        break;
+    }
+  }
+
+  ctx->stats.tokens += tokens->tokens;
+}
+
+/*
+ * Pairs each line starting a .macro or .rept
+ * with the line ending it, setting the match
+ * of both to the distance to the other
+ *
+ * Lines with no match keep a match of 0,
+ * found (and reported) once they are reached.
+ * Those still open are chained through their
+ * matches, by index, while looking for ends.
+ */
+void sixfive_tokens_match(sixfive_line *lines, int count){
+  int i, open = -1, next;
+
+  for(i=0;i<count;i++){
+    switch(lines[i].directive){
+      case sixfive_directive_macro:
+      case sixfive_directive_rept:
+        lines[i].match = open;
+        open = i;
+        break;
+      case sixfive_directive_endm:
+      case sixfive_directive_endr:
+        if(open != -1){
+          next = lines[open].match;
+          lines[open].match = i - open;
+          lines[i].match = open - i;
+          open = next;
+        }
+        break;
+    }
+  }
+
+  for(;open != -1;open=next){
+    next = lines[open].match;
+    lines[open].match = 0;
+  }
+}
+
+/*
+ * Makes room for count lines in all
+ */
+int sixfive_tokens_reserve(sixfive_ctx *ctx, sixfive_lines *lines, int count){
+  sixfive_line *list;
+  int capacity = lines->capacity;
+
+  if(count > capacity){
+    if(capacity == 0){
+      capacity = BODIES_INITIAL_COUNT;
+    }
+    while(capacity < count){
+      capacity *= 2;
+    }
+    list = realloc(lines->list, sizeof(sixfive_line)*capacity);
+    if(list == NULL){
+      return sixfive_output_error;
+    }
+    ctx->stats.allocations++;
+    lines->list = list;
+    lines->capacity = capacity;
+  }
+
+  return sixfive_output_success;
+}
+
+/*****************************/
+/* MACROS                    */
+/*****************************/
+
+sixfive_cache *sixfive_cache_new(void){
+  sixfive_cache *cache = calloc(sizeof(sixfive_cache), 1);
+
+  if(cache != NULL){
+    cache->wide = sixfive_scan_wide();
+#ifdef SIXFIVE_THREADS
+    pthread_mutex_init(&cache->lock, NULL);
+#endif
+  }
+  return cache;
+}
+
+/*
+ * Frees an included file, once nothing
+ * uses it
+ */
+void sixfive_included_free(sixfive_included *file){
+  sixfive_source_close(&file->source);
+  free(file->lines);
+  free(file->path);
+  free(file);
+}
+
+void sixfive_cache_free(sixfive_cache *cache){
+  sixfive_included *file, *next;
+
+  if(cache == NULL){
+    return;
+  }
+  for(file=cache->files;file != NULL;file=next){
+    next = file->next;
+    sixfive_included_free(file);
+  }
+#ifdef SIXFIVE_THREADS
+  pthread_mutex_destroy(&cache->lock);
+#endif
+  free(cache);
+}
+
+/*
+ * Reads a file and splits it into lines
+ * of tokens, leaving out those with none
+ */
+sixfive_included *sixfive_included_load(char *path, int wide){
+  sixfive_included *file = calloc(sizeof(sixfive_included), 1);
+  const char *line, *end, *eol;
+  long lines = 1, at;
+  int num = 1;
+
+  if(file == NULL){
+    return NULL;
+  }
+  file->path = malloc(strlen(path)+1);
+  if(file->path == NULL || sixfive_source_open(&file->source, path) == sixfive_output_error){
+    free(file->path);
+    free(file);
+    return NULL;
+  }
+  strcpy(file->path, path);
+
+  for(at=0;at<file->source.length;at++){
+    lines += (file->source.data[at] == '\n');
+  }
+  file->lines = malloc(sizeof(sixfive_line)*lines);
+  if(file->lines == NULL){
+    sixfive_included_free(file);
+    return NULL;
+  }
+
+  line = file->source.data;
+  end = file->source.data + file->source.length;
+  for(;line < end;line=eol+1,num++){
+    eol = memchr(line, '\n', end - line);
+    if(eol == NULL){
+      eol = end;
+    }
+    sixfive_tokens_split(line, eol - line, wide, &file->lines[file->count]);
+    file->lines[file->count].num = num;
+    if(file->lines[file->count].tokens > 0){
+      file->count++;
+    }
+  }
+  sixfive_tokens_match(file->lines, file->count);
+
+  return file;
+}
+
+/*
+ * Lets go of an included file, freeing it
+ * if nothing else uses it
+ */
+void sixfive_cache_release(sixfive_included *file){
+  int refs;
+
+  if(file->cache == NULL){
+    sixfive_included_free(file);
+    return;
+  }
+#ifdef SIXFIVE_THREADS
+  pthread_mutex_lock(&file->cache->lock);
+#endif
+  refs = --file->refs;
+#ifdef SIXFIVE_THREADS
+  pthread_mutex_unlock(&file->cache->lock);
+#endif
+  if(refs == 0){
+    sixfive_included_free(file);
+  }
+}
+
+/*
+ * Returns where the cache links to the file
+ * at path (where NULL is linked, if it has
+ * none), taking a reference to the file if
+ * it is unmodified since it was read
+ */
+sixfive_included **sixfive_cache_find(sixfive_cache *cache, char *path, time_t mtime, long size, int *fresh){
+  sixfive_included **link;
+
+  for(link=&cache->files;*link != NULL && strcmp((*link)->path, path) != 0;link=&(*link)->next);
+  *fresh = (*link != NULL && (*link)->mtime == mtime && (*link)->size == size);
+  if(*fresh){
+    (*link)->refs++;
+  }
+
+  return link;
+}
+
+/*
+ * Returns the latest version of a file from
+ * the cache, adding it if it is new (or was
+ * modified since it was added), or NULL if
+ * it cannot be read
+ *
+ * Files are read without holding the lock,
+ * so that one thread reading a file does not
+ * hold up the rest, then looked for again in
+ * case another thread added it meanwhile.
+ * Where the time a file was modified cannot
+ * be found, it is read again each time, and
+ * not kept.
+ */
+sixfive_included *sixfive_cache_get(sixfive_cache *cache, char *path){
+  sixfive_included *file, *stale, **link;
+#ifdef SIXFIVE_MMAP
+  struct stat st;
+  int fresh;
+
+  if(stat(path, &st) != 0){
+    return NULL;
+  }
+#ifdef SIXFIVE_THREADS
+  pthread_mutex_lock(&cache->lock);
+#endif
+  link = sixfive_cache_find(cache, path, st.st_mtime, st.st_size, &fresh);
+  file = *link;
+#ifdef SIXFIVE_THREADS
+  pthread_mutex_unlock(&cache->lock);
+#endif
+  if(fresh){
+    return file;
+  }
+
+  if((file = sixfive_included_load(path, cache->wide)) == NULL){
+    return NULL;
+  }
+  file->mtime = st.st_mtime;
+  file->size = st.st_size;
+  file->cache = cache;
+  file->refs = 2;
+
+#ifdef SIXFIVE_THREADS
+  pthread_mutex_lock(&cache->lock);
+#endif
+  link = sixfive_cache_find(cache, path, st.st_mtime, st.st_size, &fresh);
+  stale = NULL;
+  if(fresh){
+    stale = file;
+    file = *link;
+  } else {
+    /* The version it replaces is freed once its last user lets go */
+    if(*link != NULL){
+      stale = *link;
+      *link = stale->next;
+      stale = (--stale->refs == 0 ? stale : NULL);
+    }
+    file->next = cache->files;
+    cache->files = file;
+  }
+#ifdef SIXFIVE_THREADS
+  pthread_mutex_unlock(&cache->lock);
+#endif
+  if(stale != NULL){
+    sixfive_included_free(stale);
+  }
+#else
+  (void)stale;
+  (void)link;
+  (void)cache;
+  file = sixfive_included_load(path, cache->wide);
+#endif
+
+  return file;
+}
+
+/*
+ * Opens the file named by an .include line,
+ * from the context's cache, holding on to it
+ * until the context's next assembly
+ */
+sixfive_included *sixfive_include_open(sixfive_ctx *ctx, sixfive_line *tokens, int num){
+  sixfive_included *file, **held;
+  sixfive_token name, arg;
+  char path[FILENAME_MAX];
+  int capacity;
+
+  if(sixfive_directive_path(ctx, &tokens->rest, &name, path, num) == sixfive_output_error){
+    return NULL;
+  }
+  if(sixfive_directive_arg(&tokens->rest, &arg) == sixfive_output_success){
+    sixfive_diagnostic_add(ctx, num, "unexpected \"%.*s\".", (arg.len < 64 ? arg.len : 64), arg.str);
+    return NULL;
+  }
+
+  if(ctx->held_count == ctx->held_capacity){
+    capacity = (ctx->held_capacity == 0 ? MACROS_INITIAL_COUNT : ctx->held_capacity*2);
+    held = realloc(ctx->held, sizeof(sixfive_included*)*capacity);
+    if(held == NULL){
+      return NULL;
+    }
+    ctx->stats.allocations++;
+    ctx->held = held;
+    ctx->held_capacity = capacity;
+  }
+  if(ctx->cache == NULL && ctx->own_cache == NULL && (ctx->own_cache = sixfive_cache_new()) == NULL){
+    return NULL;
+  }
+
+  ctx->external = 1;
+  file = sixfive_cache_get((ctx->cache != NULL ? ctx->cache : ctx->own_cache), path);
+  if(file == NULL){
+    sixfive_diagnostic_add(ctx, num, "cannot open \"%.*s\".", (name.len < 64 ? name.len : 64), name.str);
+    return NULL;
+  }
+  ctx->held[ctx->held_count++] = file;
+
+  return file;
+}
+
+/*
+ * Returns the index of the macro a line
+ * names in place of an instruction, or -1
+ * if it names none
+ */
+int sixfive_macro_find(sixfive_ctx *ctx, sixfive_line *tokens){
+  int count = ctx->macro_names.count, i;
+
+  if(ctx->macro_count == 0 || tokens->instruction != sixfive_instruction_count){
+    return -1;
+  }
+  i = sixfive_symtab_find(&ctx->macro_names, tokens->name.str, tokens->name.len,
+    djb2hash((const unsigned char*)tokens->name.str, tokens->name.len), ADDRESS_UNKNOWN);
+  if(i == sixfive_output_error){
+    return -1;
+  }
+  if(i >= count){
+    ctx->macro_names.labels[i].mark = -1;
+  }
+
+  return ctx->macro_names.labels[i].mark;
+}
+
+/*
+ * .macro name [param, ...]: defines a macro
+ * of the lines up to the matching .endm,
+ * which lines, starting with the one at
+ * index first, are in
+ */
+int sixfive_macro_define(sixfive_ctx *ctx, const sixfive_line *lines, int first, int num){
+  const sixfive_line *tokens = &lines[first];
+  sixfive_token rest = tokens->rest, name, param;
+  sixfive_macro *macro;
+  int count = ctx->macro_names.count, capacity, i;
+
+  if(tokens->match <= 0 || tokens[tokens->match].directive != sixfive_directive_endm){
+    sixfive_diagnostic_add(ctx, num, ".macro has no matching .endm.");
+    return sixfive_output_error;
+  }
+
+  /* The name is followed by a space, the parameters by commas */
+  while(rest.len > 0 && isspace((unsigned char)*rest.str)){
+    rest.str++;
+    rest.len--;
+  }
+  for(name.str=rest.str,name.len=0;name.len < rest.len && !isspace((unsigned char)rest.str[name.len]) && rest.str[name.len] != ';';name.len++);
+  rest.str += name.len;
+  rest.len -= name.len;
+  if(!sixfive_directive_label(&name)){
+    sixfive_diagnostic_add(ctx, num, "expected the name of the macro.");
+    return sixfive_output_error;
+  }
+  if(sixfive_instruction_type(name.str, name.len) != sixfive_instruction_count){
+    sixfive_diagnostic_add(ctx, num, "\"%.*s\" is an instruction.", name.len, name.str);
+    return sixfive_output_error;
+  }
+
+  if(ctx->macro_count == ctx->macro_capacity){
+    capacity = (ctx->macro_capacity == 0 ? MACROS_INITIAL_COUNT : ctx->macro_capacity*2);
+    macro = realloc(ctx->macros, sizeof(sixfive_macro)*capacity);
+    if(macro == NULL){
+      return sixfive_output_error;
+    }
+    ctx->stats.allocations++;
+    ctx->macros = macro;
+    ctx->macro_capacity = capacity;
+  }
+  macro = &ctx->macros[ctx->macro_count];
+  for(macro->param_count=0;sixfive_directive_arg(&rest, &param) == sixfive_output_success;macro->param_count++){
+    if(!sixfive_directive_label(&param)){
+      sixfive_diagnostic_add(ctx, num, "expected the name of a parameter, not \"%.*s\".", (param.len < 64 ? param.len : 64), param.str);
+      return sixfive_output_error;
+    }
+    if(macro->param_count == MAX_MACRO_PARAMS){
+      sixfive_diagnostic_add(ctx, num, "a macro may have at most %i parameters.", MAX_MACRO_PARAMS);
+      return sixfive_output_error;
+    }
+    macro->params[macro->param_count] = param;
+  }
+
+  i = sixfive_symtab_find(&ctx->macro_names, name.str, name.len, djb2hash((const unsigned char*)name.str, name.len), ADDRESS_UNKNOWN);
+  if(i == sixfive_output_error){
+    return sixfive_output_error;
+  }
+  if(i < count && ctx->macro_names.labels[i].mark != -1){
+    sixfive_diagnostic_add(ctx, num, "macro \"%.*s\" is already defined.", name.len, name.str);
+    return sixfive_output_error;
+  }
+  ctx->macro_names.labels[i].mark = ctx->macro_count++;
+
+  /* The context's bodies may move as they grow, so are kept by index */
+  macro->name = ctx->macro_names.labels[i].string;
+  macro->lines = lines;
+  macro->first = first+1;
+  macro->count = tokens->match - 1;
+  if(ctx->bodies.count > 0 && lines >= ctx->bodies.list && lines < ctx->bodies.list + ctx->bodies.count){
+    macro->lines = NULL;
+    macro->first += lines - ctx->bodies.list;
+  }
+  macro->source = ctx->source;
+  macro->source_length = ctx->source_length;
+
+  return sixfive_output_success;
+}
+
+/*
+ * Starts expanding a macro, given the line
+ * which names it, taking its arguments from
+ * the rest of the line, separated by commas
+ */
+int sixfive_macro_args(sixfive_ctx *ctx, int macro, sixfive_line *tokens, sixfive_expansion *expansion, int num){
+  sixfive_token rest = tokens->rest, arg;
+  int argc = 0;
+
+  expansion->macro = ctx->macros[macro];
+  expansion->is_macro = 1;
+  expansion->unique = ++ctx->expansions;
+  expansion->path = NULL;
+  while(argc <= expansion->macro.param_count && sixfive_directive_arg(&rest, &arg) == sixfive_output_success){
+    if(argc < expansion->macro.param_count){
+      expansion->args[argc] = arg;
+    }
+    argc++;
+  }
+  if(argc != expansion->macro.param_count){
+    sixfive_diagnostic_add(ctx, num, "macro \"%s\" takes %i argument%s.", expansion->macro.name,
+      expansion->macro.param_count, (expansion->macro.param_count == 1 ? "" : "s"));
+    return sixfive_output_error;
+  }
+
+  return sixfive_output_success;
+}
+
+/*
+ * Writes a line of a macro into out, which
+ * holds MACRO_LINE_LENGTH bytes, with each
+ * \param replaced by its argument and each
+ * \@ by a number unique to the expansion
+ * (leaving any comment as it is)
+ */
+int sixfive_macro_substitute(sixfive_ctx *ctx, const sixfive_expansion *expansion, const sixfive_token *text, char *out, int *out_len, int num){
+  const char *c = text->str, *end = text->str + text->len, *name;
+  const sixfive_token *param;
+  char unique[24];
+  int len = 0, quoted = 0, i;
+  sixfive_token copy;
+
+  while(c < end){
+    if(*c == ';' && !quoted){
+      copy.str = c;
+      copy.len = end - c;
+      c = end;
+    } else if(*c == '\\'){
+      for(name=++c;c < end && (isalnum((unsigned char)*c) || *c == '_');c++);
+      if(c == name && c < end && *c == '@'){
+        c++;
+        sprintf(unique, "%lu", expansion->unique);
+        copy.str = unique;
+        copy.len = strlen(unique);
+      } else {
+        for(i=0;i<expansion->macro.param_count;i++){
+          param = &expansion->macro.params[i];
+          if(param->len == c - name && strncmp(param->str, name, param->len) == 0){
+            break;
+          }
+        }
+        if(i == expansion->macro.param_count){
+          sixfive_diagnostic_add(ctx, num, "macro \"%s\" has no parameter \"\\%.*s\".", expansion->macro.name, (int)(c - name < 64 ? c - name : 64), name);
+          return sixfive_output_error;
+        }
+        copy = expansion->args[i];
+      }
+    } else {
+      quoted ^= (*c == '"');
+      copy.str = c++;
+      copy.len = 1;
+    }
+
+    if(len + copy.len > MACRO_LINE_LENGTH){
+      sixfive_diagnostic_add(ctx, num, "line of macro \"%s\" is too long once expanded.", expansion->macro.name);
+      return sixfive_output_error;
+    }
+    memcpy(out + len, copy.str, copy.len);
+    len += copy.len;
+  }
+  *out_len = len;
+
+  return sixfive_output_success;
+}
+
+/*****************************/
+/* PARSER                    */
+/*****************************/
+
+/*
+ * Assembles a line split into tokens,
+ * recording a fixup for its operand, if
+ * its value is not yet known
+ */
+int sixfive_parse_eval(sixfive_ctx *ctx, sixfive_line *tokens, int num){
+  long offset = ctx->image.length;
+  const short *opcodes;
+  sixfive_operand operand;
+  int peephole = sixfive_peephole_keep;
+
+  ctx->here = offset;
+  if(tokens->directive != -1){
+    if(ctx->listing && sixfive_listing_add(ctx, num, 0) == sixfive_output_error){
+      return sixfive_output_error;
+    }
+    return sixfive_directive_eval(ctx, tokens, num);
+  }
+  if(tokens->instruction == -1){
+    return sixfive_output_none;
+  }
+  if(tokens->instruction >= sixfive_instruction_count){
+    return sixfive_output_error;
+  }
+  if(ctx->listing && sixfive_listing_add(ctx, num, 1) == sixfive_output_error){
+    return sixfive_output_error;
+  }
+  if(ctx->optimize){
+    peephole = sixfive_peephole(ctx, tokens);
+    if(peephole == sixfive_peephole_tail){
+      tokens->instruction = sixfive_instruction_JMP;
+      ctx->stats.optimize_cycles += 3;
+    }
+  }
+  if(sixfive_operand_parse(ctx, tokens, &operand, num) == sixfive_output_error){
+    return sixfive_output_error;
+  }
+  opcodes = sixfive_instruction_opcodes[tokens->instruction];
+  if(!operand.literal && operand.mode == sixfive_mode_zeropage && opcodes[sixfive_mode_relative] != -1){
+    /* A branch to an expression goes to its address, even a constant one */
+    if(operand.value.label == -1 && operand.value.expr == -1 &&
+       sixfive_expr_constant(ctx, &operand.value) == sixfive_output_error){
+      return sixfive_output_error;
+    }
+    return sixfive_branch_eval(ctx, opcodes[sixfive_mode_relative], &operand.value, num);
+  }
+  if(sixfive_instruction_eval(ctx, tokens->instruction, &operand, num) == sixfive_output_error){
+    return sixfive_output_error;
+  }
+  if(peephole == sixfive_peephole_first || peephole == sixfive_peephole_second){
+    /* Written first all the same, so that it is still checked */
+    ctx->stats.optimize_bytes += ctx->image.length - offset;
+    ctx->stats.optimize_cycles += (tokens->instruction == sixfive_instruction_RTS ? 6 : 2);
+    ctx->stats.bytes -= ctx->image.length - offset;
+    ctx->image.length = offset;
+    ctx->listed.count -= (ctx->listing ? 1 : 0);
+    return sixfive_output_success;
+  }
+  if(operand.value.label != -1 || operand.value.expr != -1){
+    /* A JMP to the next instruction is removed when relaxed */
+    if(ctx->optimize && tokens->instruction == sixfive_instruction_JMP && operand.mode == sixfive_mode_absolute){
+      return sixfive_fixup_relax(ctx, offset, &operand.value, 0, sixfive_relax_jump, -1, num);
+    }
+    /* Written as absolute, until its value is known to be in the zero page */
+    if(operand.mode >= sixfive_mode_absolute && operand.mode <= sixfive_mode_absolute_y &&
+       opcodes[operand.mode - (sixfive_mode_absolute - sixfive_mode_zeropage)] != -1){
+      return sixfive_fixup_relax(ctx, offset, &operand.value, 2, sixfive_relax_zeropage,
+                                 opcodes[operand.mode - (sixfive_mode_absolute - sixfive_mode_zeropage)], num);
+    }
+    return sixfive_fixup_add(ctx, offset+1, &operand.value, sixfive_mode_lengths[operand.mode]-1, num);
+  }
+
+  return sixfive_output_success;
+}
+
+/*
+ * Patches every fixup recorded while
+ * parsing with its value, now that all
+ * labels are known
+ */
+int sixfive_parse_labels(sixfive_ctx *ctx){
+  unsigned char *data = ctx->image.data;
+  sixfive_fixup *fixup = ctx->fixups.list;
+  sixfive_fixup *end = ctx->fixups.list + ctx->fixups.count;
+  long value;
+  int status;
+
+#ifdef DEBUG_BUILD
+  sixfive_print_info(1, "Start replacing labels.");
+#endif
+
+  for(;fixup<end;fixup++){
+    if(fixup->relax == sixfive_relax_org){
+      continue;
+    }
+    status = sixfive_fixup_value(fixup, ctx->exprs.list, ctx->symtab.labels, NULL, NULL,
+                                 ctx->origin + fixup->offset + fixup->here, &value);
+    if(status != sixfive_output_success){
+      sixfive_fixup_error(ctx, fixup, ctx->symtab.labels, status, value);
+      return sixfive_output_error;
+    }
+
+#ifdef DEBUG_BUILD
+    sixfive_print_info(2, "Operand at \"%.4lx\" becomes \"%.4lx\"", fixup->offset, value & 0xffff);
+#endif
+
+    if(sixfive_fixup_patch(ctx, data, fixup, value) == sixfive_output_error){
+      return sixfive_output_error;
+    }
+  }
+
+#ifdef DEBUG_BUILD
+  sixfive_print_info(1, "End replacing labels.");
+#endif
+
+  return sixfive_output_success;
+}
+
+/*
+ * Assembles lines already split into tokens,
+ * from a file, macro, or .rept block, which
+ * are reported on line num of the file being
+ * assembled (or, if 0, on their own lines)
+ *
+ * Lines which use a macro's parameters are
+ * split again once substituted, while the
+ * rest are assembled as they are, so that
+ * expanding a macro costs no more than its
+ * lines do.  Expanding a macro or including
+ * a file recurses, at most MAX_NESTING deep.
+ */
+int sixfive_parse_block(sixfive_ctx *ctx, const sixfive_line *lines, int count, int num, const sixfive_expansion *expansion, int depth){
+  char text[MACRO_LINE_LENGTH];
+  const sixfive_line *line, *body;
+  const char *source = ctx->source;
+  long source_length = ctx->source_length;
+  sixfive_expansion inner;
+  sixfive_included *file;
+  sixfive_line tokens;
+  sixfive_token arg;
+  unsigned long repeat = 0;
+  int i, at, len, macro = -1, diagnostics, status;
+
+  if(depth > 0){
+    ctx->stats.lines += count;
+  }
+  for(i=0;i<count;i++){
+    line = &lines[i];
+    at = (num != 0 ? num : line->num);
+    diagnostics = ctx->diagnostic_count;
+    status = sixfive_output_success;
+    tokens = *line;
+    if(expansion != NULL && expansion->is_macro && line->params && line->directive != sixfive_directive_macro){
+      status = sixfive_macro_substitute(ctx, expansion, &line->text, text, &len, at);
+      sixfive_tokens_split(text, len, ctx->wide, &tokens);
+      tokens.num = line->num;
+      tokens.match = line->match;
+    }
+
+    if(status == sixfive_output_error){
+      /* Already reported */
+    } else if(line->directive == sixfive_directive_macro){
+      status = sixfive_macro_define(ctx, lines, i, at);
+      i += line->match;
+    } else if(line->directive == sixfive_directive_rept){
+      if(line->match <= 0 || line[line->match].directive != sixfive_directive_endr){
+        sixfive_diagnostic_add(ctx, at, ".rept has no matching .endr.");
+        status = sixfive_output_error;
+      } else if((status = sixfive_directive_number(ctx, &tokens.rest, SIXFIVE_OUTPUT_MAX_LENGTH, &repeat, at)) != sixfive_output_error &&
+                sixfive_directive_arg(&tokens.rest, &arg) == sixfive_output_success){
+        sixfive_diagnostic_add(ctx, at, "unexpected \"%.*s\".", (arg.len < 64 ? arg.len : 64), arg.str);
+        status = sixfive_output_error;
+      }
+      for(;status != sixfive_output_error && repeat > 0;repeat--){
+        status = sixfive_parse_block(ctx, line+1, line->match - 1, num, expansion, depth+1);
+      }
+      i += line->match;
+    } else if(tokens.directive == sixfive_directive_include || (macro = sixfive_macro_find(ctx, &tokens)) != -1){
+      if(depth == MAX_NESTING){
+        sixfive_diagnostic_add(ctx, at, "macros and included files nest more than %i deep.", MAX_NESTING);
+        status = sixfive_output_error;
+      } else if(tokens.directive == sixfive_directive_include){
+        if((file = sixfive_include_open(ctx, &tokens, at)) == NULL){
+          status = sixfive_output_error;
+        } else {
+          inner.is_macro = 0;
+          inner.path = file->path;
+          ctx->source = file->source.data;
+          ctx->source_length = file->source.length;
+          status = sixfive_parse_block(ctx, file->lines, file->count, at, &inner, depth+1);
+        }
+      } else if((status = sixfive_macro_args(ctx, macro, &tokens, &inner, at)) != sixfive_output_error){
+        body = (inner.macro.lines != NULL ? inner.macro.lines : ctx->bodies.list) + inner.macro.first;
+        ctx->source = inner.macro.source;
+        ctx->source_length = inner.macro.source_length;
+        status = sixfive_parse_block(ctx, body, inner.macro.count, at, &inner, depth+1);
+      }
+      ctx->source = source;
+      ctx->source_length = source_length;
+    } else if(tokens.directive == sixfive_directive_endm || tokens.directive == sixfive_directive_endr){
+      sixfive_diagnostic_add(ctx, at, ".%s has no matching .%s.", sixfive_directive_names[tokens.directive],
+        (tokens.directive == sixfive_directive_endm ? "macro" : "rept"));
+      status = sixfive_output_error;
+    } else if(tokens.argc == -1){
+      status = sixfive_output_error;
+    } else {
+      sixfive_tokens_bind(ctx, &tokens);
+      status = sixfive_parse_eval(ctx, &tokens, at);
+    }
+
+    if(status == sixfive_output_error){
+      /* Unless the line already said what was wrong with it */
+      if(ctx->diagnostic_count == diagnostics){
+        sixfive_diagnostic_add(ctx, at, "invalid instruction/operand combination: \"%.*s\"", (tokens.text.len < 64 ? tokens.text.len : 64), tokens.text.str);
+      }
+      if(expansion != NULL && expansion->path != NULL){
+        sixfive_diagnostic_add(ctx, at, "in \"%.64s\", on line %i.", expansion->path, line->num);
+      }
+      return sixfive_output_error;
+    }
+  }
+
+  return sixfive_output_success;
+}
+
+/*
+ * Parses an entire string of input, line
+ * by line, leaving its labels unresolved
+ *
+ * The lines of a .macro or .rept block are
+ * split into tokens and kept until its end,
+ * then defined as a macro or repeated.
+ *
+ * Sets *lines to the number of lines it
+ * holds (or has parsed, on error), which
+ * are numbered from after the lines_before
+ * already parsed
+ */
+int sixfive_parse_string(sixfive_ctx *ctx, const char *str, long len, int *lines){
+  int num = ctx->lines_before + 1;
+  const char *line = str;
+  const char *end = str + len;
+  const char *eol;
+  sixfive_line tokens;
+  int first, depth, status;
+
+#ifdef DEBUG_BUILD
+  sixfive_print_info(0, "Start parsing file.");
+#endif
+
+  for(;line < end;line=eol+1,num++){
+    eol = memchr(line, '\n', end - line);
+    if(eol == NULL){
+      eol = end;
+    }
+    sixfive_tokens_split(line, eol - line, ctx->wide, &tokens);
+    tokens.num = num;
+    if(tokens.directive != sixfive_directive_macro && tokens.directive != sixfive_directive_rept){
+      status = sixfive_parse_block(ctx, &tokens, 1, 0, NULL, 0);
+    } else {
+      first = ctx->bodies.count;
+      for(depth=0;;){
+        if(tokens.tokens > 0){
+          if(sixfive_tokens_reserve(ctx, &ctx->bodies, ctx->bodies.count+1) == sixfive_output_error){
+            *lines = num - ctx->lines_before;
+            return sixfive_output_error;
+          }
+          ctx->bodies.list[ctx->bodies.count++] = tokens;
+        }
+        depth += (tokens.directive == sixfive_directive_macro || tokens.directive == sixfive_directive_rept);
+        depth -= (tokens.directive == sixfive_directive_endm || tokens.directive == sixfive_directive_endr);
+        if(depth == 0 || eol == end){
+          break;
+        }
+        line = eol+1;
+        eol = memchr(line, '\n', end - line);
+        if(eol == NULL){
+          eol = end;
+        }
+        sixfive_tokens_split(line, eol - line, ctx->wide, &tokens);
+        tokens.num = ++num;
+      }
+      sixfive_tokens_match(ctx->bodies.list + first, ctx->bodies.count - first);
+      status = sixfive_parse_block(ctx, ctx->bodies.list + first, ctx->bodies.count - first, 0, NULL, 0);
+    }
+    if(status == sixfive_output_error){
+      *lines = num - ctx->lines_before;
+      return sixfive_output_error;
+    }
+  }
+  *lines = num-1 - ctx->lines_before;
+  ctx->stats.lines += *lines;
+  
+#ifdef DEBUG_BUILD
+  sixfive_print_info(0, "End parsing file.");
+#endif
+
+  return sixfive_output_success;
+}
+
+/*****************************/
+/* CONTEXTS                  */
+/*****************************/
+
+sixfive_ctx *sixfive_ctx_new(void){
+  sixfive_ctx *ctx = calloc(sizeof(sixfive_ctx), 1);
+
+  if(ctx != NULL){
+    ctx->threads = 1;
+    ctx->wide = sixfive_scan_wide();
+    ctx->symtab.names = &ctx->arena;
+    ctx->macro_names.names = &ctx->arena;
+  }
+  return ctx;
+}
+
+void sixfive_ctx_free(sixfive_ctx *ctx){
+  int i;
+
+  if(ctx == NULL){
+    return;
+  }
+  for(i=0;i<ctx->unit_capacity;i++){
+    sixfive_ctx_free(ctx->units[i].ctx);
+    free(ctx->units[i].globals);
+  }
+  free(ctx->units);
+  free(ctx->previous);
+  free(ctx->text);
+  for(i=0;i<ctx->held_count;i++){
+    sixfive_cache_release(ctx->held[i]);
+  }
+  free(ctx->held);
+  sixfive_cache_free(ctx->own_cache);
+  sixfive_symtab_free(&ctx->macro_names);
+  free(ctx->macros);
+  free(ctx->bodies.list);
+  sixfive_symtab_free(&ctx->symtab);
+  sixfive_arena_free(&ctx->arena);
+  free(ctx->fixups.list);
+  free(ctx->exprs.list);
+  free(ctx->shifts);
+  free(ctx->listed.list);
+  free(ctx->lines);
+  free(ctx->memory);
+  free(ctx->counts);
+  free(ctx->cycles);
+  free(ctx->profile);
+  free(ctx->image.data);
+  free(ctx->object_data.data);
+  free(ctx->disassembly.data);
+  free(ctx->marks);
+  free(ctx->links);
+  free(ctx->bases);
+  free(ctx->diagnostics);
+  free(ctx);
+}
+
+/*
+ * Sets how many threads may assemble a
+ * single large file at once
+ */
+void sixfive_ctx_set_threads(sixfive_ctx *ctx, int threads){
+  if(threads < 1){
+    threads = 1;
+  }
+  if(threads > MAX_THREADS){
+    threads = MAX_THREADS;
+  }
+  ctx->threads = threads;
+}
+
+/*
+ * Sets the directory which .incbin finds
+ * relative paths from, the current one by
+ * default (or if len is 0)
+ */
+int sixfive_ctx_set_directory(sixfive_ctx *ctx, const char *dir, int len){
+  if(len < 0 || len >= FILENAME_MAX){
+    return sixfive_output_error;
+  }
+  memcpy(ctx->directory, dir, len);
+  ctx->directory[len] = '\0';
+
+  return sixfive_output_success;
+}
+
+/*
+ * Sets the cache which .include reads its
+ * files from, or NULL for the context's own
+ */
+void sixfive_ctx_set_cache(sixfive_ctx *ctx, sixfive_cache *cache){
+  ctx->cache = cache;
+}
+
+/*
+ * Enables the optimizer, which a file
+ * being watched is assembled again from
+ * scratch to take up
+ */
+void sixfive_ctx_set_optimize(sixfive_ctx *ctx, int enabled){
+  if(ctx->optimize != (enabled != 0)){
+    ctx->watching = 0;
+  }
+  ctx->optimize = (enabled != 0);
+}
+
+/*
+ * Enables listing each line's output, which
+ * a file being watched is assembled again
+ * from scratch to take up
+ */
+void sixfive_ctx_set_listing(sixfive_ctx *ctx, int enabled){
+  if(ctx->listing != (enabled != 0)){
+    ctx->watching = 0;
+  }
+  ctx->listing = (enabled != 0);
+}
+
+/*
+ * Hands over the listing of the last
+ * assembly, empty unless it succeeded
+ * with listing enabled
+ */
+void sixfive_ctx_listing(sixfive_ctx *ctx, sixfive_listing *listing){
+  listing->list = ctx->lines;
+  listing->count = ctx->line_count;
+}
+
+/*
+ * Enables writing the output as an object
+ * instead, which files are assembled into
+ * on a single thread, from scratch
+ */
+void sixfive_ctx_set_object(sixfive_ctx *ctx, int enabled){
+  if(ctx->object != (enabled != 0)){
+    ctx->watching = 0;
+  }
+  ctx->object = (enabled != 0);
+}
+
+/*
+ * Hands over the object written by the last
+ * assembly, empty unless it succeeded with
+ * objects enabled
+ */
+void sixfive_ctx_object(sixfive_ctx *ctx, sixfive_object *object){
+  object->data = ctx->object_data.data;
+  object->length = ctx->object_data.length;
+  object->name = NULL;
+}
+
+/*
+ * Sums the cycles of every listed line from
+ * one label up to (but not including) another
+ */
+int sixfive_ctx_cycles(sixfive_ctx *ctx, const char *from, const char *to, long *min, long *max){
+  sixfive_label *labels = ctx->symtab.labels;
+  int start, stop, i;
+
+  if(!ctx->listing){
+    return sixfive_output_error;
+  }
+  start = sixfive_label_find(ctx, from, strlen(from), ADDRESS_UNKNOWN);
+  stop = sixfive_label_find(ctx, to, strlen(to), ADDRESS_UNKNOWN);
+  if(start == sixfive_output_error || stop == sixfive_output_error ||
+     labels[start].address == ADDRESS_UNKNOWN || labels[stop].address == ADDRESS_UNKNOWN ||
+     labels[stop].address < labels[start].address){
+    return sixfive_output_error;
+  }
+
+  *min = *max = 0;
+  for(i=0;i<ctx->line_count;i++){
+    if(ctx->lines[i].address >= labels[start].address && ctx->lines[i].address < labels[stop].address){
+      *min += ctx->lines[i].cycles;
+      *max += ctx->lines[i].cycles_max;
+    }
+  }
+
+  return sixfive_output_success;
+}
+
+/*
+ * Returns the address of the first byte
+ * of the last assembly's output
+ */
+long sixfive_ctx_origin(sixfive_ctx *ctx){
+  return ctx->origin;
+}
+
+/*
+ * Zeroes the stats for the next assembly
+ */
+void sixfive_ctx_reset_stats(sixfive_ctx *ctx){
+  memset(&ctx->stats, 0, sizeof(sixfive_stats));
+  ctx->symtab.lookups = 0;
+  ctx->symtab.probes = 0;
+  ctx->symtab.probe_max = 0;
+  ctx->symtab.allocations = 0;
+  ctx->arena.allocations = 0;
+}
+
+/*
+ * Empties the context for the next file,
+ * keeping all of its memory
+ */
+void sixfive_ctx_reset(sixfive_ctx *ctx){
+  int i;
+
+  for(i=0;i<ctx->held_count;i++){
+    sixfive_cache_release(ctx->held[i]);
+  }
+  ctx->held_count = 0;
+  sixfive_symtab_clear(&ctx->macro_names);
+  ctx->macro_count = 0;
+  ctx->bodies.count = 0;
+  ctx->expansions = 0;
+  sixfive_symtab_clear(&ctx->symtab);
+  sixfive_arena_reset(&ctx->arena);
+  ctx->fixups.count = 0;
+  ctx->exprs.count = 0;
+  ctx->image.length = 0;
+  ctx->object_data.length = 0;
+  ctx->disassembly.length = 0;
+  ctx->base_count = 0;
+  ctx->diagnostic_count = 0;
+  ctx->origin = 0;
+  ctx->placed = 0;
+  ctx->fixed = 0;
+  ctx->external = 0;
+  ctx->relaxable = 0;
+  ctx->source = NULL;
+  ctx->source_length = 0;
+  ctx->lines_before = 0;
+  ctx->listed.count = 0;
+  ctx->line_count = 0;
+  ctx->profile_count = 0;
+  sixfive_ctx_reset_stats(ctx);
+}
+
+/*
+ * Enables timing of each phase
+ */
+void sixfive_ctx_set_stats(sixfive_ctx *ctx, int enabled){
+  ctx->timing = enabled;
+}
+
+/*
+ * Returns a time in milliseconds, to be
+ * compared with another, or 0 if the
+ * context is not timing its phases
+ */
+double sixfive_clock(sixfive_ctx *ctx){
+#ifdef SIXFIVE_CLOCK
+  struct timespec now;
+#endif
+
+  if(!ctx->timing){
+    return 0;
+  }
+#ifdef SIXFIVE_CLOCK
+  clock_gettime(CLOCK_MONOTONIC, &now);
+  return now.tv_sec*1000.0 + now.tv_nsec/1000000.0;
+#else
+  return clock()*1000.0/CLOCKS_PER_SEC;
+#endif
+}
+
+/*
+ * Adds the counts of another context's
+ * work (or of this one's own symbol
+ * table and arena) to the context's stats
+ */
+void sixfive_stats_add(sixfive_stats *stats, sixfive_ctx *from){
+  stats->lines += from->stats.lines;
+  stats->tokens += from->stats.tokens;
+  stats->allocations += from->stats.allocations + from->symtab.allocations + from->arena.allocations;
+  stats->label_lookups += from->stats.label_lookups + from->symtab.lookups;
+  stats->label_probes += from->stats.label_probes + from->symtab.probes;
+  stats->fixups += from->stats.fixups;
+  stats->bytes += from->stats.bytes;
+  stats->relax_passes += from->stats.relax_passes;
+  stats->relax_saved += from->stats.relax_saved;
+  stats->optimize_bytes += from->stats.optimize_bytes;
+  stats->optimize_cycles += from->stats.optimize_cycles;
+  if(from->stats.label_probe_max > stats->label_probe_max){
+    stats->label_probe_max = from->stats.label_probe_max;
+  }
+  if(from->symtab.probe_max > stats->label_probe_max){
+    stats->label_probe_max = from->symtab.probe_max;
+  }
+}
+
+/*
+ * Copies out the stats of the context's
+ * last assembly
+ */
+void sixfive_ctx_stats(sixfive_ctx *ctx, sixfive_stats *stats){
+  memset(stats, 0, sizeof(sixfive_stats));
+  stats->parse_ms = ctx->stats.parse_ms;
+  stats->layout_ms = ctx->stats.layout_ms;
+  stats->link_ms = ctx->stats.link_ms;
+  stats->total_ms = ctx->stats.total_ms;
+  sixfive_stats_add(stats, ctx);
+}
+
+/*****************************/
+/* UNITS                     */
+/*****************************/
+
+/*
+ * Replaces count units, starting at the
+ * first given, with runs of whole lines of
+ * src of at least target bytes each, which
+ * are left dirty
+ *
+ * Returns the number of units added.
+ */
+int sixfive_unit_replace(sixfive_ctx *ctx, int first, int count, const char *src, long len, long target){
+  sixfive_unit *units, *unit;
+  const char *start, *end = src + len, *cut;
+  int added = 0, total, tail, i;
+
+  for(start=src;start<end;added++){
+    cut = (end - start > target ? start + target : end);
+    cut = (cut < end ? memchr(cut, '\n', end - cut) : NULL);
+    start = (cut == NULL ? end : cut+1);
+  }
+
+  total = ctx->unit_count - count + added;
+  tail = ctx->unit_count - (first + count);
+  if(total > ctx->unit_capacity){
+    units = realloc(ctx->units, sizeof(sixfive_unit)*total);
+    if(units == NULL){
+      return sixfive_output_error;
+    }
+    ctx->stats.allocations++;
+    memset(units + ctx->unit_capacity, 0, sizeof(sixfive_unit)*(total - ctx->unit_capacity));
+    ctx->units = units;
+    ctx->unit_capacity = total;
+  }
+
+  /* Units about to be overwritten are freed, the rest reused */
+  if(added < count){
+    for(i=first+added;i<first+count;i++){
+      sixfive_ctx_free(ctx->units[i].ctx);
+      free(ctx->units[i].globals);
+    }
+    memmove(ctx->units + first + added, ctx->units + first + count, sizeof(sixfive_unit)*tail);
+    memset(ctx->units + total, 0, sizeof(sixfive_unit)*(count - added));
+  } else if(added > count){
+    for(i=ctx->unit_count;i<total;i++){
+      sixfive_ctx_free(ctx->units[i].ctx);
+      free(ctx->units[i].globals);
+    }
+    memmove(ctx->units + first + added, ctx->units + first + count, sizeof(sixfive_unit)*tail);
+    memset(ctx->units + first + count, 0, sizeof(sixfive_unit)*(added - count));
+  }
+  ctx->unit_count = total;
+
+  for(i=first,start=src;start<end;i++){
+    cut = (end - start > target ? start + target : end);
+    cut = (cut < end ? memchr(cut, '\n', end - cut) : NULL);
+    unit = &ctx->units[i];
+    unit->src = start;
+    unit->length = (cut == NULL ? end : cut+1) - start;
+    unit->dirty = 1;
+    unit->linked = 0;
+    start += unit->length;
+  }
+
+  return added;
+}
+
+/*
+ * Returns whether the source may use .include,
+ * .macro or .rept, whose lines cannot be split
+ * into units (comments included, to be safe)
+ */
+int sixfive_source_expands(const char *src, long len){
+  const char *c = src, *end = src + len, *word;
+  int type;
+
+  while((c = memchr(c, '.', end - c)) != NULL){
+    for(word=++c;c < end && isalpha((unsigned char)*c);c++);
+    type = sixfive_directive_type(word, c - word);
+    if(type == sixfive_directive_include || type == sixfive_directive_macro || type == sixfive_directive_rept){
+      return 1;
+    }
+  }
+
+  return 0;
+}
+
+/*
+ * Splits the file into units at line
+ * boundaries, a few per thread so that
+ * uneven units still balance out
+ */
+int sixfive_unit_split(sixfive_ctx *ctx, const char *src, long len){
+  int count = ctx->threads * UNITS_PER_THREAD;
+
+  if(len / count < UNIT_MIN_LENGTH){
+    count = len / UNIT_MIN_LENGTH;
+  }
+  if(count < 2){
+    return 1;
+  }
+
+  return sixfive_unit_replace(ctx, 0, ctx->unit_count, src, len, len / count);
+}
+
+/*
+ * Returns the unit holding the given
+ * offset of the source, or the last unit
+ * if it is past the end
+ */
+int sixfive_unit_at(sixfive_ctx *ctx, long offset){
+  const char *at = ctx->text + offset;
+  int lo = 0, hi = ctx->unit_count-1, mid;
+
+  while(lo < hi){
+    mid = (lo + hi + 1) / 2;
+    if(ctx->units[mid].src <= at){
+      lo = mid;
+    } else {
+      hi = mid-1;
+    }
+  }
+
+  return lo;
+}
+
+/*
+ * Parses a unit on its own, as though it
+ * were a file starting at the unit's address
+ * (assumed to be 0 until it is laid out)
+ */
+void sixfive_unit_parse(sixfive_ctx *ctx, sixfive_unit *unit){
+  if(unit->ctx == NULL && (unit->ctx = sixfive_ctx_new()) == NULL){
+    unit->status = sixfive_output_error;
+    unit->lines = 0;
+    return;
+  }
+  sixfive_ctx_reset(unit->ctx);
+  strcpy(unit->ctx->directory, ctx->directory);
+  unit->ctx->optimize = ctx->optimize;
+  unit->ctx->listing = ctx->listing;
+  unit->ctx->source = ctx->source;
+  unit->ctx->source_length = ctx->source_length;
+  unit->ctx->origin = unit->address;
+  unit->ctx->placed = unit->placed;
+  unit->linked = 0;
+  unit->status = sixfive_parse_string(unit->ctx, unit->src, unit->length, &unit->lines);
+}
+
+/*
+ * Copies a unit into place in the file's
+ * image and patches its fixups, using the
+ * labels of the whole file
+ *
+ * A unit already in place only has the
+ * fixups of labels that moved patched.
+ * Like sixfive_parse_labels, stops at the
+ * first unrecognized label.
+ */
+void sixfive_unit_link(sixfive_ctx *ctx, sixfive_unit *unit){
+  unsigned char *data = ctx->image.data + unit->base;
+  sixfive_fixup *fixup = unit->ctx->fixups.list;
+  sixfive_fixup *end = fixup + unit->ctx->fixups.count;
+  long value;
+  int index, status;
+
+  if(!unit->linked){
+    memcpy(data, unit->ctx->image.data, unit->ctx->image.length);
+  }
+  /*
+   * Until relaxed, addresses may yet move, and with them whether
+   * an expression fits, so sixfive_unit_relax patches them all
+   */
+  if(ctx->relaxable > 0){
+    return;
+  }
+
+  for(;fixup<end;fixup++){
+    if(fixup->relax == sixfive_relax_org){
+      continue;
+    }
+    /* Expressions are worked out again, as whatever they use may have moved */
+    if(fixup->expr == -1){
+      index = unit->globals[fixup->label];
+      if(unit->linked && index < ctx->previous_count && ctx->symtab.labels[index].address == ctx->previous[index]){
+        continue;
+      }
+    }
+    status = sixfive_fixup_value(fixup, unit->ctx->exprs.list, ctx->symtab.labels, unit->globals, NULL,
+                                 ctx->origin + unit->base + fixup->offset + fixup->here, &value);
+    if(status != sixfive_output_success){
+      sixfive_fixup_error(unit->ctx, fixup, ctx->symtab.labels, status, value);
+      unit->status = sixfive_output_error;
+      unit->linked = 0;
+      return;
+    }
+    /* Left to sixfive_unit_relax */
+    if(fixup->relax != sixfive_relax_none){
+      continue;
+    }
+    if(sixfive_fixup_patch(unit->ctx, data, fixup, value) == sixfive_output_error){
+      unit->status = sixfive_output_error;
+      unit->linked = 0;
+      return;
+    }
+  }
+  unit->linked = 1;
+}
+
+/*
+ * Takes units in turn until none are left,
+ * either parsing or linking them
+ */
+void *sixfive_unit_worker(void *arg){
+  sixfive_ctx *ctx = arg;
+  int next;
+
+  for(;;){
+#ifdef SIXFIVE_THREADS
+    pthread_mutex_lock(&ctx->lock);
+#endif
+    next = ctx->next_unit++;
+#ifdef SIXFIVE_THREADS
+    pthread_mutex_unlock(&ctx->lock);
+#endif
+    if(next >= ctx->unit_count){
+      break;
+    }
+
+    if(!ctx->linking){
+      if(ctx->units[next].dirty){
+        sixfive_unit_parse(ctx, &ctx->units[next]);
+      }
+    } else if(ctx->units[next].status != sixfive_output_error){
+      sixfive_unit_link(ctx, &ctx->units[next]);
+    }
+  }
+
+  return NULL;
+}
+
+/*
+ * Runs sixfive_unit_worker over every unit
+ * on the context's threads, this one included
+ */
+void sixfive_unit_run(sixfive_ctx *ctx){
+#ifdef SIXFIVE_THREADS
+  pthread_t pool[MAX_THREADS];
+  int i, started = 0;
+#endif
+
+  ctx->next_unit = 0;
+
+#ifdef SIXFIVE_THREADS
+  pthread_mutex_init(&ctx->lock, NULL);
+  for(i=1;i<ctx->threads && i<ctx->unit_count;i++){
+    if(pthread_create(&pool[started], NULL, sixfive_unit_worker, ctx) == 0){
+      started++;
+    }
+  }
+#endif
+
+  sixfive_unit_worker(ctx);
+
+#ifdef SIXFIVE_THREADS
+  for(i=0;i<started;i++){
+    pthread_join(pool[i], NULL);
+  }
+  pthread_mutex_destroy(&ctx->lock);
+#endif
+}
+
+/*
+ * Copies the first error of the earliest
+ * failing unit into the file's context,
+ * with its line number made absolute
+ */
+int sixfive_unit_error(sixfive_ctx *ctx){
+  sixfive_unit *unit;
+  int i, line = 1;
+
+  for(i=0;i<ctx->unit_count;i++){
+    unit = &ctx->units[i];
+    if(unit->status == sixfive_output_error){
+      if(unit->ctx != NULL && unit->ctx->diagnostic_count > 0){
+        sixfive_diagnostic_add(ctx, unit->ctx->diagnostics[0].line + (unit->ctx->diagnostics[0].line > 0 ? line-1 : 0), "%s", unit->ctx->diagnostics[0].message);
+      }
+      return sixfive_output_error;
+    }
+    line += unit->lines;
+  }
+
+  return sixfive_output_success;
+}
+
+/*
+ * Relaxes a file split into units, which
+ * were linked with every instruction that
+ * may be shortened at its longest, by
+ * gathering the fixups of every unit into
+ * the file's own, then relaxing and linking
+ * them all at once
+ *
+ * This rewrites the whole image, so every
+ * unit is copied into it again next time.
+ */
+int sixfive_unit_relax(sixfive_ctx *ctx){
+  sixfive_unit *unit;
+  sixfive_fixup *fixup, *end;
+  sixfive_expr_op *op, *ops;
+  int i, relaxable = 0, count = 0, exprs = 0, lines = 0;
+
+  for(i=0;i<ctx->unit_count;i++){
+    relaxable += ctx->units[i].ctx->relaxable;
+    count += ctx->units[i].ctx->fixups.count;
+    exprs += ctx->units[i].ctx->exprs.count;
+  }
+  if(relaxable == 0){
+    return sixfive_output_success;
+  }
+  if(sixfive_fixup_reserve(ctx, count) == sixfive_output_error ||
+     sixfive_expr_reserve(ctx, exprs) == sixfive_output_error){
+    return sixfive_output_error;
+  }
+
+  ctx->fixups.count = 0;
+  ctx->exprs.count = 0;
+  for(i=0;i<ctx->unit_count;i++){
+    unit = &ctx->units[i];
+    ops = ctx->exprs.list + ctx->exprs.count;
+    if(unit->ctx->exprs.count > 0){
+      memcpy(ops, unit->ctx->exprs.list, sizeof(sixfive_expr_op)*unit->ctx->exprs.count);
+    }
+    for(op=ops;op<ops+unit->ctx->exprs.count;op++){
+      if(op->op == sixfive_expr_label){
+        op->value = unit->globals[op->value];
+      }
+    }
+    fixup = ctx->fixups.list + ctx->fixups.count;
+    memcpy(fixup, unit->ctx->fixups.list, sizeof(sixfive_fixup)*unit->ctx->fixups.count);
+    ctx->fixups.count += unit->ctx->fixups.count;
+    for(end=ctx->fixups.list+ctx->fixups.count;fixup<end;fixup++){
+      fixup->offset += unit->base;
+      fixup->line += lines;
+      if(fixup->label != -1){
+        fixup->label = unit->globals[fixup->label];
+      }
+      if(fixup->expr != -1){
+        fixup->expr += ops - ctx->exprs.list;
+      }
+    }
+    ctx->exprs.count += unit->ctx->exprs.count;
+    lines += unit->lines;
+    unit->linked = 0;
+  }
+  ctx->relaxable = relaxable;
+
+  if(sixfive_relax(ctx) == sixfive_output_error){
+    return sixfive_output_error;
+  }
+  return sixfive_parse_labels(ctx);
+}
+
+/*
+ * Gathers the listed lines of every unit
+ * into the file's, in order, as though it
+ * had been parsed in one piece
+ */
+int sixfive_unit_listing(sixfive_ctx *ctx){
+  sixfive_unit *unit;
+  sixfive_listed *listed, *end;
+  int i, count = 0, marks = 0, lines = 0;
+
+  for(i=0;i<ctx->unit_count;i++){
+    count += ctx->units[i].ctx->listed.count;
+  }
+  if(sixfive_listing_reserve(ctx, count) == sixfive_output_error){
+    return sixfive_output_error;
+  }
+
+  ctx->listed.count = 0;
+  for(i=0;i<ctx->unit_count;i++){
+    unit = &ctx->units[i];
+    listed = ctx->listed.list + ctx->listed.count;
+    memcpy(listed, unit->ctx->listed.list, sizeof(sixfive_listed)*unit->ctx->listed.count);
+    ctx->listed.count += unit->ctx->listed.count;
+    for(end=ctx->listed.list+ctx->listed.count;listed<end;listed++){
+      listed->offset += unit->base;
+      listed->line += lines;
+      listed->mark += marks;
+    }
+    lines += unit->lines;
+    marks += unit->ctx->fixups.count;
+  }
+
+  return sixfive_output_success;
+}
+
+/*
+ * Gives each unit its address, where the one
+ * before it ends, and merges their labels in
+ * order, so that later definitions win as
+ * they would in a single pass
+ *
+ * Units holding a .org depend on where they
+ * start, so are parsed again (here, in order)
+ * if they were parsed assuming another start,
+ * as are failed units, which may only have
+ * failed for it.  The rest are moved as they
+ * are, and layout stops at the first failure.
+ *
+ * Units which moved must be linked again, and
+ * the address every label had before is kept
+ * so that those which did not need only have
+ * the fixups of labels which moved patched.
+ */
+int sixfive_unit_layout(sixfive_ctx *ctx){
+  sixfive_symtab *symtab = &ctx->symtab;
+  sixfive_unit *unit;
+  sixfive_label *label;
+  uint16_t *previous;
+  long address = 0, origin = -1, shift, start;
+  int placed = 0, marks = 0;
+  int i, j, *globals;
+
+  if(symtab->count > ctx->previous_capacity){
+    previous = realloc(ctx->previous, sizeof(uint16_t)*symtab->capacity);
+    if(previous == NULL){
+      return sixfive_output_error;
+    }
+    ctx->stats.allocations++;
+    ctx->previous = previous;
+    ctx->previous_capacity = symtab->capacity;
+  }
+  for(i=0;i<symtab->count;i++){
+    ctx->previous[i] = symtab->labels[i].address;
+    symtab->labels[i].address = ADDRESS_UNKNOWN;
+  }
+  ctx->previous_count = symtab->count;
+
+  for(i=0;i<ctx->unit_count;i++){
+    unit = &ctx->units[i];
+    if((unit->status == sixfive_output_error || unit->ctx->fixed) && (unit->address != address || unit->placed != placed)){
+      unit->address = address;
+      unit->placed = placed;
+      unit->dirty = 1;
+      sixfive_unit_parse(ctx, unit);
+      sixfive_stats_add(&ctx->stats, unit->ctx);
+    }
+    if(unit->status == sixfive_output_error){
+      break;
+    }
+
+    /* Where the unit was parsed to start, and where it does */
+    shift = address - unit->address;
+    start = unit->ctx->origin + shift;
+    if(!placed && unit->ctx->image.length > 0){
+      origin = start;
+      placed = 1;
+    }
+    if(placed && unit->base != start - origin){
+      unit->base = start - origin;
+      unit->linked = 0;
+    }
+    address = start + unit->ctx->image.length;
+
+    /* Labels of units parsed before are already in the table */
+    if(!unit->dirty){
+      for(j=0;j<unit->ctx->symtab.count;j++){
+        label = &unit->ctx->symtab.labels[j];
+        if(label->address != ADDRESS_UNKNOWN){
+          symtab->labels[unit->globals[j]].address = label->address + shift;
+          symtab->labels[unit->globals[j]].mark = label->mark + marks;
+        }
+      }
+      marks += unit->ctx->fixups.count;
+      continue;
+    }
+
+    if(unit->ctx->symtab.count > unit->globals_capacity){
+      globals = realloc(unit->globals, sizeof(int)*unit->ctx->symtab.count);
+      if(globals == NULL){
+        break;
+      }
+      ctx->stats.allocations++;
+      unit->globals = globals;
+      unit->globals_capacity = unit->ctx->symtab.count;
+    }
+
+    for(j=0;j<unit->ctx->symtab.count;j++){
+      label = &unit->ctx->symtab.labels[j];
+      unit->globals[j] = sixfive_symtab_find(symtab, label->string, strlen(label->string), label->hash,
+        (label->address == ADDRESS_UNKNOWN ? ADDRESS_UNKNOWN : label->address + shift));
+      if(unit->globals[j] == sixfive_output_error){
+        break;
+      }
+      if(label->address != ADDRESS_UNKNOWN){
+        symtab->labels[unit->globals[j]].mark = label->mark + marks;
+      }
+    }
+    if(j < unit->ctx->symtab.count){
+      break;
+    }
+    marks += unit->ctx->fixups.count;
+    unit->dirty = 0;
+  }
+
+  /* With nothing placed, the output is empty wherever it starts */
+  ctx->origin = (placed ? origin : address);
+  if(i < ctx->unit_count || sixfive_image_reserve(ctx, address - ctx->origin) == sixfive_output_error){
+    for(i=0;i<ctx->unit_count;i++){
+      ctx->units[i].linked = 0;
+    }
+    return sixfive_output_error;
+  }
+  ctx->image.length = address - ctx->origin;
+
+  return sixfive_output_success;
+}
+
+/*
+ * Assembles a file split into units, on
+ * several threads:
+ *   1. Parses every dirty unit at once, each
+ *      one starting where it last did
+ *   2. Lays the units out, see above
+ *   3. Copies and links every unit at once,
+ *      then relaxes them together
+ *
+ * Labels may be narrowed to the zero page
+ * and branches relaxed, so sizes do depend
+ * on labels, but each unit leaves whatever
+ * may be shortened at its longest until all
+ * of them are linked and relaxed together.
+ * That settles on the same shortest forms
+ * as sixfive_parse_string, so the output
+ * is identical to it.
+ */
+int sixfive_parse_units(sixfive_ctx *ctx){
+  double start = sixfive_clock(ctx);
+  int i, out;
+
+  /*
+   * Failed units are parsed again, to report their errors
+   * afresh, as are those which include other files
+   */
+  for(i=0;i<ctx->unit_count;i++){
+    if(ctx->units[i].status == sixfive_output_error || (ctx->units[i].ctx != NULL && ctx->units[i].ctx->external)){
+      ctx->units[i].dirty = 1;
+      ctx->units[i].linked = 0;
+    }
+  }
+
+  ctx->linking = 0;
+  sixfive_unit_run(ctx);
+  for(i=0;i<ctx->unit_count;i++){
+    if(ctx->units[i].dirty && ctx->units[i].ctx != NULL){
+      sixfive_stats_add(&ctx->stats, ctx->units[i].ctx);
+    }
+  }
+  ctx->stats.parse_ms += sixfive_clock(ctx) - start;
+
+  start = sixfive_clock(ctx);
+  if(sixfive_unit_layout(ctx) == sixfive_output_error){
+    sixfive_unit_error(ctx);
+    return sixfive_output_error;
+  }
+  ctx->stats.layout_ms += sixfive_clock(ctx) - start;
+
+  start = sixfive_clock(ctx);
+  ctx->relaxable = 0;
+  for(i=0;i<ctx->unit_count;i++){
+    ctx->relaxable += (ctx->units[i].ctx != NULL ? ctx->units[i].ctx->relaxable : 0);
+  }
+  ctx->linking = 1;
+  sixfive_unit_run(ctx);
+  out = sixfive_unit_error(ctx);
+  if(out != sixfive_output_error && ctx->listing){
+    out = sixfive_unit_listing(ctx);
+  }
+  if(out != sixfive_output_error){
+    out = sixfive_unit_relax(ctx);
+  }
+  ctx->stats.link_ms += sixfive_clock(ctx) - start;
+
+  return out;
+}
+
+/*
+ * Splits the changed part of a source being
+ * watched into new units, keeping the units
+ * before and after it (and all their work)
+ *
+ * The changed part runs from the first byte
+ * which differs to the last, widened to the
+ * units holding them (and, when optimizing,
+ * one more unit either side).
+ */
+int sixfive_unit_update(sixfive_ctx *ctx, const char *src, long len){
+  long same = (len < ctx->text_length ? len : ctx->text_length);
+  long prefix = 0, suffix = 0, start = 0, stop = 0;
+  char *text;
+  int first = 0, count = 0, i;
+
+  /* Whole blocks are compared first, as edits are usually small */
+  while(prefix + WATCH_COMPARE_LENGTH <= same && memcmp(ctx->text + prefix, src + prefix, WATCH_COMPARE_LENGTH) == 0){
+    prefix += WATCH_COMPARE_LENGTH;
+  }
+  while(prefix < same && ctx->text[prefix] == src[prefix]){
+    prefix++;
+  }
+  while(suffix + WATCH_COMPARE_LENGTH <= same - prefix &&
+        memcmp(ctx->text + ctx->text_length - suffix - WATCH_COMPARE_LENGTH, src + len - suffix - WATCH_COMPARE_LENGTH, WATCH_COMPARE_LENGTH) == 0){
+    suffix += WATCH_COMPARE_LENGTH;
+  }
+  while(suffix < same - prefix && ctx->text[ctx->text_length-1-suffix] == src[len-1-suffix]){
+    suffix++;
+  }
+  if(prefix == len && len == ctx->text_length){
+    return sixfive_output_success;
+  }
+
+  /* Widened this way, both ends fall on unchanged line boundaries */
+  if(ctx->unit_count > 0){
+    first = sixfive_unit_at(ctx, prefix);
+    count = sixfive_unit_at(ctx, ctx->text_length - suffix) - first + 1;
+    /* The optimizer looks across the line on either side of each unit */
+    if(ctx->optimize){
+      if(first > 0){
+        first--;
+        count++;
+      }
+      if(first + count < ctx->unit_count){
+        count++;
+      }
+    }
+    start = ctx->units[first].src - ctx->text;
+    stop = ctx->units[first+count-1].src + ctx->units[first+count-1].length - ctx->text;
+  }
+
+  if(len > ctx->text_capacity){
+    text = realloc(ctx->text, len);
+    if(text == NULL){
+      return sixfive_output_error;
+    }
+    ctx->stats.allocations++;
+    ctx->text = text;
+    ctx->text_capacity = len;
+  }
+  /* Only the changed part is copied, the rest moved if need be */
+  memmove(ctx->text + stop + len - ctx->text_length, ctx->text + stop, ctx->text_length - stop);
+  stop += len - ctx->text_length;
+  memcpy(ctx->text + start, src + start, stop - start);
+  ctx->text_length = len;
+
+  if(sixfive_unit_replace(ctx, first, count, ctx->text + start, stop - start, WATCH_UNIT_LENGTH) == sixfive_output_error){
+    return sixfive_output_error;
+  }
+
+  /* The text may have moved, and the units after the change with it */
+  for(i=0,start=0;i<ctx->unit_count;i++){
+    ctx->units[i].src = ctx->text + start;
+    start += ctx->units[i].length;
+  }
+
+  return sixfive_output_success;
+}
+
+/*****************************/
+/* OBJECTS                   */
+/*****************************/
+
+/*
+ * Appends len bytes to the object being
+ * written
+ */
+int sixfive_object_emit(sixfive_ctx *ctx, const void *bytes, long len){
+  sixfive_image *object = &ctx->object_data;
+  unsigned char *data;
+  long capacity = object->capacity;
+
+  if(object->length + len > capacity){
+    if(capacity == 0){
+      capacity = OUTPUT_INITIAL_LENGTH;
+    }
+    while(capacity < object->length + len){
+      capacity *= 2;
+    }
+    data = realloc(object->data, capacity);
+    if(data == NULL){
+      return sixfive_output_error;
+    }
+    ctx->stats.allocations++;
+    object->data = data;
+    object->capacity = capacity;
+  }
+
+  /* An empty image has no data to copy from */
+  if(len > 0){
+    memcpy(object->data + object->length, bytes, len);
+  }
+  object->length += len;
+  return sixfive_output_success;
+}
+
+/*
+ * Appends a number to the object being
+ * written, as the given number of bytes,
+ * little-endian (and negative numbers
+ * in two's complement)
+ */
+int sixfive_object_put(sixfive_ctx *ctx, long value, int bytes){
+  unsigned char out[4];
+  int i;
+
+  for(i=0;i<bytes;i++){
+    out[i] = ((unsigned long)value >> (8*i)) & 0xff;
+  }
+
+  return sixfive_object_emit(ctx, out, bytes);
+}
+
+/*
+ * Whether a label may be left for the
+ * linker, adding a diagnostic to ctx if
+ * it is neither defined nor imported
+ */
+int sixfive_object_resolves(sixfive_ctx *ctx, const sixfive_fixup *fixup, int index){
+  const sixfive_label *label = &ctx->symtab.labels[index];
+
+  if(label->address == ADDRESS_UNKNOWN && !(label->flags & sixfive_symbol_import)){
+    sixfive_fixup_error(ctx, fixup, ctx->symtab.labels, sixfive_output_none, index);
+    return 0;
+  }
+
+  return 1;
+}
+
+/*
+ * Returns how many operations a fixup's
+ * relocation takes, its end included (a
+ * lone label being one)
+ */
+long sixfive_object_ops(sixfive_ctx *ctx, const sixfive_fixup *fixup){
+  const sixfive_expr_op *op;
+
+  if(fixup->expr == -1){
+    return 2;
+  }
+  for(op=ctx->exprs.list+fixup->expr;op->op != sixfive_expr_end;op++);
+
+  return op - (ctx->exprs.list+fixup->expr) + 1;
+}
+
+/*
+ * Checks, before an object is relaxed, that
+ * every label it uses is either defined or
+ * imported, and that those it exports are
+ * defined
+ */
+int sixfive_object_check(sixfive_ctx *ctx){
+  const sixfive_label *label;
+  const sixfive_expr_op *op;
+  sixfive_fixup *fixup = ctx->fixups.list;
+  sixfive_fixup *end = ctx->fixups.list + ctx->fixups.count;
+  int i;
+
+  for(i=0;i<ctx->symtab.count;i++){
+    label = &ctx->symtab.labels[i];
+    if(label->address == ADDRESS_UNKNOWN && (label->flags & sixfive_symbol_export) && !(label->flags & sixfive_symbol_import)){
+      sixfive_diagnostic_add(ctx, 0, "label \"%.64s\" is exported, but never defined.", label->string);
+      return sixfive_output_error;
+    }
+    if(label->address != ADDRESS_UNKNOWN && (label->flags & sixfive_symbol_import)){
+      sixfive_diagnostic_add(ctx, 0, "label \"%.64s\" is imported, but also defined.", label->string);
+      return sixfive_output_error;
+    }
+  }
+
+  for(;fixup<end;fixup++){
+    if(fixup->relax == sixfive_relax_org){
+      continue;
+    }
+    if(fixup->expr == -1 && !sixfive_object_resolves(ctx, fixup, fixup->label)){
+      return sixfive_output_error;
+    }
+    for(op=(fixup->expr == -1 ? NULL : ctx->exprs.list + fixup->expr);op != NULL && op->op != sixfive_expr_end;op++){
+      if(op->op == sixfive_expr_label && !sixfive_object_resolves(ctx, fixup, op->value)){
+        return sixfive_output_error;
+      }
+    }
+  }
+
+  return sixfive_output_success;
+}
+
+/*
+ * Writes the relaxed output into an object,
+ * patching what is already known, leaving
+ * the rest to the linker
+ *
+ * An object is a header ("SIX5", its version,
+ * and how many sections, symbols, relocations,
+ * and operations it holds) followed by each
+ * of those, with every number little-endian:
+ *
+ *   section:    flags (2), origin (2), length (4),
+ *               and its bytes
+ *   symbol:     kind (1), section (2), offset
+ *               (2), name length (2), and name
+ *   relocation: section (2), offset (4), here (4),
+ *               width (1), line (4), and the
+ *               index of its first operation (4)
+ *   operation:  type (1) and value (4)
+ *
+ * Each relocation patches an expression, as
+ * compiled (where labels are symbols, by
+ * index, and * is the address here bytes
+ * from its offset), and each symbol is at an
+ * offset into its section.  The output is a
+ * single section, absolute if it starts with
+ * a .org, and every label a symbol.
+ */
+int sixfive_object_write(sixfive_ctx *ctx){
+  sixfive_fixup *fixup, *end = ctx->fixups.list + ctx->fixups.count;
+  const sixfive_label *label;
+  const sixfive_expr_op *op;
+  long value, relocations = 0, ops = 0;
+  int i, status = sixfive_output_none, kind, out = sixfive_output_success;
+
+  /* An absolute object's own labels are already known */
+  for(fixup=ctx->fixups.list;fixup<end;fixup++){
+    if(fixup->relax == sixfive_relax_org || fixup->width == 0){
+      continue;
+    }
+    if(ctx->fixed){
+      status = sixfive_fixup_value(fixup, ctx->exprs.list, ctx->symtab.labels, NULL, NULL,
+                                   ctx->origin + fixup->offset + fixup->here, &value);
+      if(status == sixfive_output_error){
+        sixfive_fixup_error(ctx, fixup, ctx->symtab.labels, status, value);
+        return sixfive_output_error;
+      }
+      if(status == sixfive_output_success){
+        if(sixfive_fixup_patch(ctx, ctx->image.data, fixup, value) == sixfive_output_error){
+          return sixfive_output_error;
+        }
+        /* Complete, as a relaxed branch is */
+        fixup->width = 0;
+        continue;
+      }
+    }
+    relocations++;
+    ops += sixfive_object_ops(ctx, fixup);
+  }
+
+  ctx->object_data.length = 0;
+  out |= sixfive_object_emit(ctx, "SIX5", 4);
+  out |= sixfive_object_put(ctx, OBJECT_VERSION, 2);
+  out |= sixfive_object_put(ctx, 1, 2);
+  out |= sixfive_object_put(ctx, ctx->symtab.count, 4);
+  out |= sixfive_object_put(ctx, relocations, 4);
+  out |= sixfive_object_put(ctx, ops, 4);
+
+  out |= sixfive_object_put(ctx, (ctx->fixed ? sixfive_section_absolute : sixfive_section_relocatable), 2);
+  out |= sixfive_object_put(ctx, ctx->origin, 2);
+  out |= sixfive_object_put(ctx, ctx->image.length, 4);
+  out |= sixfive_object_emit(ctx, ctx->image.data, ctx->image.length);
+
+  for(i=0;i<ctx->symtab.count;i++){
+    label = &ctx->symtab.labels[i];
+    kind = ((label->flags & sixfive_symbol_import) ? sixfive_symbol_import : label->flags);
+    out |= sixfive_object_put(ctx, kind, 1);
+    out |= sixfive_object_put(ctx, 0, 2);
+    out |= sixfive_object_put(ctx, (label->address == ADDRESS_UNKNOWN ? 0 : label->address - ctx->origin), 2);
+    out |= sixfive_object_put(ctx, strlen(label->string), 2);
+    out |= sixfive_object_emit(ctx, label->string, strlen(label->string));
+  }
+
+  /* The same fixups as above, each with the operations after the last's */
+  for(fixup=ctx->fixups.list,ops=0;fixup<end;fixup++){
+    if(fixup->relax == sixfive_relax_org || fixup->width == 0){
+      continue;
+    }
+    out |= sixfive_object_put(ctx, 0, 2);
+    out |= sixfive_object_put(ctx, fixup->offset, 4);
+    out |= sixfive_object_put(ctx, fixup->here, 4);
+    out |= sixfive_object_put(ctx, fixup->width, 1);
+    out |= sixfive_object_put(ctx, fixup->line, 4);
+    out |= sixfive_object_put(ctx, ops, 4);
+    ops += sixfive_object_ops(ctx, fixup);
+  }
+
+  for(fixup=ctx->fixups.list;fixup<end;fixup++){
+    if(fixup->relax == sixfive_relax_org || fixup->width == 0){
+      continue;
+    }
+    if(fixup->expr == -1){
+      out |= sixfive_object_put(ctx, sixfive_expr_label, 1);
+      out |= sixfive_object_put(ctx, fixup->label, 4);
+      out |= sixfive_object_put(ctx, sixfive_expr_end, 1);
+      out |= sixfive_object_put(ctx, 0, 4);
+      continue;
+    }
+    for(op=ctx->exprs.list+fixup->expr;;op++){
+      out |= sixfive_object_put(ctx, op->op, 1);
+      out |= sixfive_object_put(ctx, op->value, 4);
+      if(op->op == sixfive_expr_end){
+        break;
+      }
+    }
+  }
+
+  return (out == sixfive_output_success ? sixfive_output_success : sixfive_output_error);
+}
+
+/*
+ * Reads a number of the given number of
+ * bytes from an object, or 0 if it ends
+ * first
+ */
+unsigned long sixfive_reader_get(sixfive_reader *r, int bytes){
+  unsigned long value = 0;
+  int i;
+
+  if(r->end - r->c < bytes){
+    r->error = 1;
+    r->c = r->end;
+    return 0;
+  }
+  for(i=bytes-1;i>=0;i--){
+    value = (value << 8) | r->c[i];
+  }
+  r->c += bytes;
+
+  return value;
+}
+
+/* Reads a signed, four-byte number */
+long sixfive_reader_signed(sixfive_reader *r){
+  unsigned long value = sixfive_reader_get(r, 4);
+
+  return ((value & 0x80000000UL) ? -(long)(~value & 0x7fffffffUL) - 1 : (long)value);
+}
+
+/*
+ * Reads the header of an object, into the
+ * number of its sections, symbols,
+ * relocations, and operations
+ */
+int sixfive_link_header(sixfive_ctx *ctx, const sixfive_object *object, sixfive_reader *r, unsigned long *counts){
+  const char *name = (object->name != NULL ? object->name : "object");
+  int i;
+
+  r->c = object->data;
+  r->end = object->data + object->length;
+  r->error = 0;
+  if(object->length < 4 || memcmp(object->data, "SIX5", 4) != 0){
+    sixfive_diagnostic_add(ctx, 0, "\"%.64s\" is not an object.", name);
+    return sixfive_output_error;
+  }
+  r->c += 4;
+  if(sixfive_reader_get(r, 2) != OBJECT_VERSION){
+    sixfive_diagnostic_add(ctx, 0, "\"%.64s\" is an object of another version.", name);
+    return sixfive_output_error;
+  }
+  counts[0] = sixfive_reader_get(r, 2);
+  for(i=1;i<4;i++){
+    counts[i] = sixfive_reader_get(r, 4);
+    r->error |= (counts[i] > (unsigned long)object->length);
+  }
+  if(r->error){
+    sixfive_diagnostic_add(ctx, 0, "\"%.64s\" is truncated.", name);
+    return sixfive_output_error;
+  }
+
+  return sixfive_output_success;
+}
+
+/*
+ * Whether an object's expression is whole:
+ * each operation has the values it takes,
+ * and it ends with one value left
+ */
+int sixfive_link_expr(const sixfive_expr_op *op, unsigned long count, unsigned long symbols){
+  unsigned long i;
+  int depth = 0;
+
+  for(i=0;i<count && depth < MAX_EXPR_OPS;i++,op++){
+    switch(op->op){
+      case sixfive_expr_end:
+        return depth == 1;
+      case sixfive_expr_label:
+        if(op->value < 0 || (unsigned long)op->value >= symbols){
+          return 0;
+        }
+        /* Fall through */
+      case sixfive_expr_value:
+      case sixfive_expr_here:
+        depth++;
+        break;
+      case sixfive_expr_negate:
+      case sixfive_expr_not:
+      case sixfive_expr_low:
+      case sixfive_expr_high:
+        if(depth < 1){
+          return 0;
+        }
+        break;
+      default:
+        if(depth < 2){
+          return 0;
+        }
+        depth--;
+        break;
+    }
+  }
+
+  return 0;
+}
+
+/*
+ * Places each of an object's sections, the
+ * index-th given, where the last ended (or
+ * where it must be, if absolute), and
+ * defines the symbols it exports
+ */
+int sixfive_link_place(sixfive_ctx *ctx, const sixfive_object *objects, int index){
+  const sixfive_object *object = &objects[index];
+  const char *name = (object->name != NULL ? object->name : "object");
+  sixfive_label *label;
+  sixfive_reader r;
+  const unsigned char *data;
+  unsigned long counts[4], flags, origin, length, kind, section, offset, len, i;
+  long address, *bases;
+  int first = ctx->base_count, capacity, found;
+
+  if(sixfive_link_header(ctx, object, &r, counts) == sixfive_output_error){
+    return sixfive_output_error;
+  }
+  if(ctx->base_count + counts[0] > (unsigned long)ctx->base_capacity){
+    capacity = ctx->base_count + counts[0];
+    bases = realloc(ctx->bases, sizeof(long)*capacity);
+    if(bases == NULL){
+      return sixfive_output_error;
+    }
+    ctx->stats.allocations++;
+    ctx->bases = bases;
+    ctx->base_capacity = capacity;
+  }
+
+  for(i=0;i<counts[0];i++){
+    flags = sixfive_reader_get(&r, 2);
+    origin = sixfive_reader_get(&r, 2);
+    length = sixfive_reader_get(&r, 4);
+    if(r.error || length > (unsigned long)(r.end - r.c)){
+      sixfive_diagnostic_add(ctx, 0, "\"%.64s\" is truncated.", name);
+      return sixfive_output_error;
+    }
+    data = r.c;
+    r.c += length;
+
+    address = ctx->origin + ctx->image.length;
+    if((flags & sixfive_section_absolute) && !ctx->fixed){
+      ctx->origin = origin;
+    } else if((flags & sixfive_section_absolute) && (long)origin < address){
+      sixfive_diagnostic_add(ctx, 0, "\"%.64s\" is at $%.4lx, behind the current address, $%.4lx.", name, origin, address);
+      return sixfive_output_error;
+    } else if((flags & sixfive_section_absolute) && sixfive_image_fill(ctx, 0, origin - address) == sixfive_output_error){
+      return sixfive_output_error;
+    }
+    ctx->fixed = 1;
+    ctx->bases[ctx->base_count++] = ctx->origin + ctx->image.length;
+    if(length > SIXFIVE_OUTPUT_MAX_LENGTH || sixfive_image_emit(ctx, data, length) == sixfive_output_error){
+      sixfive_diagnostic_add(ctx, 0, "\"%.64s\" does not fit, at $%.4lx.", name, ctx->origin + ctx->image.length);
+      return sixfive_output_error;
+    }
+  }
+
+  for(i=0;i<counts[1];i++){
+    kind = sixfive_reader_get(&r, 1);
+    section = sixfive_reader_get(&r, 2);
+    offset = sixfive_reader_get(&r, 2);
+    len = sixfive_reader_get(&r, 2);
+    if(r.error || len > (unsigned long)(r.end - r.c) || (kind != sixfive_symbol_import && section >= counts[0])){
+      sixfive_diagnostic_add(ctx, 0, "\"%.64s\" is truncated.", name);
+      return sixfive_output_error;
+    }
+    data = r.c;
+    r.c += len;
+    if(kind != sixfive_symbol_export){
+      continue;
+    }
+
+    found = sixfive_symtab_find(&ctx->symtab, (const char*)data, len, djb2hash(data, len), ADDRESS_UNKNOWN);
+    if(found == sixfive_output_error){
+      return sixfive_output_error;
+    }
+    label = &ctx->symtab.labels[found];
+    if(label->flags & sixfive_symbol_export){
+      sixfive_diagnostic_add(ctx, 0, "\"%.32s\" is exported by both \"%.32s\" and \"%.32s\".", label->string,
+        (objects[label->mark].name != NULL ? objects[label->mark].name : "object"), name);
+      return sixfive_output_error;
+    }
+    label->flags = sixfive_symbol_export;
+    label->mark = index;
+    label->address = (ctx->bases[first+section] + offset) & 0xffff;
+  }
+
+  return sixfive_output_success;
+}
+
+/*
+ * Patches each of an object's relocations,
+ * with the symbols of every object, given
+ * the index of its first section (moved on
+ * past its last)
+ */
+int sixfive_link_patch(sixfive_ctx *ctx, const sixfive_object *object, int *next){
+  const char *name = (object->name != NULL ? object->name : "object");
+  sixfive_label *links, *link;
+  sixfive_fixup fixup;
+  sixfive_expr_op *op;
+  sixfive_reader r;
+  const unsigned char *data;
+  unsigned long counts[4], kind, section, offset, len, expr, i;
+  long value, base, limit;
+  int found, status, first = *next;
+
+  if(sixfive_link_header(ctx, object, &r, counts) == sixfive_output_error){
+    return sixfive_output_error;
+  }
+  for(i=0;i<counts[0] && !r.error;i++){
+    r.c += 4;
+    r.c += sixfive_reader_get(&r, 4);
+  }
+
+  if(counts[1] > (unsigned long)ctx->link_capacity){
+    links = realloc(ctx->links, sizeof(sixfive_label)*counts[1]);
+    if(links == NULL){
+      return sixfive_output_error;
+    }
+    ctx->stats.allocations++;
+    ctx->links = links;
+    ctx->link_capacity = counts[1];
+  }
+
+  /* Symbols it imports are found among those others export */
+  for(i=0;i<counts[1] && !r.error;i++){
+    link = &ctx->links[i];
+    kind = sixfive_reader_get(&r, 1);
+    section = sixfive_reader_get(&r, 2);
+    offset = sixfive_reader_get(&r, 2);
+    len = sixfive_reader_get(&r, 2);
+    if(r.error || len > (unsigned long)(r.end - r.c)){
+      r.error = 1;
+      break;
+    }
+    data = r.c;
+    r.c += len;
+    if(kind == sixfive_symbol_import){
+      found = sixfive_symtab_find(&ctx->symtab, (const char*)data, len, djb2hash(data, len), ADDRESS_UNKNOWN);
+      if(found == sixfive_output_error){
+        return sixfive_output_error;
+      }
+      *link = ctx->symtab.labels[found];
+    } else {
+      link->string = sixfive_symtab_intern(&ctx->symtab, (const char*)data, len);
+      if(link->string == NULL){
+        return sixfive_output_error;
+      }
+      link->address = (ctx->bases[first+section] + offset) & 0xffff;
+    }
+  }
+
+  if(sixfive_expr_reserve(ctx, counts[3]) == sixfive_output_error){
+    return sixfive_output_error;
+  }
+  r.c += 19*counts[2];
+  for(i=0,op=ctx->exprs.list;i<counts[3] && !r.error;i++,op++){
+    op->op = sixfive_reader_get(&r, 1);
+    op->value = sixfive_reader_signed(&r);
+    r.error |= (op->op > sixfive_expr_shr);
+  }
+  if(r.error || r.c > r.end){
+    sixfive_diagnostic_add(ctx, 0, "\"%.64s\" is truncated.", name);
+    return sixfive_output_error;
+  }
+
+  /* Then back to the relocations, before the operations */
+  r.c -= 5*counts[3] + 19*counts[2];
+  for(i=0;i<counts[2];i++){
+    section = sixfive_reader_get(&r, 2);
+    offset = sixfive_reader_get(&r, 4);
+    fixup.here = sixfive_reader_signed(&r);
+    fixup.width = sixfive_reader_get(&r, 1);
+    fixup.line = sixfive_reader_get(&r, 4);
+    expr = sixfive_reader_get(&r, 4);
+    fixup.label = -1;
+    fixup.expr = expr;
+    fixup.relax = sixfive_relax_none;
+    if(section >= counts[0] || fixup.width > 2 || expr >= counts[3] ||
+       !sixfive_link_expr(ctx->exprs.list + expr, counts[3] - expr, counts[1])){
+      sixfive_diagnostic_add(ctx, 0, "\"%.64s\" is truncated.", name);
+      return sixfive_output_error;
+    }
+    base = ctx->bases[first+section];
+    fixup.offset = base - ctx->origin + offset;
+    if(offset > SIXFIVE_OUTPUT_MAX_LENGTH || fixup.offset + fixup.width > ctx->image.length){
+      sixfive_diagnostic_add(ctx, 0, "\"%.64s\" is truncated.", name);
+      return sixfive_output_error;
+    }
+
+    status = sixfive_expr_eval(ctx->exprs.list + expr, ctx->links, NULL, NULL, base + offset + fixup.here, &value);
+    if(status == sixfive_output_none){
+      sixfive_diagnostic_add(ctx, 0, "\"%.32s\" uses \"%.32s\" on line %i, which no object exports.", name, ctx->links[value].string, fixup.line);
+      return sixfive_output_error;
+    }
+    if(status == sixfive_output_error){
+      sixfive_diagnostic_add(ctx, 0, "\"%.32s\" divides by zero on line %i.", name, fixup.line);
+      return sixfive_output_error;
+    }
+    switch(sixfive_fixup_range(&fixup, value, &limit)){
+      case 1:
+        sixfive_diagnostic_add(ctx, 0, "\"%.32s\" on line %i: $%lx is larger than $%lx.", name, fixup.line, value, limit);
+        return sixfive_output_error;
+      case -1:
+        sixfive_diagnostic_add(ctx, 0, "\"%.32s\" on line %i: %li is smaller than %li.", name, fixup.line, value, limit);
+        return sixfive_output_error;
+    }
+    ctx->image.data[fixup.offset] = value & 0xff;
+    if(fixup.width == 2){
+      ctx->image.data[fixup.offset+1] = (value >> 8) & 0xff;
+    }
+  }
+  *next += counts[0];
+
+  return sixfive_output_success;
+}
+
+/*****************************/
+/* ASSEMBLY                  */
+/*****************************/
+
+/*
+ * Copies the image of a finished assembly
+ * into the caller's buffer, and hands over
+ * its diagnostics
+ */
+int sixfive_assemble_finish(sixfive_ctx *ctx, int out, unsigned char *out_buf, long *out_len, sixfive_diagnostics *diagnostics){
+  ctx->line_count = 0;
+  if(out != sixfive_output_error && ctx->listing && sixfive_listing_finish(ctx) == sixfive_output_error){
+    sixfive_diagnostic_add(ctx, 0, "out of memory for the listing.");
+    out = sixfive_output_error;
+  }
+  if(out != sixfive_output_error){
+    if(ctx->image.length > *out_len || (out_buf == NULL && ctx->image.length > 0)){
+      sixfive_diagnostic_add(ctx, 0, "output buffer too small, %li bytes needed.", ctx->image.length);
+      out = sixfive_output_error;
+    } else if(ctx->image.length > 0){
+      memcpy(out_buf, ctx->image.data, ctx->image.length);
+    }
+    *out_len = ctx->image.length;
+  }
+
+  if(diagnostics != NULL){
+    diagnostics->list = ctx->diagnostics;
+    diagnostics->count = ctx->diagnostic_count;
+  }
+
+  return out;
+}
+
+/*
+ * Relaxes and links a file parsed on a
+ * single thread (or, for an object, leaves
+ * it to the linker)
+ */
+int sixfive_assemble_link(sixfive_ctx *ctx){
+  double phase = sixfive_clock(ctx);
+  int out = sixfive_output_success;
+
+  if(ctx->object){
+    out = sixfive_object_check(ctx);
+  }
+  if(out != sixfive_output_error){
+    out = sixfive_relax(ctx);
+  }
+  if(out != sixfive_output_error){
+    out = (ctx->object ? sixfive_object_write(ctx) : sixfive_parse_labels(ctx));
+  }
+  ctx->stats.link_ms = sixfive_clock(ctx) - phase;
+
+  return out;
+}
+
+int sixfive_assemble(sixfive_ctx *ctx, const char *src, long len, unsigned char *out_buf, long *out_len, sixfive_diagnostics *diagnostics){
+  double start = sixfive_clock(ctx), phase;
+  int out, lines;
+
+  sixfive_ctx_reset(ctx);
+  ctx->watching = 0;
+  ctx->source = src;
+  ctx->source_length = len;
+
+  if(ctx->threads > 1 && !ctx->object && !sixfive_source_expands(src, len) && sixfive_unit_split(ctx, src, len) > 1){
+    out = sixfive_parse_units(ctx);
+  } else {
+    phase = sixfive_clock(ctx);
+    out = sixfive_parse_string(ctx, src, len, &lines);
+    ctx->stats.parse_ms = sixfive_clock(ctx) - phase;
+    if(out != sixfive_output_error){
+      out = sixfive_assemble_link(ctx);
+    }
+  }
+
+  out = sixfive_assemble_finish(ctx, out, out_buf, out_len, diagnostics);
+  ctx->stats.total_ms = sixfive_clock(ctx) - start;
+  return out;
+}
+
+/*
+ * Keeps a copy of the source, split into
+ * small units, so that each call after the
+ * first parses only the units which changed,
+ * and links only what moved
+ */
+int sixfive_reassemble(sixfive_ctx *ctx, const char *src, long len, unsigned char *out_buf, long *out_len, sixfive_diagnostics *diagnostics){
+  double start = sixfive_clock(ctx);
+  int out;
+
+  if(ctx->object || sixfive_source_expands(src, len)){
+    return sixfive_assemble(ctx, src, len, out_buf, out_len, diagnostics);
+  }
+  ctx->diagnostic_count = 0;
+  sixfive_ctx_reset_stats(ctx);
+
+  if(!ctx->watching){
+    sixfive_ctx_reset(ctx);
+    ctx->text_length = 0;
+    if(sixfive_unit_replace(ctx, 0, ctx->unit_count, src, 0, WATCH_UNIT_LENGTH) != sixfive_output_error){
+      ctx->watching = 1;
+    }
+  }
+
+  out = (ctx->watching ? sixfive_unit_update(ctx, src, len) : sixfive_output_error);
+  if(out == sixfive_output_error){
+    ctx->watching = 0;
+  } else {
+    ctx->source = ctx->text;
+    ctx->source_length = ctx->text_length;
+    out = sixfive_parse_units(ctx);
+  }
+
+  out = sixfive_assemble_finish(ctx, out, out_buf, out_len, diagnostics);
+  ctx->stats.total_ms = sixfive_clock(ctx) - start;
+  return out;
+}
+
+/*
+ * Places every object before patching any,
+ * so that each may use what any other
+ * exports
+ */
+int sixfive_link(sixfive_ctx *ctx, const sixfive_object *objects, int count, long origin, unsigned char *out_buf, long *out_len, sixfive_diagnostics *diagnostics){
+  double start = sixfive_clock(ctx), phase;
+  int out = sixfive_output_success, i, first;
+
+  sixfive_ctx_reset(ctx);
+  ctx->watching = 0;
+
+  if(origin > 0xffff){
+    sixfive_diagnostic_add(ctx, 0, "origin $%lx is out of range.", origin);
+    out = sixfive_output_error;
+  } else if(origin >= 0){
+    ctx->origin = origin;
+    ctx->fixed = 1;
+  }
+
+  phase = sixfive_clock(ctx);
+  for(i=0;i<count && out != sixfive_output_error;i++){
+    out = sixfive_link_place(ctx, objects, i);
+  }
+  ctx->stats.layout_ms = sixfive_clock(ctx) - phase;
+
+  phase = sixfive_clock(ctx);
+  for(i=0,first=0;i<count && out != sixfive_output_error;i++){
+    out = sixfive_link_patch(ctx, &objects[i], &first);
+  }
+  ctx->stats.link_ms = sixfive_clock(ctx) - phase;
+
+  out = sixfive_assemble_finish(ctx, out, out_buf, out_len, diagnostics);
+  ctx->stats.total_ms = sixfive_clock(ctx) - start;
+  return out;
+}
+
+/*
+ * Starts assembling a source given a piece
+ * at a time, see sixfive_stream_write
+ */
+void sixfive_stream_begin(sixfive_ctx *ctx){
+  sixfive_ctx_reset(ctx);
+  ctx->watching = 0;
+  ctx->text_length = 0;
+  ctx->stream_parsed = 0;
+  ctx->stream_status = sixfive_output_success;
+  ctx->stream_whole = 0;
+}
+
+/*
+ * Parses the stream's lines from where it
+ * left off up to stop, looking no further
+ * than end for the optimizer
+ */
+int sixfive_stream_parse(sixfive_ctx *ctx, const char *stop, const char *end){
+  double phase = sixfive_clock(ctx);
+  int lines;
+
+  ctx->source = ctx->text;
+  ctx->source_length = end - ctx->text;
+  ctx->stream_status = sixfive_parse_string(ctx, ctx->text + ctx->stream_parsed, stop - (ctx->text + ctx->stream_parsed), &lines);
+  ctx->lines_before += lines;
+  ctx->stats.parse_ms += sixfive_clock(ctx) - phase;
+
+  return ctx->stream_status;
+}
+
+/*
+ * Adds the next len bytes of a stream,
+ * parsing every whole line but the last,
+ * which the optimizer may look ahead to,
+ * then dropping all but that and the line
+ * before it (which it may look back to)
+ *
+ * A stream which defines macros, repeats
+ * lines, or includes files is kept whole
+ * from there on, and parsed at its end,
+ * as those lines may be needed again.
+ * Fails once a line has.
+ */
+int sixfive_stream_write(sixfive_ctx *ctx, const char *data, long len){
+  const char *from, *eol, *next, *keep;
+  char *text;
+  long capacity = ctx->text_capacity;
+
+  if(ctx->stream_status == sixfive_output_error){
+    return sixfive_output_error;
+  }
+  if(ctx->text_length + len > capacity){
+    if(capacity == 0){
+      capacity = READ_BLOCK_LENGTH;
+    }
+    while(capacity < ctx->text_length + len){
+      capacity *= 2;
+    }
+    text = realloc(ctx->text, capacity);
+    if(text == NULL){
+      return sixfive_output_error;
+    }
+    ctx->stats.allocations++;
+    ctx->text = text;
+    ctx->text_capacity = capacity;
+  }
+  memcpy(ctx->text + ctx->text_length, data, len);
+  ctx->text_length += len;
+
+  from = ctx->text + ctx->stream_parsed;
+  if(!ctx->stream_whole && sixfive_source_expands(from, ctx->text + ctx->text_length - from)){
+    ctx->stream_whole = 1;
+  }
+  if(ctx->stream_whole){
+    return sixfive_output_success;
+  }
+
+  /* The end of the last whole line, and the start of it */
+  for(eol=ctx->text+ctx->text_length;eol > from && eol[-1] != '\n';eol--);
+  if(eol == from){
+    return sixfive_output_success;
+  }
+  for(next=eol-1;next > from && next[-1] != '\n';next--);
+  if(next == from){
+    return sixfive_output_success;
+  }
+  if(sixfive_stream_parse(ctx, next, eol) == sixfive_output_error){
+    return sixfive_output_error;
+  }
+
+  for(keep=next-1;keep > ctx->text && keep[-1] != '\n';keep--);
+  ctx->text_length -= keep - ctx->text;
+  ctx->stream_parsed = next - keep;
+  memmove(ctx->text, keep, ctx->text_length);
+
+  return sixfive_output_success;
+}
+
+/*
+ * Parses what is left of a stream, then
+ * links it as sixfive_assemble would have
+ * the whole source
+ */
+int sixfive_stream_end(sixfive_ctx *ctx, unsigned char *out_buf, long *out_len, sixfive_diagnostics *diagnostics){
+  int out = ctx->stream_status;
+
+  if(out != sixfive_output_error){
+    out = sixfive_stream_parse(ctx, ctx->text + ctx->text_length, ctx->text + ctx->text_length);
+  }
+  if(out != sixfive_output_error){
+    out = sixfive_assemble_link(ctx);
+  }
+
+  out = sixfive_assemble_finish(ctx, out, out_buf, out_len, diagnostics);
+  ctx->stats.total_ms = ctx->stats.parse_ms + ctx->stats.link_ms;
+  return out;
+}
+
+/*****************************/
+/* DISASSEMBLY               */
+/*****************************/
+
+/* Each hex digit, as the disassembler writes it */
+const char sixfive_hex_digits[] = "0123456789abcdef";
+
+/*
+ * Writes value as digits hex digits,
+ * returning where they end
+ */
+char *sixfive_disassembly_hex(char *out, long value, int digits){
+  while(digits-- > 0){
+    *out++ = sixfive_hex_digits[(value >> (4*digits)) & 0xf];
+  }
+
+  return out;
+}
+
+/*
+ * Whether the disassembly has a label at an
+ * address: one which starts a line, and
+ * which some operand uses
+ */
+int sixfive_disassembly_labelled(sixfive_ctx *ctx, long address, long len){
+  long at = address - ctx->origin;
+
+  return at >= 0 && at < len && ctx->marks[at] == (sixfive_disassembly_line | sixfive_disassembly_target);
+}
+
+/*
+ * Writes the label at an address, returning
+ * where it ends
+ */
+char *sixfive_disassembly_label(char *out, long address){
+  *out++ = 'L';
+  return sixfive_disassembly_hex(out, address, 4);
+}
+
+/*
+ * Whether a label at an address is sure to
+ * stay outside the zero page while it is
+ * assembled, as each instruction before it
+ * starts in its zero page form, if it has
+ * one, so is a byte shorter than at last
+ * (and at least three bytes long)
+ */
+int sixfive_disassembly_absolute(sixfive_ctx *ctx, long address){
+  return address - (address - ctx->origin)/3 >= 0x100;
+}
+
+/*
+ * Writes an absolute address, by its label
+ * if it has one sure to stay outside the
+ * zero page, or as four hex digits, which
+ * keep it absolute
+ */
+char *sixfive_disassembly_address(sixfive_ctx *ctx, char *out, long address, long len){
+  if(sixfive_disassembly_absolute(ctx, address) && sixfive_disassembly_labelled(ctx, address, len)){
+    return sixfive_disassembly_label(out, address);
+  }
+  *out++ = '$';
+  return sixfive_disassembly_hex(out, address, 4);
+}
+
+/*
+ * Whether the next branch may use a label:
+ * each is assembled at its longest before it
+ * is shortened, so only while room is left
+ * for that below $10000
+ */
+int sixfive_disassembly_branch(long *room){
+  long grows = RELAX_LENGTH(sixfive_relax_branch) - sixfive_mode_lengths[sixfive_mode_relative];
+
+  if(*room < grows){
+    return 0;
+  }
+  *room -= grows;
+  return 1;
+}
+
+/*
+ * Makes room for len bytes of disassembly
+ */
+int sixfive_disassembly_reserve(sixfive_ctx *ctx, long len){
+  sixfive_image *disassembly = &ctx->disassembly;
+  unsigned char *data;
+  long capacity = disassembly->capacity;
+
+  if(len > capacity){
+    if(capacity == 0){
+      capacity = OUTPUT_INITIAL_LENGTH;
+    }
+    while(capacity < len){
+      capacity *= 2;
+    }
+    data = realloc(disassembly->data, capacity);
+    if(data == NULL){
+      return sixfive_output_error;
+    }
+    ctx->stats.allocations++;
+    disassembly->data = data;
+    disassembly->capacity = capacity;
+  }
+
+  return sixfive_output_success;
+}
+
+/*
+ * Fills in how to write each of the 256
+ * opcodes, from the instruction set, and in
+ * ops[256], a byte which is not one
+ */
+void sixfive_disassembly_ops(sixfive_disassembly_op *ops){
+  static const char *before[sixfive_mode_count] = {"", " A", " #$", " $", " $", " $", " ", " ", " ", " (", " ($", " ($", " "};
+  static const char *after[sixfive_mode_count] = {"", "", "", "", ",X", ",Y", "", ",X", ",Y", ")", ",X)", "),Y", ""};
+  signed char instructions[256], modes[256];
+  sixfive_disassembly_op *op;
+  int i, mode;
+
+  sixfive_opcode_decode(instructions, modes);
+  memset(ops, 0, sizeof(sixfive_disassembly_op)*257);
+  for(i=0,op=ops;i<=256;i++,op++){
+    mode = (i < 256 ? modes[i] : -1);
+    op->mode = mode;
+    if(mode == -1){
+      memcpy(op->before, "  .byte $", 9);
+      op->before_len = 9;
+      op->length = 1;
+      op->digits = 2;
+      continue;
+    }
+    op->before[0] = op->before[1] = ' ';
+    memcpy(op->before+2, sixfive_instruction_names[(int)instructions[i]], 3);
+    op->before_len = 5 + strlen(before[mode]);
+    memcpy(op->before+5, before[mode], op->before_len-5);
+    op->after_len = strlen(after[mode]);
+    memcpy(op->after, after[mode], op->after_len);
+    op->length = sixfive_mode_lengths[mode];
+    op->value_at = (op->length == 2 ? 1 : 0);
+    op->digits = (op->length == 2 && mode != sixfive_mode_relative ? 2 : 0);
+  }
+}
+
+/*
+ * Marks an address an operand uses, if it
+ * is one a label can be at ($ffff means a
+ * label is unknown)
+ */
+void sixfive_disassembly_target_mark(sixfive_ctx *ctx, long address, long len){
+  long at = address - ctx->origin;
+
+  if(at >= 0 && at < len && address != ADDRESS_UNKNOWN){
+    ctx->marks[at] |= sixfive_disassembly_target;
+  }
+}
+
+/*
+ * Finds where each line of the disassembly
+ * starts, decoding from the first byte on,
+ * and each address an operand uses which
+ * could have a label: any a branch reaches
+ * (while there is room for it to), and any
+ * of two bytes which stays outside the zero
+ * page (as a label would otherwise move into
+ * it)
+ *
+ * Returns the number of lines.
+ */
+long sixfive_disassembly_mark(sixfive_ctx *ctx, const unsigned char *data, long len, const sixfive_disassembly_op *ops){
+  const sixfive_disassembly_op *op;
+  unsigned char *marks = ctx->marks;
+  long at, next, target, lines = 0;
+  long room = SIXFIVE_OUTPUT_MAX_LENGTH - (ctx->origin + len);
+
+  memset(marks, 0, len);
+  for(at=0;at<len;at=next,lines++){
+    op = &ops[data[at]];
+    marks[at] |= sixfive_disassembly_line;
+    next = at + op->length;
+    if(next > len){
+      /* Cut short, so left as bytes */
+      next = at + 1;
+    } else if(op->mode == sixfive_mode_relative){
+      target = ctx->origin + next + (signed char)data[at+1];
+      if(sixfive_disassembly_branch(&room)){
+        sixfive_disassembly_target_mark(ctx, target, len);
+      }
+    } else if(op->length == 3){
+      target = data[at+1] | (data[at+2] << 8);
+      if(sixfive_disassembly_absolute(ctx, target)){
+        sixfive_disassembly_target_mark(ctx, target, len);
+      }
+    }
+  }
+
+  return lines;
+}
+
+/*
+ * Writes the disassembly, a line at a time,
+ * into a buffer with room for every line,
+ * returning its length
+ */
+long sixfive_disassembly_write(sixfive_ctx *ctx, const unsigned char *data, long len, const sixfive_disassembly_op *ops){
+  const sixfive_disassembly_op *op;
+  long at, next, target;
+  int value;
+  long room = SIXFIVE_OUTPUT_MAX_LENGTH - (ctx->origin + len);
+  char *c = (char*)ctx->disassembly.data;
+
+  if(ctx->origin != 0){
+    memcpy(c, ".org $", 6);
+    c = sixfive_disassembly_hex(c+6, ctx->origin, 4);
+    *c++ = '\n';
+  }
+  for(at=0;at<len;at=next){
+    op = &ops[data[at]];
+    next = at + op->length;
+    if(next > len){
+      op = &ops[256];
+      next = at + 1;
+    }
+    if(ctx->marks[at] & sixfive_disassembly_target){
+      c = sixfive_disassembly_label(c, ctx->origin + at);
+      *c++ = ':';
+      *c++ = '\n';
+    }
+
+    /* Most have at most a byte, written whether or not it is kept */
+    memcpy(c, op->before, sizeof(op->before));
+    c += op->before_len;
+    value = data[at + op->value_at];
+    c[0] = sixfive_hex_digits[value >> 4];
+    c[1] = sixfive_hex_digits[value & 0xf];
+    c += op->digits;
+    if(op->mode == sixfive_mode_relative){
+      /* A branch with no label to reach is written as its offset */
+      target = ctx->origin + next + (signed char)value;
+      if(sixfive_disassembly_branch(&room) && sixfive_disassembly_labelled(ctx, target, len)){
+        c = sixfive_disassembly_label(c, target);
+      } else {
+        *c++ = '$';
+        c = sixfive_disassembly_hex(c, value, 2);
+      }
+    } else if(op->length == 3){
+      c = sixfive_disassembly_address(ctx, c, data[at+1] | (data[at+2] << 8), len);
+    }
+    memcpy(c, op->after, sizeof(op->after));
+    c += op->after_len;
+    *c++ = '\n';
+  }
+
+  return c - (char*)ctx->disassembly.data;
+}
+
+/*
+ * Disassembles len bytes of a program which
+ * starts at origin back into source, which
+ * assembles into exactly the same bytes
+ *
+ * Each opcode is looked up in a table of all
+ * 256, decoded from the instruction set, and
+ * each line written straight into a buffer
+ * made large enough for them all (and the
+ * whole of each opcode's text) at the start.
+ * Bytes which are not an instruction are
+ * written with .byte, and an operand which
+ * uses an address with a line of its own
+ * uses a label there, named for its address.
+ */
+int sixfive_disassemble(sixfive_ctx *ctx, const unsigned char *data, long len, long origin, const char **text, long *text_len, sixfive_diagnostics *diagnostics){
+  sixfive_disassembly_op ops[257];
+  double start = sixfive_clock(ctx);
+  int out = sixfive_output_success;
+  long lines = 0;
+
+  sixfive_ctx_reset(ctx);
+  ctx->watching = 0;
+  ctx->origin = origin;
+  *text = NULL;
+  *text_len = 0;
+
+  if(origin < 0 || len < 0 || origin + len > SIXFIVE_OUTPUT_MAX_LENGTH){
+    sixfive_diagnostic_add(ctx, 0, "%li bytes from $%lx do not fit below $10000.", len, origin);
+    out = sixfive_output_error;
+  } else if(ctx->marks == NULL){
+    if((ctx->marks = malloc(SIXFIVE_OUTPUT_MAX_LENGTH)) == NULL){
+      out = sixfive_output_error;
+    } else {
+      ctx->stats.allocations++;
+    }
+  }
+
+  if(out != sixfive_output_error){
+    sixfive_disassembly_ops(ops);
+    lines = sixfive_disassembly_mark(ctx, data, len, ops);
+    /* Each line has at most a label and an instruction, after a .org */
+    out = sixfive_disassembly_reserve(ctx, DISASSEMBLY_LINE_LENGTH*(lines+1));
+  }
+  if(out != sixfive_output_error){
+    ctx->disassembly.length = sixfive_disassembly_write(ctx, data, len, ops);
+    *text = (const char*)ctx->disassembly.data;
+    *text_len = ctx->disassembly.length;
+  }
+
+  if(diagnostics != NULL){
+    diagnostics->list = ctx->diagnostics;
+    diagnostics->count = ctx->diagnostic_count;
+  }
+  ctx->stats.lines = lines;
+  ctx->stats.bytes = len;
+  ctx->stats.total_ms = sixfive_clock(ctx) - start;
+  return out;
+}
+
+/*****************************/
+/* INPUT                     */
+/*****************************/
+
+/*
+ * Maps the given file into memory where
+ * possible, otherwise (or for pipes and
+ * empty files) reads it in full
+ */
+int sixfive_source_open(sixfive_source *src, char *path){
+  FILE *fp_in;
+  char *buf = NULL, *tmp;
+  long capacity = 0;
+  size_t len;
+#ifdef SIXFIVE_MMAP
+  struct stat st;
+  void *map;
+  int fd;
+
+  fd = open(path, O_RDONLY);
+  if(fd == -1){
+    return sixfive_output_error;
+  }
+  if(fstat(fd, &st) == 0 && S_ISREG(st.st_mode) && st.st_size > 0){
+    map = mmap(NULL, st.st_size, PROT_READ, MAP_PRIVATE, fd, 0);
+    if(map != MAP_FAILED){
+      close(fd);
+      src->data = map;
+      src->length = st.st_size;
+      src->mapped = 1;
+      return sixfive_output_success;
+    }
+  }
+  close(fd);
+#endif
+
+  fp_in = fopen(path, "rb");
+  if(fp_in == NULL){
+    return sixfive_output_error;
+  }
+
+  src->length = 0;
+  do {
+    if(src->length == capacity){
+      capacity += READ_BLOCK_LENGTH;
+      tmp = realloc(buf, capacity);
+      if(tmp == NULL){
+        free(buf);
+        fclose(fp_in);
+        return sixfive_output_error;
+      }
+      buf = tmp;
+    }
+    len = fread(buf + src->length, 1, capacity - src->length, fp_in);
+    src->length += len;
+  } while(len > 0);
+  fclose(fp_in);
+
+  src->data = buf;
+  src->mapped = 0;
+  return sixfive_output_success;
+}
+
+void sixfive_source_close(sixfive_source *src){
+#ifdef SIXFIVE_MMAP
+  if(src->mapped){
+    munmap((void*)src->data, src->length);
+    return;
+  }
+#endif
+  free((void*)src->data);
+}
@@ -1,611 +1,1496 @@
 /*
  * sixfive.c: an assembler for the 6502 microprocessor
  *
- * Usage: sixfive [in.S] [out.bin]
+ * Usage: sixfive [options] [--watch] [in.S] [out.bin]
+ *        sixfive [options] - -
+ *        sixfive [options] [-m manifest] [in.S:out.bin ...]
+ *        sixfive run [-j threads] [-O] [--limit cycles] [--top n] [in.S]
+ *        sixfive link [--org address] [out.bin] [in.o ...]
+ *        sixfive serve [-j threads] [-O] [-c] [--socket path]
+ *        sixfive -d [--org address] [in.bin] [out.S]
+ *
+ * Where options are -j threads, -O, -c, --stats[=json], --list, and
+ * --cycles from:to.  Run as sixfive-link, it links.  A path of - is
+ * stdin or stdout, which the source is read from a block at a time,
+ * and reports on output to stdout go to stderr.
+ * -d disassembles, into out.S or (without it) stdout.
  */
 
+/*
+ * Batches are assembled by a pool of threads,
+ * files watched for changes, phases timed by
+ * the wall clock, and requests served over
+ * sockets, where POSIX is available
+ */
+#if defined(__unix__) || defined(__APPLE__)
+#define _POSIX_C_SOURCE 200112L
+#define SIXFIVE_THREADS
+#define SIXFIVE_WATCH
+#define SIXFIVE_CLOCK
+#define SIXFIVE_SOCKETS
+#endif
+
 #include <stdio.h>
 #include <string.h>
-#include <strings.h>
-#include <stdint.h>
-#include <stdarg.h>
 #include <stdlib.h>
-#include <ctype.h>
+#include <time.h>
 
-/*****************************/
-/* PREPROCESSOR              */
-/*****************************/
+#ifdef SIXFIVE_THREADS
+#include <pthread.h>
+#endif
+
+#ifdef SIXFIVE_WATCH
+#include <sys/stat.h>
+#endif
 
-#define MAX_LINE_LENGTH 256
-#define MAX_OUTPUT_LENGTH 256
-#define MAX_OPERAND_LENGTH 256
-#define MAX_LABELS_COUNT 256
+#ifdef SIXFIVE_SOCKETS
+#include <errno.h>
+#include <signal.h>
+#include <unistd.h>
+#include <sys/socket.h>
+#include <sys/un.h>
+#endif
 
-#define LABEL_MAGIC_START 0xfeff
-#define ADDRESS_UNKNOWN 0xffff
+#include "sixfive.h"
 
-#define RED     "\x1b[31m"
-#define GREEN   "\x1b[32m"
-#define YELLOW  "\x1b[33m"
-#define BLUE    "\x1b[34m"
-#define MAGENTA "\x1b[35m"
-#define CYAN    "\x1b[36m"
-#define RESET   "\x1b[0m"
+/*****************************/
+/* PREPROCESSOR              */
+/*****************************/
 
-#define LENGTH(x) (sizeof(x)/sizeof(x[0]))
+#define JOBS_INITIAL_COUNT 16
+#define MAX_THREADS 256
+#define WATCH_INTERVAL_MS 100
+#define RUN_DEFAULT_LIMIT 100000000UL
+#define RUN_DEFAULT_TOP 10
+#define STREAM_BLOCK_LENGTH 0x4000
+#define SERVE_MAX_REQUEST_LENGTH 0x4000000L
+#define SERVE_BACKLOG 16
 
 /*****************************/
-/* UTILITY FUNCTIONS         */
+/* ENUMS AND TYPEDEFS        */
 /*****************************/
 
 /*
- * Dan Bernstein's hash algorithm,
- * http://www.cse.yorku.ca/~oz/hash.html
+ * One file of a batch, along with
+ * everything needed to report on it
+ * once the whole batch is done
  */
-unsigned long djb2hash(unsigned char *str){
-  unsigned long hash = 5381;
-  int c;
-
-  while((c = *str++)){
-    hash = ((hash << 5) + hash) + c; /* hash * 33 + c */
-  }
-
-  return hash;
-}
+typedef struct sixfive_job {
+  char *in_path;
+  char *out_path;
+  int status;
+  sixfive_diagnostic *diagnostics;
+  int diagnostic_count;
+  sixfive_stats stats;
+  double read_ms;
+  double write_ms;
+  int cycles_status;
+  long cycles_min;
+  long cycles_max;
+} sixfive_job;
 
 /*
- * For supporting lowercase mnemonics
+ * The batch being assembled, shared
+ * between all worker threads, which
+ * take the next job in turn, and the
+ * options each is assembled with
+ *
+ * cycles_from and cycles_to name the
+ * labels to count cycles between (or
+ * are NULL).  cache holds the files
+ * they all .include, read once each.
  */
-char *str_uppercase(char *str){
-  char *c = str;
-  int ind = 0;
-  do {
-    str[ind++] = toupper(*c);
-  } while(*c++);
-  return str;
-}
+typedef struct sixfive_batch {
+  sixfive_job *jobs;
+  int count;
+  int capacity;
+  int next;
+  int job_threads;
+  int optimize;
+  int object;
+  int stats;
+  int listing;
+  char *cycles_from;
+  char *cycles_to;
+  sixfive_cache *cache;
+#ifdef SIXFIVE_THREADS
+  pthread_mutex_t lock;
+#endif
+} sixfive_batch;
 
 /*
- * strdup() is not part of ANSI C
- * https://github.com/OSGeo/PROJ/issues/609
+ * The cycles spent after a label (or
+ * before the first, if label is NULL)
+ * in a run, up to the next
  */
-char *pj_strdup(char *str){
-  size_t len = strlen(str) + 1;
-  char *dup = calloc(sizeof(char), len);
-  memcpy(dup, str, len);
-  return dup;
-}
+typedef struct sixfive_hotspot {
+  const char *label;
+  unsigned long count;
+  unsigned long cycles;
+} sixfive_hotspot;
 
-/*****************************/
-/* ENUMS AND TYPEDEFS        */
-/*****************************/
-
-/* 
- * 100*strlen(operand)+operand[0]
- *
- * See util/operand_enum.c
+/*
+ * A server, shared between the threads
+ * which each take the next connection
+ * to its socket (or, serving stdin, the
+ * one thread), with the flags every
+ * request is assembled with at least
  */
-enum {
-  sixfive_operand_accumulator=165, /* A */
-  sixfive_operand_x=188,           /* X */
-  sixfive_operand_x2=288,          /* ...,X) */
-  sixfive_operand_y=189,           /* Y */
-  sixfive_operand_immediate=435,   /* #$ff */
-  sixfive_operand_absolute=536,    /* $ffff */
-  sixfive_operand_zeropage=336,    /* $ff */
-  sixfive_operand_indirect=740,    /* ($ffff) */
-  sixfive_operand_indirect_zeropage=540, /* ($ff) */
-  sixfive_operand_indirect_zeropage2=440 /* ($ff,X) */
-/* sixfive_operand_relative is the same as zeropage */
-};
+typedef struct sixfive_server {
+  int listener;
+  int flags;
+  sixfive_cache *cache;
+} sixfive_server;
 
-/* 
- * djb2hash(instruction);
- *
- * See util/instruction_enum.c
- */
+/* Options a request may set, as bits of its flags */
 enum {
-  sixfive_instruction_ADC=193450093,
-  sixfive_instruction_AND=193450424,
-  sixfive_instruction_ASL=193450597,
-  sixfive_instruction_BCC=193451149,
-  sixfive_instruction_BCS=193451165,
-  sixfive_instruction_BEQ=193451229,
-  sixfive_instruction_BIT=193451364,
-  sixfive_instruction_BMI=193451485,
-  sixfive_instruction_BNE=193451514,
-  sixfive_instruction_BPL=193451587,
-  sixfive_instruction_BRK=193451652,
-  sixfive_instruction_BVC=193451776,
-  sixfive_instruction_BVS=193451792,
-  sixfive_instruction_CLC=193452535,
-  sixfive_instruction_CLD=193452536,
-  sixfive_instruction_CLI=193452541,
-  sixfive_instruction_CLV=193452554,
-  sixfive_instruction_CMP=193452581,
-  sixfive_instruction_CPX=193452688,
-  sixfive_instruction_CPY=193452689,
-  sixfive_instruction_DEC=193453393,
-  sixfive_instruction_DEX=193453414,
-  sixfive_instruction_DEY=193453415,
-  sixfive_instruction_EOR=193454827,
-  sixfive_instruction_INC=193459135,
-  sixfive_instruction_INX=193459156,
-  sixfive_instruction_INY=193459157,
-  sixfive_instruction_JMP=193460204,
-  sixfive_instruction_JSR=193460404,
-  sixfive_instruction_LDA=193462070,
-  sixfive_instruction_LDX=193462093,
-  sixfive_instruction_LDY=193462094,
-  sixfive_instruction_LSR=193462582,
-  sixfive_instruction_NOP=193464626,
-  sixfive_instruction_ORA=193465799,
-  sixfive_instruction_PHA=193466558,
-  sixfive_instruction_PHP=193466573,
-  sixfive_instruction_PLA=193466690,
-  sixfive_instruction_PLP=193466705,
-  sixfive_instruction_ROL=193468978,
-  sixfive_instruction_ROR=193468984,
-  sixfive_instruction_RTI=193469140,
-  sixfive_instruction_RTS=193469150,
-  sixfive_instruction_SBC=193469629,
-  sixfive_instruction_SEC=193469728,
-  sixfive_instruction_SED=193469729,
-  sixfive_instruction_SEI=193469734,
-  sixfive_instruction_STA=193470221,
-  sixfive_instruction_STX=193470244,
-  sixfive_instruction_STY=193470245,
-  sixfive_instruction_TAX=193470706,
-  sixfive_instruction_TAY=193470707,
-  sixfive_instruction_TSX=193471300,
-  sixfive_instruction_TXA=193471442,
-  sixfive_instruction_TXS=193471460,
-  sixfive_instruction_TYA=193471475
+  sixfive_serve_optimize=1,
+  sixfive_serve_object=2
 };
 
-/* Used to describe the parser's state */
+/* Used to describe how --stats are reported */
 enum {
-  sixfive_state_unknown,
-  sixfive_state_comment,
-  sixfive_state_instruction,
-  sixfive_state_operand,
-  sixfive_state_label,
-  sixfive_state_directive
+  sixfive_stats_none,
+  sixfive_stats_text,
+  sixfive_stats_json
 };
 
-/* Used for clarity in return statements */
+/* Used to describe why a job failed */
 enum {
-  sixfive_output_error=-1,
-  sixfive_output_none=0,
-  sixfive_output_success=1
+  sixfive_job_success,
+  sixfive_job_read_error,
+  sixfive_job_assemble_error,
+  sixfive_job_write_error,
+  sixfive_job_listing_error
 };
 
-/* 
- * Used to store identifying information
- * about a label, used on the parser's
- * second pass
+/*****************************/
+/* UTILITY FUNCTIONS         */
+/*****************************/
+
+/*
+ * Returns a time in milliseconds, to be
+ * compared with another
+ */
+double sixfive_now(void){
+#ifdef SIXFIVE_CLOCK
+  struct timespec now;
+
+  clock_gettime(CLOCK_MONOTONIC, &now);
+  return now.tv_sec*1000.0 + now.tv_nsec/1000000.0;
+#else
+  return clock()*1000.0/CLOCKS_PER_SEC;
+#endif
+}
+
+/*
+ * Lets .incbin find files relative to the
+ * directory of the source file at path
  */
-typedef struct sixfive_label {
-  char *string;
-  uint16_t magic;
-  uint16_t address;
-} sixfive_label;
+void sixfive_set_directory(sixfive_ctx *ctx, const char *path){
+  const char *slash = strrchr(path, '/');
+
+  if(slash == NULL){
+    sixfive_ctx_set_directory(ctx, "", 0);
+  } else {
+    sixfive_ctx_set_directory(ctx, path, (slash == path ? 1 : slash - path));
+  }
+}
 
 /*****************************/
-/* LOGGING UTILITIES         */
+/* OUTPUT                    */
 /*****************************/
 
-void sixfive_print_info(int depth, char *str, ...){
-  va_list args;
+/*
+ * Prints the diagnostics of a failed
+ * assembly, one per line, tagged with
+ * the file they belong to if given
+ */
+void sixfive_print_diagnostics(char *path, const sixfive_diagnostic *list, int count){
+  int i;
 
-  switch(depth){
-    case 0:
-      printf(CYAN "> ");
-      break;
-    case 1:
-      printf(GREEN "=> ");
+  for(i=0;i<count;i++){
+    if(list[i].line > 0 && path != NULL){
+      sixfive_print_error("Syntax error in \"%s\" on line %i: %s", path, list[i].line, list[i].message);
+    } else if(list[i].line > 0){
+      sixfive_print_error("Syntax error on line %i: %s", list[i].line, list[i].message);
+    } else if(path != NULL){
+      sixfive_print_error("Error in \"%s\": %s", path, list[i].message);
+    } else {
+      sixfive_print_error("Error: %s", list[i].message);
+    }
+  }
+}
+
+/*
+ * Prints the outcome of a job, returning
+ * 1 if it failed
+ */
+int sixfive_print_job(sixfive_job *job, int tagged, int quiet){
+  switch(job->status){
+    case sixfive_job_success:
+      /* Which would end up in the output, written to stdout */
+      if(!quiet && strcmp(job->out_path, "-") != 0){
+        sixfive_print_info(-1, GREEN "Successfully assembled \"%s\" into \"%s\".", job->in_path, job->out_path);
+      }
+      return 0;
+    case sixfive_job_read_error:
+      sixfive_print_error("Error: unable to open file \"%s\" for reading.", job->in_path);
       break;
-    case 2:
-      printf(YELLOW "==> ");
+    case sixfive_job_assemble_error:
+      sixfive_print_diagnostics(tagged ? job->in_path : NULL, job->diagnostics, job->diagnostic_count);
       break;
-    case 3:
-      printf(BLUE "===> ");
+    case sixfive_job_write_error:
+      sixfive_print_error("Error: unable to write file \"%s\".", job->out_path);
       break;
-    case 4:
-      printf(MAGENTA "====> ");
+    case sixfive_job_listing_error:
+      sixfive_print_error("Error: unable to write the listing of \"%s\".", job->out_path);
       break;
   }
-
-  va_start(args, str);
-  vfprintf(stdout, str, args);
-  printf("\n" RESET);
-  va_end(args);
+  return 1;
 }
 
-void sixfive_print_error(char *str, ...){
-  va_list args;
+/*
+ * Writes an assembled image to the given
+ * path (or stdout, for -), removing the
+ * file if that fails part-way
+ */
+int sixfive_write_output(char *path, const unsigned char *buf, long len){
+  FILE *fp_out;
+  int out = sixfive_output_success;
 
-  va_start(args, str);
-  fprintf(stderr, RED);
-  vfprintf(stderr, str, args);
-  fprintf(stderr, "\n" RESET);
-  va_end(args);
+  if(strcmp(path, "-") == 0){
+    return (fwrite(buf, 1, len, stdout) == (size_t)len && fflush(stdout) == 0 ? sixfive_output_success : sixfive_output_error);
+  }
+
+  fp_out = fopen(path, "wb");
+
+  if(fp_out == NULL){
+    return sixfive_output_error;
+  }
+  if(fwrite(buf, 1, len, fp_out) != (size_t)len){
+    out = sixfive_output_error;
+  }
+  if(fclose(fp_out) != 0 || out == sixfive_output_error){
+    remove(path);
+    out = sixfive_output_error;
+  }
+
+  return out;
 }
 
-/*****************************/
-/* OPERANDS                  */
-/*****************************/
+/*
+ * Returns the path of the listing of an
+ * output file: the same, with .lst in
+ * place of its extension
+ */
+char *sixfive_listing_path(const char *out_path){
+  const char *slash = strrchr(out_path, '/');
+  const char *dot = strrchr(out_path, '.');
+  size_t len = strlen(out_path);
+  char *path;
+
+  if(dot != NULL && dot != out_path && (slash == NULL || dot > slash+1)){
+    len = dot - out_path;
+  }
+  path = malloc(len + 5);
+  if(path != NULL){
+    memcpy(path, out_path, len);
+    strcpy(path + len, ".lst");
+  }
+
+  return path;
+}
 
 /*
- * Returns the type of a given operand,
- * using the hash function
- * 100*strlen(operand)+operand[0], or
- * 0 if its type is not recognized
+ * Orders listed lines by line, then in
+ * output order
  */
-int sixfive_operand_type(char *op){
-  int out;
+int sixfive_listed_compare_line(const void *a, const void *b){
+  const sixfive_listing_line *x = *(const sixfive_listing_line* const*)a;
+  const sixfive_listing_line *y = *(const sixfive_listing_line* const*)b;
 
-  if(op == NULL){
-    return 0;
+  if(x->line != y->line){
+    return (x->line > y->line) - (x->line < y->line);
   }
+  return (x > y) - (x < y);
+}
 
-  out = 100*strlen(op)+op[0];
+/*
+ * Writes a row of the listing, for what
+ * one line assembled into, followed by a
+ * row for every four bytes past the first
+ */
+void sixfive_write_listed(FILE *fp_out, const sixfive_listing_line *listed, unsigned char *out_buf, int num, const char *text, int len){
+  char cycles[16];
+  long at;
+
+  cycles[0] = '\0';
+  if(listed->cycles_max > 0){
+    sprintf(cycles, (listed->cycles == listed->cycles_max ? "%i" : "%i-%i"), listed->cycles, listed->cycles_max);
+    strcat(cycles, (listed->crosses ? "*" : ""));
+  }
+  if(num > 0){
+    fprintf(fp_out, "%5i  %.4lX  ", num, listed->address);
+  } else {
+    fprintf(fp_out, "%5s  %.4lX  ", "", listed->address);
+  }
+  for(at=0;at<4;at++){
+    if(at < listed->length){
+      fprintf(fp_out, "%.2X ", out_buf[listed->offset + at]);
+    } else {
+      fprintf(fp_out, "   ");
+    }
+  }
+  if(len > 0){
+    fprintf(fp_out, "%-7s %.*s\n", cycles, len, text);
+  } else {
+    fprintf(fp_out, "%s\n", cycles);
+  }
+  for(at=4;at<listed->length;at++){
+    if(at % 4 == 0){
+      fprintf(fp_out, "%5s  %.4lX  ", "", listed->address + at);
+    }
+    fprintf(fp_out, (at % 4 == 3 || at+1 == listed->length ? "%.2X\n" : "%.2X "), out_buf[listed->offset + at]);
+  }
+}
+
+/*
+ * Writes a listing of the source beside
+ * the output: every line, along with the
+ * address, bytes, and cycles of those which
+ * assembled into any, four bytes a row
+ *
+ * A line assembled more than once, by a
+ * macro, .include, or .rept, has a row for
+ * each time, after its first without the
+ * line again.
+ */
+int sixfive_write_listing(sixfive_ctx *ctx, char *out_path, const char *src, long len, unsigned char *out_buf){
+  char *path = sixfive_listing_path(out_path);
+  FILE *fp_out;
+  const char *line = src, *end = src + len, *eol;
+  const sixfive_listing_line **sorted;
+  sixfive_listing listing;
+  int num = 1, i = 0, first, length, out = sixfive_output_success;
+
+  sixfive_ctx_listing(ctx, &listing);
+  sorted = malloc(sizeof(sixfive_listing_line*)*(listing.count+1));
+  if(path == NULL || sorted == NULL || (fp_out = fopen(path, "w")) == NULL){
+    free(sorted);
+    free(path);
+    return sixfive_output_error;
+  }
+  for(i=0;i<listing.count;i++){
+    sorted[i] = &listing.list[i];
+  }
+  qsort(sorted, listing.count, sizeof(sixfive_listing_line*), sixfive_listed_compare_line);
+
+  fprintf(fp_out, "; Cycles are the fewest and most each line takes, marked * where\n");
+  fprintf(fp_out, "; crossing a page costs one more\n");
+  fprintf(fp_out, " line  addr  bytes       cycles  source\n");
+  for(i=0;line < end;line=eol+1,num++){
+    eol = memchr(line, '\n', end - line);
+    if(eol == NULL){
+      eol = end;
+    }
+    length = (int)(eol - line - (eol > line && eol[-1] == '\r'));
+    while(i < listing.count && sorted[i]->line < num){
+      i++;
+    }
+    if(i == listing.count || sorted[i]->line != num){
+      fprintf(fp_out, "%5i  %-4s  %-12s%-7s %.*s\n", num, "", "", "", length, line);
+      continue;
+    }
 
-  switch(out){
-    case sixfive_operand_accumulator: /* Fall through */
-    case sixfive_operand_x:
-    case sixfive_operand_x2:
-    case sixfive_operand_y:
-    case sixfive_operand_immediate:
-    case sixfive_operand_absolute:
-    case sixfive_operand_zeropage:
-    case sixfive_operand_indirect:
-    case sixfive_operand_indirect_zeropage:
-    case sixfive_operand_indirect_zeropage2:
-      return out;
+    for(first=i;i < listing.count && sorted[i]->line == num;i++){
+      sixfive_write_listed(fp_out, sorted[i], out_buf, (i == first ? num : 0), line, (i == first ? length : 0));
+    }
   }
 
-  return 0;
+  if(fclose(fp_out) != 0){
+    out = sixfive_output_error;
+  }
+  free(sorted);
+  free(path);
+  return out;
 }
 
 /*
- * Given a byte in text, returns its
- * corresponding value as a char
+ * Returns where to print the reports on a
+ * file written to out_path: stdout, unless
+ * the file itself is written there (for -)
  */
-char sixfive_operand_to_byte(char *operand, int take_upper){
-  char out = 0;
-  int offset = 0;
+FILE *sixfive_report_stream(const char *out_path){
+  return (strcmp(out_path, "-") == 0 ? stderr : stdout);
+}
 
-  if(operand == NULL){
-    return 0;
+/*
+ * Prints a string as JSON, quoted and
+ * with any special characters escaped
+ */
+void sixfive_print_json_string(FILE *fp, const char *str){
+  putc('"', fp);
+  for(;*str != '\0';str++){
+    if(*str == '"' || *str == '\\'){
+      fprintf(fp, "\\%c", *str);
+    } else if((unsigned char)*str < 0x20){
+      fprintf(fp, "\\u%.4x", (unsigned char)*str);
+    } else {
+      putc(*str, fp);
+    }
   }
+  putc('"', fp);
+}
 
-  switch(sixfive_operand_type(operand)){
-    case sixfive_operand_immediate: /* Fall through */
-    case sixfive_operand_indirect_zeropage:
-    case sixfive_operand_indirect_zeropage2:
-      offset = 2;
-      break;
-    case sixfive_operand_absolute:
-      offset = 1+(2*take_upper);
-      break;
-    case sixfive_operand_zeropage:
-      offset = 1;
-      break;
-    case sixfive_operand_indirect:
-      offset = 2+(2*take_upper);
-      break;
+/*
+ * Prints what assembling a file took, to
+ * fp, as a table or as a single line of
+ * JSON
+ */
+void sixfive_print_stats(FILE *fp, char *path, sixfive_stats *stats, double read_ms, double write_ms, int format){
+  double total_ms = read_ms + stats->total_ms + write_ms;
+
+  if(format == sixfive_stats_json){
+    fprintf(fp, "{\"file\":");
+    sixfive_print_json_string(fp, path);
+    fprintf(fp, ",\"read_ms\":%.3f,\"parse_ms\":%.3f,\"layout_ms\":%.3f,\"link_ms\":%.3f,\"write_ms\":%.3f,\"total_ms\":%.3f",
+      read_ms, stats->parse_ms, stats->layout_ms, stats->link_ms, write_ms, total_ms);
+    fprintf(fp, ",\"lines\":%li,\"tokens\":%li,\"allocations\":%li,\"label_lookups\":%li,\"label_probes\":%li,\"label_probe_max\":%li,\"fixups\":%li,\"bytes\":%li,\"relax_passes\":%li,\"relax_saved\":%li,\"optimize_bytes\":%li,\"optimize_cycles\":%li}\n",
+      stats->lines, stats->tokens, stats->allocations, stats->label_lookups, stats->label_probes, stats->label_probe_max, stats->fixups, stats->bytes,
+      stats->relax_passes, stats->relax_saved, stats->optimize_bytes, stats->optimize_cycles);
+    return;
   }
 
-  sscanf(operand+offset, "%2hhx", (unsigned char*)&out);
+  fprintf(fp, "Stats for \"%s\":\n", path);
+  fprintf(fp, "  read          %10.3f ms\n", read_ms);
+  fprintf(fp, "  parse         %10.3f ms\n", stats->parse_ms);
+  fprintf(fp, "  layout        %10.3f ms\n", stats->layout_ms);
+  fprintf(fp, "  link          %10.3f ms\n", stats->link_ms);
+  fprintf(fp, "  write         %10.3f ms\n", write_ms);
+  fprintf(fp, "  total         %10.3f ms\n", total_ms);
+  fprintf(fp, "  lines         %10li\n", stats->lines);
+  fprintf(fp, "  tokens        %10li\n", stats->tokens);
+  fprintf(fp, "  allocations   %10li\n", stats->allocations);
+  fprintf(fp, "  label lookups %10li (%.2f probes each, at most %li)\n", stats->label_lookups,
+    (stats->label_lookups > 0 ? (double)stats->label_probes/stats->label_lookups : 0), stats->label_probe_max);
+  fprintf(fp, "  fixups        %10li\n", stats->fixups);
+  fprintf(fp, "  bytes         %10li\n", stats->bytes);
+  fprintf(fp, "  relaxed       %10li bytes saved, in %li passes\n", stats->relax_saved, stats->relax_passes);
+  fprintf(fp, "  optimized     %10li bytes saved, and %li cycles\n", stats->optimize_bytes, stats->optimize_cycles);
+}
 
-  return out;
+/*
+ * Prints the cycles a job counted between
+ * the batch's two labels, to fp, as text
+ * or as a single line of JSON, returning 1
+ * if they could not be counted
+ */
+int sixfive_print_cycles(FILE *fp, sixfive_batch *batch, sixfive_job *job, int format){
+  if(job->cycles_status == sixfive_output_error){
+    sixfive_print_error("Error in \"%s\": unable to count cycles from \"%s\" to \"%s\", which must both be labels, in order.",
+      job->in_path, batch->cycles_from, batch->cycles_to);
+    return 1;
+  }
+
+  if(format == sixfive_stats_json){
+    fprintf(fp, "{\"file\":");
+    sixfive_print_json_string(fp, job->in_path);
+    fprintf(fp, ",\"from\":");
+    sixfive_print_json_string(fp, batch->cycles_from);
+    fprintf(fp, ",\"to\":");
+    sixfive_print_json_string(fp, batch->cycles_to);
+    fprintf(fp, ",\"cycles_min\":%li,\"cycles_max\":%li}\n", job->cycles_min, job->cycles_max);
+  } else {
+    fprintf(fp, "Cycles from \"%s\" to \"%s\" in \"%s\": %li to %li.\n" RESET, batch->cycles_from, batch->cycles_to, job->in_path, job->cycles_min, job->cycles_max);
+  }
+  return 0;
 }
 
 /*****************************/
-/* LABELS                    */
+/* JOBS                      */
 /*****************************/
 
-int label_index;
-sixfive_label labels[MAX_LABELS_COUNT];
+/*
+ * Assembles stdin a block at a time, as it
+ * arrives, keeping only what the context
+ * has yet to parse
+ */
+int sixfive_job_stream(sixfive_ctx *ctx, unsigned char *out_buf, long *out_len, sixfive_diagnostics *diagnostics){
+  char block[STREAM_BLOCK_LENGTH];
+  size_t len;
+
+  sixfive_stream_begin(ctx);
+  while((len = fread(block, 1, sizeof(block), stdin)) > 0 && sixfive_stream_write(ctx, block, len) != sixfive_output_error);
+
+  return sixfive_stream_end(ctx, out_buf, out_len, diagnostics);
+}
 
 /*
- * Finds a label in the array of known labels,
- * adding one if it does not already exist
+ * Assembles a single job with the given
+ * context and output buffer, writing the
+ * output file only if it succeeds
  */
-int sixfive_label_find(char *str, uint16_t adr){
-  int i;
-  
-/*  printf("%s %x\n", str, adr); */
+void sixfive_job_run(sixfive_batch *batch, sixfive_job *job, sixfive_ctx *ctx, unsigned char *out_buf){
+  sixfive_source source;
+  sixfive_diagnostics diagnostics;
+  sixfive_object object;
+  long out_len = SIXFIVE_OUTPUT_MAX_LENGTH;
+  double start = sixfive_now();
+  int streamed = (strcmp(job->in_path, "-") == 0);
+  int out;
 
-  for(i=0;i<label_index;i++){
-    if(strcmp(str, labels[i].string) == 0){
-      if(adr != ADDRESS_UNKNOWN){
-        labels[i].address = adr;
-      }
-      return i;
+  /* Read as it is assembled, so counted as assembling */
+  if(streamed){
+    sixfive_set_directory(ctx, "");
+    out = sixfive_job_stream(ctx, out_buf, &out_len, &diagnostics);
+  } else if(sixfive_source_open(&source, job->in_path) == sixfive_output_error){
+    job->status = sixfive_job_read_error;
+    return;
+  } else {
+    job->read_ms = sixfive_now() - start;
+    sixfive_set_directory(ctx, job->in_path);
+    out = sixfive_assemble(ctx, source.data, source.length, out_buf, &out_len, &diagnostics);
+  }
+  sixfive_ctx_stats(ctx, &job->stats);
+  sixfive_ctx_object(ctx, &object);
+
+  start = sixfive_now();
+  if(out == sixfive_output_error){
+    /* The context's copy is overwritten by its next job */
+    job->status = sixfive_job_assemble_error;
+    job->diagnostics = malloc(sizeof(sixfive_diagnostic)*(diagnostics.count+1));
+    if(job->diagnostics != NULL){
+      memcpy(job->diagnostics, diagnostics.list, sizeof(sixfive_diagnostic)*diagnostics.count);
+      job->diagnostic_count = diagnostics.count;
+    }
+  } else if(batch->object ? sixfive_write_output(job->out_path, object.data, object.length) == sixfive_output_error :
+                             sixfive_write_output(job->out_path, out_buf, out_len) == sixfive_output_error){
+    job->status = sixfive_job_write_error;
+  } else if(batch->listing && sixfive_write_listing(ctx, job->out_path, source.data, source.length, out_buf) == sixfive_output_error){
+    job->status = sixfive_job_listing_error;
+  } else {
+    job->status = sixfive_job_success;
+    if(batch->cycles_from != NULL){
+      job->cycles_status = sixfive_ctx_cycles(ctx, batch->cycles_from, batch->cycles_to, &job->cycles_min, &job->cycles_max);
     }
   }
+  job->write_ms = (job->status == sixfive_job_assemble_error ? 0 : sixfive_now() - start);
 
-  if(sixfive_operand_type(str) == 0){
-    labels[label_index].string = pj_strdup(str);
-    labels[label_index].magic = LABEL_MAGIC_START+label_index;
-    labels[label_index++].address = adr;
-    return label_index-1;
+  if(!streamed){
+    sixfive_source_close(&source);
   }
-  return sixfive_output_error;
 }
 
-/*****************************/
-/* INSTRUCTIONS              */
-/*****************************/
+/*
+ * Adds a job to the batch, copying
+ * both of its paths
+ */
+int sixfive_batch_add(sixfive_batch *batch, const char *in_path, int in_len, const char *out_path, int out_len){
+  sixfive_job *jobs, *job;
+  int capacity;
+
+  if(batch->count == batch->capacity){
+    capacity = (batch->capacity == 0 ? JOBS_INITIAL_COUNT : batch->capacity*2);
+    jobs = realloc(batch->jobs, sizeof(sixfive_job)*capacity);
+    if(jobs == NULL){
+      return sixfive_output_error;
+    }
+    batch->jobs = jobs;
+    batch->capacity = capacity;
+  }
+
+  job = &batch->jobs[batch->count];
+  memset(job, 0, sizeof(sixfive_job));
+  job->in_path = malloc(in_len+1);
+  job->out_path = malloc(out_len+1);
+  if(job->in_path == NULL || job->out_path == NULL){
+    free(job->in_path);
+    free(job->out_path);
+    return sixfive_output_error;
+  }
+  memcpy(job->in_path, in_path, in_len);
+  job->in_path[in_len] = '\0';
+  memcpy(job->out_path, out_path, out_len);
+  job->out_path[out_len] = '\0';
+  batch->count++;
+
+  return sixfive_output_success;
+}
 
 /*
- * Array from 0x00 to 0xff of (instruction hash)+(type of first arg)+(type of second arg)
- *
- * This may seem to be both a bit of a black box as well as an unnecessarily complex solution
- * to the problem of storing opcodes, however it is advantageous in that:
- *   1. This array can be generated (relatively) automatically, see util/opcode_array.c
- *   2. Memory usage remains relatively low, as there exists one array for every opcode
- *        rather than one array for every instruction
- *   3. Lookup is O(n) rather than O(n^2) (i.e. iterating through single array versus
- *        iterating through an array of instructions and iterating through an array
- *        of an instruction's opcodes
- */
-int sixfive_instruction_opcodes[] = {
-  193451652, 193466527, 0x00,      0x00, 0x00,      193466135, 193450933, 0x00, 193466573, 193466234, 193450762, 0x00, 0x00,      193466335, 193451133, 0x00,
-  193451923, 193466528, 0x00,      0x00, 0x00,      193466323, 193451121, 0x00, 193452535, 193466524, 0x00,      0x00, 0x00,      193466523, 193451321, 0x00,
-  193460940, 193451152, 0x00,      0x00, 193451700, 193450760, 193469314, 0x00, 193466705, 193450859, 193469143, 0x00, 193451900, 193450960, 193469514, 0x00,
-  193451821, 193451153, 0x00,      0x00, 0x00,      193450948, 193469502, 0x00, 193469728, 193451149, 0x00,      0x00, 0x00,      193451148, 193469702, 0x00,
-  193469140, 193455555, 0x00,      0x00, 0x00,      193455163, 193462918, 0x00, 193466558, 193455262, 193462747, 0x00, 193460740, 193455363, 193463118, 0x00,
-  193452112, 193455556, 0x00,      0x00, 0x00,      193455351, 193463106, 0x00, 193452541, 193455552, 0x00,      0x00, 0x00,      193455551, 193463306, 0x00,
-  193469150, 193450821, 0x00,      0x00, 0x00,      193450429, 193469320, 0x00, 193466690, 193450528, 193469149, 0x00, 193460944, 193450629, 193469520, 0x00,
-  193452128, 193450822, 0x00,      0x00, 0x00,      193450617, 193469508, 0x00, 193469734, 193450818, 0x00,      0x00, 0x00,      193450817, 193469708, 0x00,
-  0x00,      193470949, 0x00,      0x00, 193470581, 193470557, 193470580, 0x00, 193453415, 0x00,      193471442, 0x00, 193470781, 193470757, 193470780, 0x00,
-  193451485, 193470950, 0x00,      0x00, 193470769, 193470745, 193470769, 0x00, 193471475, 193470946, 193471460, 0x00, 0x00,      193470945, 0x00,      0x00,
-  193462529, 193462798, 193462528, 0x00, 193462430, 193462406, 193462429, 0x00, 193470707, 193462505, 193470706, 0x00, 193462630, 193462606, 193462629, 0x00,
-  193451501, 193462799, 0x00,      0x00, 193462618, 193462594, 193462618, 0x00, 193452554, 193462795, 193471300, 0x00, 193462818, 193462794, 193462818, 0x00,
-  193453124, 193453309, 0x00,      0x00, 193453025, 193452917, 193453729, 0x00, 193459157, 193453016, 193453414, 0x00, 193453225, 193453117, 193453929, 0x00,
-  193451850, 193453310, 0x00,      0x00, 0x00,      193453105, 193453917, 0x00, 193452536, 193453306, 0x00,      0x00, 0x00,      193453305, 193454117, 0x00,
-  193453123, 193470357, 0x00,      0x00, 193453024, 193469965, 193459471, 0x00, 193459156, 193470064, 193464626, 0x00, 193453224, 193470165, 193459671, 0x00,
-  193451565, 193470358, 0x00,      0x00, 0x00,      193470153, 193459659, 0x00, 193469729, 193470354, 0x00,      0x00, 0x00,      193470353, 193459859, 0x00
-};
+ * Adds a job given as "in.S:out.bin",
+ * split at the last colon
+ */
+int sixfive_batch_add_pair(sixfive_batch *batch, char *pair){
+  char *sep = strrchr(pair, ':');
+
+  if(sep == NULL || sep == pair || sep[1] == '\0'){
+    sixfive_print_error("Error: expected \"in.S:out.bin\", got \"%s\".", pair);
+    return sixfive_output_error;
+  }
+
+  return sixfive_batch_add(batch, pair, sep - pair, sep+1, strlen(sep+1));
+}
 
 /*
- * Given the hash of the current instruction
- * and the arguments passed, writes the
- * appropriate bytes to the output file
- *
- * TODO: Clean argument storage/freeing,
- * functional but overcomplicated as is
- */
-int sixfive_instruction_eval(int instruc, int argc, char **argv, FILE *fp_out, int num, char *buf){
-  unsigned char opcode;
-  unsigned char output[3];
-
-  int type_arg1 = sixfive_operand_type(argv[0]);
-  int type_arg2 = sixfive_operand_type(argv[1]);
-
-  for(opcode=0;opcode<0xff;opcode++){
-    if(sixfive_instruction_opcodes[opcode] == instruc+type_arg1+type_arg2){
-      output[0] = opcode;
-
-      switch(type_arg1){
-        case sixfive_operand_absolute:
-        case sixfive_operand_indirect:
-          output[1] = sixfive_operand_to_byte(argv[0], 1);
-          output[2] = sixfive_operand_to_byte(argv[0], 0);
-          fwrite(output, 1, 3, fp_out);
-          break;
-        case sixfive_operand_immediate:
-        case sixfive_operand_zeropage:
-        case sixfive_operand_indirect_zeropage:
-        case sixfive_operand_indirect_zeropage2:
-          output[1] = sixfive_operand_to_byte(argv[0], 0);
-          fwrite(output, 1, 2, fp_out);
-          break;
-        default:
-          fwrite(output, 1, 1, fp_out);
-          break;
-      }
+ * Adds every job listed in a manifest,
+ * one "in.S out.bin" pair per line, with
+ * blank lines and ;-comments ignored
+ */
+int sixfive_batch_add_manifest(sixfive_batch *batch, char *path){
+  sixfive_source manifest;
+  const char *c, *end, *field[2];
+  int len[2], i, num = 1, out = sixfive_output_success;
+
+  if(sixfive_source_open(&manifest, path) == sixfive_output_error){
+    sixfive_print_error("Error: unable to open file \"%s\" for reading.", path);
+    return sixfive_output_error;
+  }
 
-      if(argc >= 1){
-        free(argv[0]);
+  c = manifest.data;
+  end = manifest.data + manifest.length;
+  while(c < end && out != sixfive_output_error){
+    for(i=0;i<2;i++){
+      while(c < end && (*c == ' ' || *c == '\t' || *c == '\r')){
+        c++;
       }
-      if(argc == 2){
-        free(argv[1]);
+      field[i] = c;
+      while(c < end && *c != ' ' && *c != '\t' && *c != '\r' && *c != '\n' && *c != ';'){
+        c++;
       }
-      free(argv);
-      return sixfive_output_success;
+      len[i] = c - field[i];
     }
+    while(c < end && (*c == ' ' || *c == '\t' || *c == '\r')){
+      c++;
+    }
+
+    if(len[0] > 0 && (len[1] == 0 || (c < end && *c != '\n' && *c != ';'))){
+      sixfive_print_error("Error in \"%s\" on line %i: expected \"in.S out.bin\".", path, num);
+      out = sixfive_output_error;
+    } else if(len[0] > 0){
+      out = sixfive_batch_add(batch, field[0], len[0], field[1], len[1]);
+    }
+
+    while(c < end && *c++ != '\n');
+    num++;
   }
 
-  if(argc >= 1){
-    free(argv[0]);
+  sixfive_source_close(&manifest);
+  return out;
+}
+
+/*
+ * Takes jobs from the batch until none
+ * are left, with a context and output
+ * buffer of its own
+ */
+void *sixfive_batch_worker(void *arg){
+  sixfive_batch *batch = arg;
+  sixfive_ctx *ctx = sixfive_ctx_new();
+  unsigned char *out_buf = malloc(SIXFIVE_OUTPUT_MAX_LENGTH);
+  int next;
+
+  if(ctx != NULL){
+    sixfive_ctx_set_threads(ctx, batch->job_threads);
+    sixfive_ctx_set_optimize(ctx, batch->optimize);
+    sixfive_ctx_set_object(ctx, batch->object);
+    sixfive_ctx_set_listing(ctx, batch->listing || batch->cycles_from != NULL);
+    sixfive_ctx_set_stats(ctx, batch->stats != sixfive_stats_none);
+    sixfive_ctx_set_cache(ctx, batch->cache);
   }
-  if(argc == 2){
-    free(argv[1]);
+
+  for(;;){
+#ifdef SIXFIVE_THREADS
+    pthread_mutex_lock(&batch->lock);
+#endif
+    next = batch->next++;
+#ifdef SIXFIVE_THREADS
+    pthread_mutex_unlock(&batch->lock);
+#endif
+    if(next >= batch->count){
+      break;
+    }
+
+    if(ctx == NULL || out_buf == NULL){
+      batch->jobs[next].status = sixfive_job_assemble_error;
+    } else {
+      sixfive_job_run(batch, &batch->jobs[next], ctx, out_buf);
+    }
   }
-  free(argv);
-  return sixfive_output_error;
+
+  free(out_buf);
+  sixfive_ctx_free(ctx);
+  return NULL;
 }
 
 /*
- * Returns the hash of the given instruction
- * mnemonic, used to access the above array
- * and determine an instruction's opcode
+ * Assembles every job of the batch on
+ * the given number of threads (or on
+ * this one, without POSIX threads)
  */
-#define sixfive_instruction_type(buf) (djb2hash(buf))
+void sixfive_batch_run(sixfive_batch *batch, int threads){
+#ifdef SIXFIVE_THREADS
+  pthread_t pool[MAX_THREADS];
+  int i, started = 0;
+#endif
+
+  /* A lone file is split between the threads instead */
+  batch->job_threads = 1;
+  if(batch->count == 1){
+    batch->job_threads = threads;
+  }
+  if(threads > batch->count){
+    threads = batch->count;
+  }
+  /* Without one, each context keeps its own */
+  batch->cache = sixfive_cache_new();
+
+#ifdef SIXFIVE_THREADS
+  pthread_mutex_init(&batch->lock, NULL);
+  for(i=1;i<threads;i++){
+    if(pthread_create(&pool[started], NULL, sixfive_batch_worker, batch) == 0){
+      started++;
+    }
+  }
+#endif
+
+  /* This thread works alongside the pool */
+  sixfive_batch_worker(batch);
+
+#ifdef SIXFIVE_THREADS
+  for(i=0;i<started;i++){
+    pthread_join(pool[i], NULL);
+  }
+  pthread_mutex_destroy(&batch->lock);
+#endif
+  sixfive_cache_free(batch->cache);
+  batch->cache = NULL;
+}
 
 /*****************************/
-/* PARSER                    */
+/* WATCH                     */
 /*****************************/
 
 /*
- * Parses a single line of input,
- * using spaces, commas, and EOFs
- * to evaluate tokens
+ * Assembles a file again whenever it is
+ * modified, until interrupted, keeping
+ * the work done on every part of it that
+ * did not change
  *
- * TODO: Labels, directives, and
- * variables
- */
-int sixfive_parse_line(char *line, int num, FILE *fp_out){
-  int current_state = sixfive_state_unknown;
-  int current_instruction = -1;
-  int current_argument = 0;
-  int label_ind = 0;
-  int buf_ind = 0;
-  char *c = line;
-  char buf[MAX_LINE_LENGTH];
-  char **args = calloc(sizeof(char*)*MAX_OPERAND_LENGTH, 2);
-#ifdef DEBUG_BUILD
-  sixfive_print_info(1, "Start parsing line.");
-#endif
-  do {
-    switch(*c){
-      case ';':
-#ifdef DEBUG_BUILD
-        sixfive_print_info(2, "Comment");
-#endif
-        current_state = sixfive_state_comment;
-        goto finish_parsing_line;
-      case ':':
-#ifdef DEBUG_BUILD
-        sixfive_print_info(2, "Label: %s", buf);
-#endif
-        current_state = sixfive_state_label;
-        buf[buf_ind] = '\0';
-        sixfive_label_find(buf, ftell(fp_out));
-        break;
-      case '.':
-#ifdef DEBUG_BUILD
-        sixfive_print_info(2, "Directive");
-#endif
-        current_state = sixfive_state_directive;
-        break;
-      case ' ': /* Fall through */
-      case ',':
-      case '\0':
-        if(buf_ind == 0){
-          break;
+ * Takes its options from the (otherwise
+ * empty) batch.
+ */
+int sixfive_watch(sixfive_batch *batch, char *in_path, char *out_path, int threads){
+#ifdef SIXFIVE_WATCH
+  struct timespec interval;
+  struct stat st;
+  time_t mtime = 0;
+  off_t size = -1;
+  sixfive_source source;
+  sixfive_diagnostics diagnostics;
+  sixfive_stats build;
+  sixfive_object object;
+  sixfive_job job;
+  sixfive_ctx *ctx = sixfive_ctx_new();
+  unsigned char *out_buf = malloc(SIXFIVE_OUTPUT_MAX_LENGTH);
+  long out_len;
+  double start, read_ms, write_ms;
+  int stats = batch->stats;
+
+  if(ctx == NULL || out_buf == NULL){
+    sixfive_print_error("Error: out of memory.");
+    free(out_buf);
+    sixfive_ctx_free(ctx);
+    return 1;
+  }
+  sixfive_ctx_set_threads(ctx, threads);
+  sixfive_ctx_set_optimize(ctx, batch->optimize);
+  sixfive_ctx_set_object(ctx, batch->object);
+  sixfive_ctx_set_listing(ctx, batch->listing || batch->cycles_from != NULL);
+  sixfive_ctx_set_stats(ctx, stats != sixfive_stats_none);
+  sixfive_set_directory(ctx, in_path);
+  memset(&job, 0, sizeof(sixfive_job));
+  job.in_path = in_path;
+
+  interval.tv_sec = 0;
+  interval.tv_nsec = WATCH_INTERVAL_MS*1000000L;
+  sixfive_print_info(-1, CYAN "Watching \"%s\" for changes, press Ctrl-C to stop.", in_path);
+  fflush(stdout);
+
+  for(;;){
+    /* Editors may replace the file, leaving it briefly missing */
+    if(stat(in_path, &st) == 0 && (st.st_mtime != mtime || st.st_size != size)){
+      mtime = st.st_mtime;
+      size = st.st_size;
+
+      start = sixfive_now();
+      if(sixfive_source_open(&source, in_path) == sixfive_output_error){
+        sixfive_print_error("Error: unable to open file \"%s\" for reading.", in_path);
+      } else {
+        read_ms = sixfive_now() - start;
+        out_len = SIXFIVE_OUTPUT_MAX_LENGTH;
+        start = sixfive_now();
+        if(sixfive_reassemble(ctx, source.data, source.length, out_buf, &out_len, &diagnostics) == sixfive_output_error){
+          sixfive_print_diagnostics(NULL, diagnostics.list, diagnostics.count);
+          write_ms = 0;
+        } else {
+          sixfive_ctx_stats(ctx, &build);
+          sixfive_ctx_object(ctx, &object);
+          start = sixfive_now();
+          if(batch->object ? sixfive_write_output(out_path, object.data, object.length) == sixfive_output_error :
+                             sixfive_write_output(out_path, out_buf, out_len) == sixfive_output_error){
+            sixfive_print_error("Error: unable to write file \"%s\".", out_path);
+          } else if(batch->listing && sixfive_write_listing(ctx, out_path, source.data, source.length, out_buf) == sixfive_output_error){
+            sixfive_print_error("Error: unable to write the listing of \"%s\".", out_path);
+          } else if(stats != sixfive_stats_json){
+            sixfive_print_info(-1, GREEN "Assembled \"%s\" into \"%s\" in %.2f ms.", in_path, out_path, build.total_ms);
+          }
+          write_ms = sixfive_now() - start;
+          if(batch->cycles_from != NULL){
+            job.cycles_status = sixfive_ctx_cycles(ctx, batch->cycles_from, batch->cycles_to, &job.cycles_min, &job.cycles_max);
+            sixfive_print_cycles(sixfive_report_stream(out_path), batch, &job, stats);
+          }
         }
-        buf[buf_ind] = '\0';
-        buf_ind = 0;
-        switch(current_state){
-          case sixfive_state_unknown:
-          case sixfive_state_instruction:
-#ifdef DEBUG_BUILD
-              sixfive_print_info(3, "Instruction: %s", buf);
-#endif
-            current_state = sixfive_state_operand;
-            current_instruction = sixfive_instruction_type((unsigned char*)str_uppercase(buf));
-            break;
-          case sixfive_state_operand:
-#ifdef DEBUG_BUILD
-            sixfive_print_info(4, "Operand: %s", buf);
-#endif
-            if((label_ind = sixfive_label_find(buf, ADDRESS_UNKNOWN)) != sixfive_output_error){
-              sprintf(buf, "$%.4x", labels[label_ind].magic);
-            }
-            args[current_argument++] = pj_strdup(buf);
-            break;
-          case sixfive_state_label:
-            current_state = sixfive_state_instruction;
-            break;
-          case sixfive_state_directive:
-            break;
+        if(stats != sixfive_stats_none){
+          sixfive_ctx_stats(ctx, &build);
+          sixfive_print_stats(sixfive_report_stream(out_path), in_path, &build, read_ms, write_ms, stats);
         }
-        break;
-      default:
-        buf[buf_ind++] = *c;
-        break;
+        sixfive_source_close(&source);
+      }
+      fflush(stdout);
     }
-  } while(*c++);
-
-finish_parsing_line:;
-#ifdef DEBUG_BUILD
-  sixfive_print_info(1, "End parsing line.");
+    nanosleep(&interval, NULL);
+  }
+#else
+  sixfive_print_error("Error: --watch is not supported on this platform.");
+  return 1;
 #endif
+}
+
+/*****************************/
+/* RUN                       */
+/*****************************/
 
-  if(current_instruction > -1){
-    return sixfive_instruction_eval(current_instruction, current_argument, args, fp_out, num, buf);
+/* Orders hotspots by label, to merge those of the same one */
+int sixfive_hotspot_compare_label(const void *a, const void *b){
+  const sixfive_hotspot *x = a, *y = b;
+
+  if(x->label == NULL || y->label == NULL){
+    return (x->label != NULL) - (y->label != NULL);
   }
+  return strcmp(x->label, y->label);
+}
 
-  free(args);
-  return sixfive_output_none;
+/* Orders hotspots by cycles, most first */
+int sixfive_hotspot_compare_cycles(const void *a, const void *b){
+  const sixfive_hotspot *x = a, *y = b;
+
+  return (x->cycles < y->cycles) - (x->cycles > y->cycles);
+}
+
+/* Orders profiled lines by cycles, most first */
+int sixfive_profile_compare_cycles(const void *a, const void *b){
+  const sixfive_profile_line *x = *(const sixfive_profile_line* const*)a;
+  const sixfive_profile_line *y = *(const sixfive_profile_line* const*)b;
+
+  if(x->cycles != y->cycles){
+    return (x->cycles < y->cycles) - (x->cycles > y->cycles);
+  }
+  return (x->line > y->line) - (x->line < y->line);
 }
 
 /*
- * Replaces all instances of a label's
- * "magic" with that label's address
- *
- * TODO: Support magic longer than 16
- * bits
+ * Prints the labels whose code took the
+ * most cycles in a run, counting each
+ * line towards the label before it, and
+ * how many times each was entered
  */
-int sixfive_parse_labels(FILE *fp_out, int num){
-  int i, ind = 0;
-  int len_max = ftell(fp_out);
-  uint16_t tmp = 0;
+int sixfive_print_hot_labels(sixfive_profile *profile, unsigned long total, int top){
+  sixfive_hotspot *spots;
+  const sixfive_profile_line *line;
+  int i, count = 0, merged = 0, entered = 0;
+
+  spots = malloc(sizeof(sixfive_hotspot)*(profile->count+1));
+  if(spots == NULL){
+    return sixfive_output_error;
+  }
 
-#ifdef DEBUG_BUILD
-  sixfive_print_info(1, "Start replacing labels.");
-#endif
+  /* Lines are in output order, so a label's usually follow each other */
+  for(i=0;i<profile->count;i++){
+    line = &profile->list[i];
+    if(count == 0 || spots[count-1].label != line->label){
+      spots[count].label = line->label;
+      spots[count].count = 0;
+      spots[count++].cycles = 0;
+      entered = 0;
+    }
+    /* Entered at its first line with code, not at a .org or label before it */
+    if(!entered && line->label_offset == 0 && line->length > 0){
+      spots[count-1].count = line->count;
+      entered = 1;
+    }
+    spots[count-1].cycles += line->cycles;
+  }
+  qsort(spots, count, sizeof(sixfive_hotspot), sixfive_hotspot_compare_label);
+  for(i=0;i<count;i++){
+    if(merged > 0 && sixfive_hotspot_compare_label(&spots[merged-1], &spots[i]) == 0){
+      spots[merged-1].cycles += spots[i].cycles;
+      spots[merged-1].count += spots[i].count;
+    } else {
+      spots[merged++] = spots[i];
+    }
+  }
+  qsort(spots, merged, sizeof(sixfive_hotspot), sixfive_hotspot_compare_cycles);
 
-  fseek(fp_out, 0, SEEK_SET);
-  while(ind++ < len_max){
-    tmp <<= 8;
-    tmp |= fgetc(fp_out);
-    for(i=0;i<label_index;i++){
-      if(((tmp >> 8) | ((tmp&0xff) << 8)) == labels[i].magic){
-        if(labels[i].address == ADDRESS_UNKNOWN){
-          sixfive_print_error("Syntax error on line %i: unrecognized operand/label \"%s\".", num, labels[i].string);
-          return sixfive_output_error;
-        } else {
+  printf("Hottest labels:\n");
+  printf("%12s  %6s  %10s  %s\n", "cycles", "%", "entered", "label");
+  for(i=0;i<merged && i<top && spots[i].cycles > 0;i++){
+    printf("%12lu  %6.2f  %10lu  %s\n", spots[i].cycles, 100.0*spots[i].cycles/total, spots[i].count,
+      (spots[i].label == NULL ? "(start)" : spots[i].label));
+  }
 
-#ifdef DEBUG_BUILD
-          sixfive_print_info(2, "Label \"%s\" becomes \"%.4x\"", labels[i].string, labels[i].address);
-#endif
+  free(spots);
+  return sixfive_output_success;
+}
 
-          fseek(fp_out, -2, SEEK_CUR);
-          fwrite(&labels[i].address, 1, 2, fp_out);
+/*
+ * Prints the lines which took the most
+ * cycles in a run, along with where they
+ * are and the source of each
+ */
+int sixfive_print_hot_lines(sixfive_profile *profile, unsigned long total, int top, const char *src, long len){
+  const sixfive_profile_line **hot;
+  const char **starts, *start, *c;
+  int i, count = 0, lines = 1, num;
+  long at;
+
+  /* Where each line of the source starts, to print it */
+  for(at=0;at<len;at++){
+    lines += (src[at] == '\n');
+  }
+  hot = malloc(sizeof(sixfive_profile_line*)*(profile->count+1));
+  starts = malloc(sizeof(char*)*(lines+1));
+  if(hot == NULL || starts == NULL){
+    free(hot);
+    free(starts);
+    return sixfive_output_error;
+  }
+  starts[0] = src;
+  for(at=0,num=1;at<len;at++){
+    if(src[at] == '\n'){
+      starts[num++] = src + at + 1;
+    }
+  }
+  starts[lines] = src + len + 1;
+
+  for(i=0;i<profile->count;i++){
+    if(profile->list[i].cycles > 0){
+      hot[count++] = &profile->list[i];
+    }
+  }
+  qsort(hot, count, sizeof(sixfive_profile_line*), sixfive_profile_compare_cycles);
+
+  printf("Hottest lines:\n");
+  printf("%12s  %6s  %10s  %5s  %-4s  %s\n", "cycles", "%", "count", "line", "addr", "source");
+  for(i=0;i<count && i<top;i++){
+    num = hot[i]->line;
+    start = starts[num-1];
+    c = starts[num] - 1;
+    while(start < c && (*start == ' ' || *start == '\t')){
+      start++;
+    }
+    while(c > start && c[-1] == '\r'){
+      c--;
+    }
+    printf("%12lu  %6.2f  %10lu  %5i  %.4lX  %.*s\n", hot[i]->cycles, 100.0*hot[i]->cycles/total, hot[i]->count,
+      num, hot[i]->address, (int)(c - start), start);
+  }
+
+  free(starts);
+  free(hot);
+  return sixfive_output_success;
+}
+
+/*
+ * Assembles a file and runs it from its
+ * origin, then prints why it stopped and
+ * where it spent its cycles, returning 1
+ * if it could not be run to a BRK or RTS
+ */
+int sixfive_run_file(sixfive_batch *batch, char *in_path, int threads, unsigned long limit, int top){
+  static const char *reasons[] = {"reached a BRK", "returned", "reached the cycle limit", "reached an illegal opcode"};
+  sixfive_source source;
+  sixfive_diagnostics diagnostics;
+  sixfive_profile profile;
+  sixfive_run run;
+  sixfive_ctx *ctx = sixfive_ctx_new();
+  unsigned char *out_buf = malloc(SIXFIVE_OUTPUT_MAX_LENGTH);
+  long out_len = SIXFIVE_OUTPUT_MAX_LENGTH;
+  int out = 1;
+
+  if(ctx == NULL || out_buf == NULL){
+    sixfive_print_error("Error: out of memory.");
+    free(out_buf);
+    sixfive_ctx_free(ctx);
+    return 1;
+  }
+  if(sixfive_source_open(&source, in_path) == sixfive_output_error){
+    sixfive_print_error("Error: unable to open file \"%s\" for reading.", in_path);
+    free(out_buf);
+    sixfive_ctx_free(ctx);
+    return 1;
+  }
+
+  sixfive_ctx_set_threads(ctx, threads);
+  sixfive_ctx_set_optimize(ctx, batch->optimize);
+  sixfive_ctx_set_listing(ctx, 1);
+  sixfive_set_directory(ctx, in_path);
+  if(sixfive_assemble(ctx, source.data, source.length, out_buf, &out_len, &diagnostics) == sixfive_output_error){
+    sixfive_print_diagnostics(NULL, diagnostics.list, diagnostics.count);
+  } else if(sixfive_ctx_run(ctx, limit, &run) == sixfive_output_error ||
+            sixfive_ctx_profile(ctx, &profile) == sixfive_output_error){
+    sixfive_print_error("Error: out of memory.");
+  } else {
+    sixfive_print_info(-1, "%sRan \"%s\" from $%.4lX until it %s at $%.4lX: %lu instructions, %lu cycles.",
+      (run.status == sixfive_run_brk || run.status == sixfive_run_return ? GREEN : YELLOW), in_path, sixfive_ctx_origin(ctx), reasons[run.status], run.pc, run.instructions, run.cycles);
+    if(run.cycles > 0 &&
+       (sixfive_print_hot_labels(&profile, run.cycles, top) == sixfive_output_error ||
+        sixfive_print_hot_lines(&profile, run.cycles, top, source.data, source.length) == sixfive_output_error)){
+      sixfive_print_error("Error: out of memory.");
+    } else {
+      out = (run.status == sixfive_run_brk || run.status == sixfive_run_return ? 0 : 1);
+    }
+  }
+
+  sixfive_source_close(&source);
+  free(out_buf);
+  sixfive_ctx_free(ctx);
+  return out;
+}
+
+/*****************************/
+/* LINK                      */
+/*****************************/
+
+/*
+ * Parses an address given as $hex or as
+ * a C number, returning -1 if it is not
+ * one
+ */
+long sixfive_parse_address(const char *str){
+  char *end;
+  long address;
+
+  if(*str == '$'){
+    address = strtol(str+1, &end, 16);
+  } else {
+    address = strtol(str, &end, 0);
+  }
+
+  return (*str == '\0' || *end != '\0' || address < 0 || address > 0xffff ? -1 : address);
+}
+
+/*
+ * Links the objects at paths into a program
+ * at out_path, starting at origin (or, if it
+ * is -1, wherever the first object does),
+ * returning 1 if it could not
+ */
+int sixfive_link_files(char *out_path, char **paths, int count, long origin, int stats){
+  sixfive_source *sources = malloc(sizeof(sixfive_source)*count);
+  sixfive_object *objects = malloc(sizeof(sixfive_object)*count);
+  sixfive_diagnostics diagnostics;
+  sixfive_stats build;
+  sixfive_ctx *ctx = sixfive_ctx_new();
+  unsigned char *out_buf = malloc(SIXFIVE_OUTPUT_MAX_LENGTH);
+  long out_len = SIXFIVE_OUTPUT_MAX_LENGTH;
+  double start = sixfive_now(), read_ms, write_ms = 0;
+  int i, opened = 0, out = 1;
+
+  if(sources == NULL || objects == NULL || ctx == NULL || out_buf == NULL){
+    sixfive_print_error("Error: out of memory.");
+    count = 0;
+  }
+
+  for(;opened<count;opened++){
+    if(sixfive_source_open(&sources[opened], paths[opened]) == sixfive_output_error){
+      sixfive_print_error("Error: unable to open file \"%s\" for reading.", paths[opened]);
+      break;
+    }
+    objects[opened].data = (const unsigned char*)sources[opened].data;
+    objects[opened].length = sources[opened].length;
+    objects[opened].name = paths[opened];
+  }
+  read_ms = sixfive_now() - start;
+
+  if(opened == count && count > 0){
+    sixfive_ctx_set_stats(ctx, stats != sixfive_stats_none);
+    if(sixfive_link(ctx, objects, count, origin, out_buf, &out_len, &diagnostics) == sixfive_output_error){
+      sixfive_print_diagnostics(NULL, diagnostics.list, diagnostics.count);
+    } else {
+      start = sixfive_now();
+      if(sixfive_write_output(out_path, out_buf, out_len) == sixfive_output_error){
+        sixfive_print_error("Error: unable to write file \"%s\".", out_path);
+      } else {
+        if(stats != sixfive_stats_json && strcmp(out_path, "-") != 0){
+          sixfive_print_info(-1, GREEN "Successfully linked %i objects into \"%s\".", count, out_path);
         }
+        out = 0;
       }
+      write_ms = sixfive_now() - start;
+    }
+    if(stats != sixfive_stats_none){
+      sixfive_ctx_stats(ctx, &build);
+      sixfive_print_stats(sixfive_report_stream(out_path), out_path, &build, read_ms, write_ms, stats);
     }
   }
 
-#ifdef DEBUG_BUILD
-  sixfive_print_info(1, "End replacing labels.");
-#endif
+  for(i=0;i<opened;i++){
+    sixfive_source_close(&sources[i]);
+  }
+  free(sources);
+  free(objects);
+  free(out_buf);
+  sixfive_ctx_free(ctx);
+  return out;
+}
+
+/*****************************/
+/* DISASSEMBLY               */
+/*****************************/
+
+/*
+ * Disassembles the program at in_path, which
+ * starts at origin (or, if it is -1, at 0),
+ * into source at out_path (or stdout, for -),
+ * returning 1 if it could not
+ */
+int sixfive_disassemble_file(char *in_path, char *out_path, long origin, int stats){
+  sixfive_source source;
+  sixfive_diagnostics diagnostics;
+  sixfive_stats build;
+  sixfive_ctx *ctx = sixfive_ctx_new();
+  const char *text;
+  long text_len;
+  double start = sixfive_now(), read_ms, write_ms = 0;
+  int out = 1;
+
+  if(ctx == NULL){
+    sixfive_print_error("Error: out of memory.");
+    return 1;
+  }
+  if(sixfive_source_open(&source, in_path) == sixfive_output_error){
+    sixfive_print_error("Error: unable to open file \"%s\" for reading.", in_path);
+    sixfive_ctx_free(ctx);
+    return 1;
+  }
+  read_ms = sixfive_now() - start;
+
+  sixfive_ctx_set_stats(ctx, stats != sixfive_stats_none);
+  if(sixfive_disassemble(ctx, (const unsigned char*)source.data, source.length, (origin == -1 ? 0 : origin), &text, &text_len, &diagnostics) == sixfive_output_error){
+    if(diagnostics.count == 0){
+      sixfive_print_error("Error: out of memory.");
+    }
+    sixfive_print_diagnostics(in_path, diagnostics.list, diagnostics.count);
+  } else {
+    start = sixfive_now();
+    if(sixfive_write_output(out_path, (const unsigned char*)text, text_len) == sixfive_output_error){
+      sixfive_print_error("Error: unable to write file \"%s\".", out_path);
+    } else {
+      if(stats != sixfive_stats_json && strcmp(out_path, "-") != 0){
+        sixfive_print_info(-1, GREEN "Successfully disassembled \"%s\" into \"%s\".", in_path, out_path);
+      }
+      out = 0;
+    }
+    write_ms = sixfive_now() - start;
+  }
+  if(stats != sixfive_stats_none){
+    sixfive_ctx_stats(ctx, &build);
+    sixfive_print_stats(sixfive_report_stream(out_path), in_path, &build, read_ms, write_ms, stats);
+  }
+
+  sixfive_source_close(&source);
+  sixfive_ctx_free(ctx);
+  return out;
+}
+
+/*****************************/
+/* SERVE                     */
+/*****************************/
+
+/*
+ * Reads a little-endian number of the given
+ * number of bytes from a request into *value,
+ * failing if the stream ends first
+ */
+int sixfive_serve_get(FILE *in, int bytes, unsigned long *value){
+  unsigned char buf[4];
+  int i;
+
+  if(fread(buf, 1, bytes, in) != (size_t)bytes){
+    return sixfive_output_error;
+  }
+  *value = 0;
+  for(i=bytes-1;i>=0;i--){
+    *value = (*value << 8) | buf[i];
+  }
 
   return sixfive_output_success;
 }
 
 /*
- * Parses an entire string of
- * input, tokenizing by line
+ * Writes a little-endian number of the given
+ * number of bytes to a response
  */
-int sixfive_parse_string(char *str, FILE *fp_out){
-  int num = 1;
-  char *line = strtok(str, "\n");
-  label_index = 0;
+int sixfive_serve_put(FILE *out, unsigned long value, int bytes){
+  unsigned char buf[4];
+  int i;
 
-#ifdef DEBUG_BUILD
-  sixfive_print_info(0, "Start parsing file.");
-#endif
+  for(i=0;i<bytes;i++){
+    buf[i] = (value >> (8*i)) & 0xff;
+  }
 
-  while(line != NULL){
-    if(sixfive_parse_line(line, num++, fp_out) == sixfive_output_error){
-      sixfive_print_error("Syntax error on line %i: invalid instruction/operand combination: \"%s\"", num-1, line);
-      return sixfive_output_error;
+  return (fwrite(buf, 1, bytes, out) == (size_t)bytes ? sixfive_output_success : sixfive_output_error);
+}
+
+/*
+ * Answers each request on a stream, until
+ * it ends, with a warm context (and so
+ * parsing only what changed since the last
+ * request, if it was for the same file)
+ *
+ * A request is its source's length (4 bytes),
+ * its path's length (2), and its flags (1),
+ * followed by its path (which .include and
+ * .incbin find files relative to, or empty
+ * for the current directory) and source.  A
+ * response is 0 for success or 1 for failure
+ * (1 byte), the output's length (4) and the
+ * output, then how many diagnostics follow
+ * (4), each its line (4), its message's
+ * length (2), and its message.  Numbers are
+ * little-endian.
+ */
+int sixfive_serve_stream(sixfive_server *server, sixfive_ctx *ctx, FILE *in, FILE *out){
+  sixfive_diagnostics diagnostics;
+  sixfive_object object;
+  unsigned char *out_buf = malloc(SIXFIVE_OUTPUT_MAX_LENGTH), *output;
+  unsigned long src_len, path_len, flags;
+  char *buf = NULL, *tmp;
+  long capacity = 0, out_len;
+  int i, status, len, out_status = sixfive_output_success;
+
+  if(out_buf == NULL){
+    return sixfive_output_error;
+  }
+
+  while(out_status != sixfive_output_error && sixfive_serve_get(in, 4, &src_len) != sixfive_output_error){
+    if(sixfive_serve_get(in, 2, &path_len) == sixfive_output_error ||
+       sixfive_serve_get(in, 1, &flags) == sixfive_output_error ||
+       src_len > SERVE_MAX_REQUEST_LENGTH){
+      out_status = sixfive_output_error;
+      break;
+    }
+    if((long)(path_len + src_len + 1) > capacity){
+      capacity = path_len + src_len + 1;
+      tmp = realloc(buf, capacity);
+      if(tmp == NULL){
+        out_status = sixfive_output_error;
+        break;
+      }
+      buf = tmp;
+    }
+    if(fread(buf, 1, path_len + src_len, in) != path_len + src_len){
+      out_status = sixfive_output_error;
+      break;
+    }
+    /* The source follows the path, which only needs to end while it is used */
+    tmp = buf + path_len;
+    len = *tmp;
+    *tmp = '\0';
+    sixfive_set_directory(ctx, buf);
+    *tmp = len;
+
+    flags |= server->flags;
+    sixfive_ctx_set_optimize(ctx, flags & sixfive_serve_optimize);
+    sixfive_ctx_set_object(ctx, flags & sixfive_serve_object);
+    out_len = SIXFIVE_OUTPUT_MAX_LENGTH;
+    status = sixfive_reassemble(ctx, buf + path_len, src_len, out_buf, &out_len, &diagnostics);
+
+    output = out_buf;
+    if(status == sixfive_output_error){
+      out_len = 0;
+    } else if(flags & sixfive_serve_object){
+      sixfive_ctx_object(ctx, &object);
+      output = (unsigned char*)object.data;
+      out_len = object.length;
+    }
+    out_status = sixfive_serve_put(out, (status == sixfive_output_error), 1);
+    out_status |= sixfive_serve_put(out, out_len, 4);
+    if(out_len > 0 && fwrite(output, 1, out_len, out) != (size_t)out_len){
+      out_status = sixfive_output_error;
+    }
+    out_status |= sixfive_serve_put(out, (status == sixfive_output_error ? diagnostics.count : 0), 4);
+    for(i=0;status == sixfive_output_error && i<diagnostics.count;i++){
+      len = strlen(diagnostics.list[i].message);
+      out_status |= sixfive_serve_put(out, diagnostics.list[i].line, 4);
+      out_status |= sixfive_serve_put(out, len, 2);
+      if(fwrite(diagnostics.list[i].message, 1, len, out) != (size_t)len){
+        out_status = sixfive_output_error;
+      }
+    }
+    if(fflush(out) != 0){
+      out_status = sixfive_output_error;
     }
-    line = strtok(NULL, "\n");
   }
-  
-#ifdef DEBUG_BUILD
-  sixfive_print_info(0, "End parsing file.");
+
+  free(buf);
+  free(out_buf);
+  return out_status;
+}
+
+/*
+ * Serves each connection to the server's
+ * socket in turn, with a context of its
+ * own, until the socket is closed
+ */
+void *sixfive_serve_worker(void *arg){
+#ifdef SIXFIVE_SOCKETS
+  sixfive_server *server = arg;
+  sixfive_ctx *ctx = sixfive_ctx_new();
+  FILE *in, *out;
+  int fd, copy;
+
+  if(ctx == NULL){
+    return NULL;
+  }
+  sixfive_ctx_set_cache(ctx, server->cache);
+
+  while((fd = accept(server->listener, NULL, NULL)) != -1 || errno == EINTR || errno == ECONNABORTED){
+    if(fd == -1){
+      continue;
+    }
+    /* Each direction is buffered apart, as a stream cannot switch without seeking */
+    copy = dup(fd);
+    in = fdopen(fd, "rb");
+    out = (copy != -1 ? fdopen(copy, "wb") : NULL);
+    if(in != NULL && out != NULL){
+      sixfive_serve_stream(server, ctx, in, out);
+    }
+    if(in != NULL){
+      fclose(in);
+    } else {
+      close(fd);
+    }
+    if(out != NULL){
+      fclose(out);
+    } else if(copy != -1){
+      close(copy);
+    }
+  }
+
+  sixfive_ctx_free(ctx);
+#else
+  (void)arg;
 #endif
+  return NULL;
+}
 
-  return sixfive_parse_labels(fp_out, num);
+/*
+ * Answers requests, as described by
+ * sixfive_serve_stream, on stdin (with
+ * responses on stdout) until it ends, or
+ * if path is given, on each connection
+ * to a Unix socket there, until killed
+ *
+ * Connections are answered by up to the
+ * given number of threads at once, which
+ * share the files they .include.
+ */
+int sixfive_serve(char *path, int threads, int flags){
+  sixfive_server server;
+  sixfive_ctx *ctx;
+  int out = 0;
+#ifdef SIXFIVE_SOCKETS
+  struct sockaddr_un address;
+  struct stat st;
+  pthread_t pool[MAX_THREADS];
+  int i, started = 0;
+#endif
+
+  server.listener = -1;
+  server.flags = flags;
+  server.cache = sixfive_cache_new();
+  if(server.cache == NULL){
+    sixfive_print_error("Error: out of memory.");
+    return 1;
+  }
+
+  if(path == NULL){
+    ctx = sixfive_ctx_new();
+    if(ctx == NULL){
+      sixfive_print_error("Error: out of memory.");
+      out = 1;
+    } else {
+      sixfive_ctx_set_cache(ctx, server.cache);
+      out = (sixfive_serve_stream(&server, ctx, stdin, stdout) == sixfive_output_error);
+      sixfive_ctx_free(ctx);
+    }
+    sixfive_cache_free(server.cache);
+    return out;
+  }
+
+#ifdef SIXFIVE_SOCKETS
+  memset(&address, 0, sizeof(address));
+  address.sun_family = AF_UNIX;
+  if(strlen(path) >= sizeof(address.sun_path)){
+    sixfive_print_error("Error: socket path \"%s\" is too long.", path);
+    sixfive_cache_free(server.cache);
+    return 1;
+  }
+  strcpy(address.sun_path, path);
+
+  /* A socket left behind by an earlier server is replaced, but nothing else */
+  if(stat(path, &st) == 0 && S_ISSOCK(st.st_mode)){
+    unlink(path);
+  }
+  server.listener = socket(AF_UNIX, SOCK_STREAM, 0);
+  if(server.listener == -1 ||
+     bind(server.listener, (struct sockaddr*)&address, sizeof(address)) == -1 ||
+     listen(server.listener, SERVE_BACKLOG) == -1){
+    sixfive_print_error("Error: unable to listen on \"%s\".", path);
+    if(server.listener != -1){
+      close(server.listener);
+    }
+    sixfive_cache_free(server.cache);
+    return 1;
+  }
+
+  /* A client which hangs up only ends its own connection */
+  signal(SIGPIPE, SIG_IGN);
+  sixfive_print_info(-1, CYAN "Serving on \"%s\", press Ctrl-C to stop.", path);
+  fflush(stdout);
+
+  for(i=1;i<threads;i++){
+    if(pthread_create(&pool[started], NULL, sixfive_serve_worker, &server) == 0){
+      started++;
+    }
+  }
+  sixfive_serve_worker(&server);
+  for(i=0;i<started;i++){
+    pthread_join(pool[i], NULL);
+  }
+
+  close(server.listener);
+  unlink(path);
+  sixfive_cache_free(server.cache);
+  return 1;
+#else
+  sixfive_print_error("Error: --socket is not supported on this platform.");
+  sixfive_cache_free(server.cache);
+  return 1;
+#endif
 }
 
 /*****************************/
@@ -613,42 +1498,163 @@ int sixfive_parse_string(char *str, FILE *fp_out){
 /*****************************/
 
 int main(int argc, char **argv){
-  FILE *fp_in, *fp_out;
-  int file_len;
-  char *file_buf;
+  sixfive_batch batch;
+  int threads = 1;
+  int tagged = 0;
+  int watch = 0;
+  int stats = sixfive_stats_none;
+  int running = 0;
+  int linking = 0;
+  int serving = 0;
+  int disassembling = 0;
+  char *socket_path = NULL;
+  long origin = -1;
+  const char *name;
+  int top = RUN_DEFAULT_TOP;
+  unsigned long limit = RUN_DEFAULT_LIMIT;
+  int files = 0;
+  int out = 0;
+  int i;
+
+  memset(&batch, 0, sizeof(sixfive_batch));
 
-  if(argc < 3){
-    sixfive_print_info(-1, CYAN "sixfive: a small 6502 assembler.\n" YELLOW "Usage: sixfive [file.S] [out.bin]" RESET);
+  if(argc < 2){
+    sixfive_print_info(-1, CYAN "sixfive: a small 6502 assembler.\n" YELLOW "Usage: sixfive [options] [--watch] [file.S] [out.bin]\n       sixfive [options] - -\n       sixfive [options] [-m manifest] [file.S:out.bin ...]\n       sixfive run [-j threads] [-O] [--limit cycles] [--top n] [file.S]\n       sixfive link [--org address] [out.bin] [file.o ...]\n       sixfive serve [-j threads] [-O] [-c] [--socket path]\n       sixfive -d [--org address] [file.bin] [out.S]\nOptions: -j threads, -O, -c, --stats[=json], --list, --cycles from:to" RESET);
     return 0;
   }
 
-  fp_in = fopen(argv[1], "r");
-  if(fp_in == NULL){
-    sixfive_print_error("Error: unable to open file \"%s\" for reading.", argv[1]);
-    return 1;
+  /* Options first, leaving only files in argv[1 ... files] */
+  name = strrchr(argv[0], '/');
+  name = (name != NULL ? name+1 : argv[0]);
+  running = (strcmp(argv[1], "run") == 0);
+  linking = (strcmp(name, "sixfive-link") == 0 ? -1 : strcmp(argv[1], "link") == 0);
+  serving = (strcmp(argv[1], "serve") == 0);
+  disassembling = (strcmp(argv[1], "-d") == 0);
+  for(i=1+running+(linking > 0)+serving+disassembling;i<argc && out != sixfive_output_error;i++){
+    if(serving && strcmp(argv[i], "--socket") == 0 && i+1 < argc){
+      socket_path = argv[++i];
+    } else if((linking || disassembling) && strcmp(argv[i], "--org") == 0 && i+1 < argc){
+      origin = sixfive_parse_address(argv[++i]);
+      if(origin == -1){
+        sixfive_print_error("Error: expected an address from $0 to $ffff, got \"%s\".", argv[i]);
+        out = sixfive_output_error;
+      }
+    } else if(running && strcmp(argv[i], "--limit") == 0 && i+1 < argc){
+      limit = strtoul(argv[++i], NULL, 10);
+    } else if(running && strcmp(argv[i], "--top") == 0 && i+1 < argc){
+      top = atoi(argv[++i]);
+    } else if(strcmp(argv[i], "-j") == 0 && i+1 < argc){
+      threads = atoi(argv[++i]);
+      if(threads < 1 || threads > MAX_THREADS){
+        sixfive_print_error("Error: thread count must be between 1 and %i.", MAX_THREADS);
+        out = sixfive_output_error;
+      }
+    } else if(strcmp(argv[i], "-m") == 0 && i+1 < argc){
+      out = sixfive_batch_add_manifest(&batch, argv[++i]);
+      tagged = 1;
+    } else if(strcmp(argv[i], "-O") == 0){
+      batch.optimize = 1;
+    } else if(strcmp(argv[i], "-c") == 0){
+      batch.object = 1;
+    } else if(strcmp(argv[i], "--list") == 0){
+      batch.listing = 1;
+    } else if(strcmp(argv[i], "--cycles") == 0 && i+1 < argc){
+      /* Split in place, at the colon */
+      batch.cycles_from = argv[++i];
+      batch.cycles_to = strchr(argv[i], ':');
+      if(batch.cycles_to == NULL || batch.cycles_to == batch.cycles_from || batch.cycles_to[1] == '\0'){
+        sixfive_print_error("Error: expected \"from:to\", got \"%s\".", argv[i]);
+        out = sixfive_output_error;
+      } else {
+        *batch.cycles_to++ = '\0';
+      }
+    } else if(strcmp(argv[i], "--watch") == 0){
+      watch = 1;
+    } else if(strcmp(argv[i], "--stats") == 0){
+      stats = sixfive_stats_text;
+    } else if(strcmp(argv[i], "--stats=json") == 0){
+      stats = sixfive_stats_json;
+    } else {
+      argv[++files] = argv[i];
+    }
   }
-  fseek(fp_in, 0, SEEK_END);
-  file_len = ftell(fp_in);
-  fseek(fp_in, 0, SEEK_SET);
 
-  file_buf = malloc(file_len);
-  fread(file_buf, file_len, 1, fp_in);
+  if(out == sixfive_output_error){
+    /* Already reported */
+  } else if(serving){
+    if(tagged || watch || files != 0){
+      sixfive_print_error("Error: serve takes no files, only requests.");
+      return 1;
+    }
+    return sixfive_serve(socket_path, threads, (batch.optimize ? sixfive_serve_optimize : 0) | (batch.object ? sixfive_serve_object : 0));
+  } else if(disassembling){
+    if(tagged || watch || files < 1 || files > 2){
+      sixfive_print_error("Error: -d takes a single file.bin, and optionally out.S.");
+      return 1;
+    }
+    return sixfive_disassemble_file(argv[1], (files == 2 ? argv[2] : "-"), origin, stats);
+  } else if(linking){
+    if(tagged || watch || files < 2){
+      sixfive_print_error("Error: link takes an out.bin and at least one file.o.");
+      return 1;
+    }
+    return sixfive_link_files(argv[1], argv+2, files-1, origin, stats);
+  } else if(running){
+    if(tagged || watch || files != 1){
+      sixfive_print_error("Error: run takes a single file.S.");
+      return 1;
+    }
+    return sixfive_run_file(&batch, argv[1], threads, limit, top);
+  } else if(watch){
+    if(tagged || files != 2){
+      sixfive_print_error("Error: --watch takes a single file.S and out.bin.");
+      return 1;
+    }
+    batch.stats = stats;
+    return sixfive_watch(&batch, argv[1], argv[2], threads);
+  } else if(!tagged && files == 2 && strchr(argv[1], ':') == NULL){
+    out = sixfive_batch_add(&batch, argv[1], strlen(argv[1]), argv[2], strlen(argv[2]));
+  } else {
+    /* Batches tag diagnostics with their file */
+    tagged = 1;
+    for(i=1;i<=files && out != sixfive_output_error;i++){
+      out = sixfive_batch_add_pair(&batch, argv[i]);
+    }
+  }
 
-  fp_out = fopen(argv[2], "w+b");
-  if(fp_out == NULL){
-    sixfive_print_error("Error: unable to open file \"%s\" for writing.", argv[2]);
-    return 1;
+  /* A listing quotes the source, which stdin does not keep */
+  for(i=0;i<batch.count && out != sixfive_output_error;i++){
+    if(batch.listing && strcmp(batch.jobs[i].in_path, "-") == 0){
+      sixfive_print_error("Error: --list needs a file.S, not stdin.");
+      out = sixfive_output_error;
+    }
   }
 
-  if(sixfive_parse_string(file_buf, fp_out) == sixfive_output_error){
-    remove(argv[2]);
+  if(out != sixfive_output_error){
+    batch.stats = stats;
+    sixfive_batch_run(&batch, threads);
+
+    /* Reported in the order given, whichever thread finished first */
+    out = 0;
+    for(i=0;i<batch.count;i++){
+      out |= sixfive_print_job(&batch.jobs[i], tagged, stats == sixfive_stats_json);
+      if(batch.cycles_from != NULL && batch.jobs[i].status == sixfive_job_success){
+        out |= sixfive_print_cycles(sixfive_report_stream(batch.jobs[i].out_path), &batch, &batch.jobs[i], stats);
+      }
+      if(stats != sixfive_stats_none && batch.jobs[i].status != sixfive_job_read_error){
+        sixfive_print_stats(sixfive_report_stream(batch.jobs[i].out_path), batch.jobs[i].in_path, &batch.jobs[i].stats, batch.jobs[i].read_ms, batch.jobs[i].write_ms, stats);
+      }
+    }
   } else {
-    sixfive_print_info(-1, GREEN "Successfully assembled \"%s\" into \"%s\".", argv[1], argv[2]);
+    out = 1;
   }
-  fclose(fp_out);
 
-  free(file_buf);
-  fclose(fp_in);
+  for(i=0;i<batch.count;i++){
+    free(batch.jobs[i].in_path);
+    free(batch.jobs[i].out_path);
+    free(batch.jobs[i].diagnostics);
+  }
+  free(batch.jobs);
 
-  return 0;
+  return out;
 }
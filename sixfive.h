@@ -0,0 +1,423 @@
+/*
+ * sixfive.h: libsixfive, an assembler for the 6502 microprocessor
+ *
+ * Assembles a source held in memory into a caller-provided buffer,
+ * using a context which holds all state for one assembly at a time.
+ * Contexts share nothing, so each thread may use its own, and a
+ * context may be reused without reallocating.
+ */
+
+#ifndef SIXFIVE_H
+#define SIXFIVE_H
+
+/*****************************/
+/* PREPROCESSOR              */
+/*****************************/
+
+/* The 6502's address space, and so the largest possible output */
+#define SIXFIVE_OUTPUT_MAX_LENGTH 0x10000
+#define SIXFIVE_MESSAGE_LENGTH 128
+
+#define RED     "\x1b[31m"
+#define GREEN   "\x1b[32m"
+#define YELLOW  "\x1b[33m"
+#define BLUE    "\x1b[34m"
+#define MAGENTA "\x1b[35m"
+#define CYAN    "\x1b[36m"
+#define RESET   "\x1b[0m"
+
+/*****************************/
+/* ENUMS AND TYPEDEFS        */
+/*****************************/
+
+/* Used for clarity in return statements */
+enum {
+  sixfive_output_error=-1,
+  sixfive_output_none=0,
+  sixfive_output_success=1
+};
+
+/* Opaque, see libsixfive.c */
+typedef struct sixfive_ctx sixfive_ctx;
+typedef struct sixfive_cache sixfive_cache;
+
+/*
+ * An error found while assembling, on
+ * the given line of the source (or 0
+ * if it does not belong to one)
+ */
+typedef struct sixfive_diagnostic {
+  int line;
+  char message[SIXFIVE_MESSAGE_LENGTH];
+} sixfive_diagnostic;
+
+/*
+ * The diagnostics of the last assembly,
+ * owned by (and valid until the next use
+ * of) its context
+ */
+typedef struct sixfive_diagnostics {
+  const sixfive_diagnostic *list;
+  int count;
+} sixfive_diagnostics;
+
+/*
+ * A line of source which assembled into
+ * length bytes of the output, from offset,
+ * which the program runs at address
+ *
+ * An instruction takes from cycles to
+ * cycles_max cycles, the most if it is a
+ * branch that is taken, or crosses is set
+ * and the page crossings it may make add
+ * a cycle each.  Directives take none.
+ */
+typedef struct sixfive_listing_line {
+  int line;
+  long offset;
+  long address;
+  int length;
+  int cycles;
+  int cycles_max;
+  int crosses;
+} sixfive_listing_line;
+
+/*
+ * The listing of the last assembly, in
+ * output order, owned by (and valid until
+ * the next use of) its context
+ */
+typedef struct sixfive_listing {
+  const sixfive_listing_line *list;
+  int count;
+} sixfive_listing;
+
+/* Why a run stopped */
+enum {
+  sixfive_run_brk=0,
+  sixfive_run_return=1,
+  sixfive_run_limit=2,
+  sixfive_run_illegal=3
+};
+
+/*
+ * How a run of the output went: why and
+ * where (at pc) it stopped, how many
+ * instructions it ran and cycles they
+ * took, and for each address, how many
+ * times the instruction there ran and how
+ * many cycles it took in all
+ *
+ * counts and address_cycles are owned by
+ * (and valid until the next run with) the
+ * context.
+ */
+typedef struct sixfive_run {
+  int status;
+  long pc;
+  unsigned long instructions;
+  unsigned long cycles;
+  const unsigned long *counts;
+  const unsigned long *address_cycles;
+} sixfive_run;
+
+/*
+ * A listed line of the last assembly, of
+ * length bytes at label_offset bytes past
+ * label (or NULL if no label comes before
+ * it), which the last run ran count times,
+ * taking cycles cycles in all
+ */
+typedef struct sixfive_profile_line {
+  int line;
+  long address;
+  int length;
+  const char *label;
+  long label_offset;
+  unsigned long count;
+  unsigned long cycles;
+} sixfive_profile_line;
+
+/*
+ * The profile of the last run, in the
+ * listing's order, owned by (and valid
+ * until the next use of) its context
+ */
+typedef struct sixfive_profile {
+  const sixfive_profile_line *list;
+  int count;
+} sixfive_profile;
+
+/*
+ * What the last assembly with a context did:
+ * the time spent in each phase (measured only
+ * once enabled with sixfive_ctx_set_stats), and
+ * how much of each kind of work it took
+ *
+ * Rebuilds by sixfive_reassemble count only the
+ * lines they parsed again.  relax_saved is the
+ * number of bytes saved by shortening operands
+ * and branches, in relax_passes passes, and
+ * optimize_bytes and optimize_cycles what the
+ * optimizer saved (counting branches as not
+ * taken).
+ */
+typedef struct sixfive_stats {
+  double parse_ms;
+  double layout_ms;
+  double link_ms;
+  double total_ms;
+  long lines;
+  long tokens;
+  long allocations;
+  long label_lookups;
+  long label_probes;
+  long label_probe_max;
+  long fixups;
+  long bytes;
+  long relax_passes;
+  long relax_saved;
+  long optimize_bytes;
+  long optimize_cycles;
+} sixfive_stats;
+
+/*
+ * An object, written by assembling with
+ * objects enabled, to be linked with
+ * others by sixfive_link, where name (or
+ * NULL) is used in its diagnostics
+ */
+typedef struct sixfive_object {
+  const unsigned char *data;
+  long length;
+  const char *name;
+} sixfive_object;
+
+/*
+ * A source file, either mmapped or
+ * read into memory
+ */
+typedef struct sixfive_source {
+  const char *data;
+  long length;
+  int mapped;
+} sixfive_source;
+
+/*****************************/
+/* LOGGING UTILITIES         */
+/*****************************/
+
+void sixfive_print_info(int depth, char *str, ...);
+void sixfive_print_error(char *str, ...);
+
+/*****************************/
+/* CONTEXTS                  */
+/*****************************/
+
+sixfive_ctx *sixfive_ctx_new(void);
+void sixfive_ctx_free(sixfive_ctx *ctx);
+
+/*
+ * Lets sixfive_assemble split large files
+ * (of at least 128 KiB) into runs of lines,
+ * assembled on up to this many threads, with
+ * output identical to that of one thread
+ */
+void sixfive_ctx_set_threads(sixfive_ctx *ctx, int threads);
+
+/*
+ * Sets the directory which files named by
+ * .incbin are found relative to, given as
+ * len bytes of dir (by default, and if len
+ * is 0, the current directory)
+ */
+int sixfive_ctx_set_directory(sixfive_ctx *ctx, const char *dir, int len);
+
+/*
+ * Has .include read its files from a cache,
+ * which any number of contexts (on any
+ * number of threads) may share, so that each
+ * file is read and split into tokens once
+ * until it is modified
+ *
+ * Without one (or given NULL), a context
+ * keeps a cache of its own.  A cache must
+ * outlive every context given it.
+ */
+void sixfive_ctx_set_cache(sixfive_ctx *ctx, sixfive_cache *cache);
+
+/*
+ * Enables the optimizer, which looks at each
+ * pair of consecutive lines, without changing
+ * what the program does.  It removes only:
+ *   - An immediate load (or transfer) whose
+ *     register the next line sets again
+ *   - A transfer straight back (as TXA after
+ *     TAX), or a repeated SEI or CLI
+ *   - A flag change the next line undoes
+ *   - A JMP or branch to the next line
+ * and makes a JSR followed by RTS a JMP.
+ *
+ * Loads from memory and stores are never
+ * removed, as they may have side effects (as
+ * on IO registers), nor is PLA.
+ */
+void sixfive_ctx_set_optimize(sixfive_ctx *ctx, int enabled);
+
+/*
+ * Enables listing where each line of the
+ * source ended up, and the cycles it takes,
+ * once assembled
+ */
+void sixfive_ctx_set_listing(sixfive_ctx *ctx, int enabled);
+void sixfive_ctx_listing(sixfive_ctx *ctx, sixfive_listing *listing);
+
+/*
+ * Enables assembling into an object rather
+ * than a program, to be linked with others,
+ * of the labels named by .export and using
+ * those named by .import
+ *
+ * Its code is placed by the linker, unless
+ * it starts with a .org, so until then is
+ * never assumed to be in the zero page.
+ * sixfive_ctx_object hands it over, owned
+ * by (and valid until the next use of) the
+ * context, once assembled.
+ */
+void sixfive_ctx_set_object(sixfive_ctx *ctx, int enabled);
+void sixfive_ctx_object(sixfive_ctx *ctx, sixfive_object *object);
+
+/*
+ * Sums the cycles of the last assembly's
+ * listing, from the label from up to the
+ * label to, into *min and *max, as though
+ * each instruction between them ran once
+ *
+ * Fails if listing is not enabled, or if
+ * either label is unknown or to comes
+ * before from.
+ */
+int sixfive_ctx_cycles(sixfive_ctx *ctx, const char *from, const char *to, long *min, long *max);
+
+/*
+ * Runs the output of the last assembly on
+ * a 6502, loaded at its origin in otherwise
+ * empty memory and started there, until it
+ * reaches a BRK, returns with an RTS from
+ * where it started, reaches an opcode the
+ * 6502 lacks, or has run for limit cycles
+ *
+ * Fails if the last assembly did.
+ */
+int sixfive_ctx_run(sixfive_ctx *ctx, unsigned long limit, sixfive_run *run);
+
+/*
+ * Maps the last run back to the lines of
+ * the source, which needs listing enabled
+ */
+int sixfive_ctx_profile(sixfive_ctx *ctx, sixfive_profile *profile);
+
+/*
+ * Returns the address which the output of
+ * the last assembly starts at, as set by a
+ * leading .org (or 0)
+ */
+long sixfive_ctx_origin(sixfive_ctx *ctx);
+
+/*
+ * Enables timing each phase of assembly,
+ * which costs a clock reading per phase
+ * (counts are always kept)
+ */
+void sixfive_ctx_set_stats(sixfive_ctx *ctx, int enabled);
+void sixfive_ctx_stats(sixfive_ctx *ctx, sixfive_stats *stats);
+
+/*****************************/
+/* CACHES                    */
+/*****************************/
+
+sixfive_cache *sixfive_cache_new(void);
+void sixfive_cache_free(sixfive_cache *cache);
+
+/*****************************/
+/* ASSEMBLY                  */
+/*****************************/
+
+/*
+ * Assembles len bytes of source into out_buf,
+ * which can hold *out_len bytes (a buffer of
+ * SIXFIVE_OUTPUT_MAX_LENGTH always suffices)
+ *
+ * On success, sets *out_len to the number of
+ * bytes assembled.  On error, fills in the
+ * diagnostics (which may be NULL) instead.
+ */
+int sixfive_assemble(sixfive_ctx *ctx, const char *src, long len, unsigned char *out_buf, long *out_len, sixfive_diagnostics *diagnostics);
+
+/*
+ * As sixfive_assemble, but for a source which
+ * is edited between calls: only the lines
+ * that changed since the last call with this
+ * context are parsed again, and only the
+ * bytes that moved are linked again
+ *
+ * The context keeps a copy of the source, so
+ * src need not outlive the call.
+ */
+int sixfive_reassemble(sixfive_ctx *ctx, const char *src, long len, unsigned char *out_buf, long *out_len, sixfive_diagnostics *diagnostics);
+
+/*
+ * As sixfive_assemble, but for a source given
+ * a piece at a time (of any length, split
+ * anywhere) by sixfive_stream_write, between
+ * sixfive_stream_begin and sixfive_stream_end
+ *
+ * Only the lines not yet parsed are kept, so
+ * the memory used grows with the output and
+ * its labels rather than the source, unless
+ * it uses .macro, .rept, or .include, which
+ * keep the rest of it.  A failed write has
+ * its diagnostics filled in by the end.
+ */
+void sixfive_stream_begin(sixfive_ctx *ctx);
+int sixfive_stream_write(sixfive_ctx *ctx, const char *data, long len);
+int sixfive_stream_end(sixfive_ctx *ctx, unsigned char *out_buf, long *out_len, sixfive_diagnostics *diagnostics);
+
+/*
+ * Links count objects into a program, in
+ * out_buf as for sixfive_assemble, placing
+ * each where the last ended, or where its
+ * .org put it
+ *
+ * The program starts at origin, or if it
+ * is -1, at the first object's .org (or 0).
+ */
+int sixfive_link(sixfive_ctx *ctx, const sixfive_object *objects, int count, long origin, unsigned char *out_buf, long *out_len, sixfive_diagnostics *diagnostics);
+
+/*****************************/
+/* DISASSEMBLY               */
+/*****************************/
+
+/*
+ * Disassembles len bytes of a program, which
+ * starts at origin, into source which
+ * assembles back into the same bytes, with a
+ * label (named L and its address, as L8000)
+ * at each line that an operand uses
+ *
+ * Sets *text and *text_len to it, owned by
+ * (and valid until the next use of) the
+ * context.  Fails if the program does not
+ * fit below $10000.
+ */
+int sixfive_disassemble(sixfive_ctx *ctx, const unsigned char *data, long len, long origin, const char **text, long *text_len, sixfive_diagnostics *diagnostics);
+
+/*****************************/
+/* INPUT                     */
+/*****************************/
+
+int sixfive_source_open(sixfive_source *src, char *path);
+void sixfive_source_close(sixfive_source *src);
+
+#endif